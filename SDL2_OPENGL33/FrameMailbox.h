@@ -0,0 +1,67 @@
+#ifndef FRAME_MAILBOX_H
+#define FRAME_MAILBOX_H
+
+#include <atomic>
+
+//Hands the newest frame snapshot from the simulation thread to the render
+//thread without either one waiting. Three slots: the writer fills one, the
+//reader reads another and the third holds the latest published snapshot.
+//publish() swaps the writer's slot with the third, acquire() swaps the
+//reader's with it if something new arrived. Snapshots the reader never
+//picked up are overwritten, the reader always gets the newest one whole.
+//Slots are reused, so a snapshot holding vectors stops allocating once
+//every slot has been written.
+template <typename T>
+class FrameMailbox
+{
+public:
+    FrameMailbox() : m_writeSlot(0), m_readSlot(1), m_published(0), m_read(0)
+    {
+        m_shared.store(2, std::memory_order_relaxed);
+    }
+
+    //writer thread: the slot to fill, it keeps its contents from the last
+    //time it was written
+    T& beginWrite() { return m_slots[m_writeSlot]; }
+    void publish()
+    {
+        int previous = m_shared.exchange(m_writeSlot | FRESH, std::memory_order_acq_rel);
+        m_writeSlot = previous & ~FRESH;
+        m_published++;
+    }
+
+    //reader thread: moves to the newest snapshot, false if nothing was
+    //published since the last call
+    bool acquire()
+    {
+        if (!(m_shared.load(std::memory_order_relaxed) & FRESH)) {
+            return false;
+        }
+        int previous = m_shared.exchange(m_readSlot, std::memory_order_acq_rel);
+        m_readSlot = previous & ~FRESH;
+        m_read++;
+        return true;
+    }
+    const T& read() const { return m_slots[m_readSlot]; }
+
+    //snapshots published and picked up, the difference was skipped. Each
+    //count belongs to its thread, read them from the other one afterwards.
+    unsigned int getPublished() const { return m_published; }
+    unsigned int getRead() const { return m_read; }
+
+private:
+    static const int FRESH = 4;
+
+    T m_slots[3];
+    int m_writeSlot;
+    int m_readSlot;
+    unsigned int m_published;
+    unsigned int m_read;
+    //slot index of the latest snapshot, with FRESH until it is read
+    std::atomic<int> m_shared;
+
+    FrameMailbox(const FrameMailbox&);
+    FrameMailbox& operator=(const FrameMailbox&);
+};
+
+#endif
@@ -16,6 +16,9 @@ using namespace std;
 glm::mat4  P = glm::mat4(1);
 glm::mat4 MV = glm::mat4(1);
 
+//resolved MVP uniform of the triangle shader
+GLSLShader::UniformHandle mvpUniform;
+
 Game* Game::s_pInstance = 0;
 
 Game::Game():
@@ -87,6 +90,9 @@ GAME_STATUS_TAG Game::init(const char* title, int xpos, int ypos, int width, int
     //set the polygon mode to render lines
     //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
+    //reuse programs linked by a previous run
+    GLSLShader::SetProgramCacheDirectory("shadercache");
+
     //GL_CHECK_ERRORS
     //load shader
     m_pShader->LoadFromFile(GL_VERTEX_SHADER, "shaders/shader.vert");
@@ -98,8 +104,10 @@ GAME_STATUS_TAG Game::init(const char* title, int xpos, int ypos, int width, int
         m_pShader->AddAttribute("vVertex");
         m_pShader->AddAttribute("vColor");
         m_pShader->AddUniform("MVP");
+        mvpUniform = m_pShader->GetUniform("MVP");
     m_pShader->UnUse();
     //GL_CHECK_ERRORS
+    GLSLShader::PrintProgramCacheStats(cout);
 
     //triangle vertices and indices
     Vertex vertices[3];
@@ -153,14 +161,14 @@ GAME_STATUS_TAG Game::init(const char* title, int xpos, int ypos, int width, int
     return GAME_INIT_SUCCESS;
 }
 
-void Game::render()
+void Game::render(float alpha)
 {
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     //bind the shader
     m_pShader->Use();
     //pass the shader uniform
-    glUniformMatrix4fv((*m_pShader)("MVP"), 1, GL_FALSE, glm::value_ptr(P*MV));
+    m_pShader->SetUniform(mvpUniform, P*MV);
     //drwa triangle
     glDrawElements(GL_TRIANGLES, 3, GL_UNSIGNED_SHORT, 0);
     //unbind the shader
@@ -197,7 +205,7 @@ void Game::handleEvents()
     TheInputHandler::Instance()->update();
 }
 
-void Game::update()
+void Game::update(float dt)
 {
     //m_pGameStateMachine->update();
 }
\ No newline at end of file
@@ -33,8 +33,13 @@ public:
         return s_pInstance;
     }
 
-    void render();
-    void update();
+    //alpha is how far the frame is from the last update towards the next one,
+    //0 to 1, for blending the last two simulation states. Runs on the thread
+    //with the GL context, like handleEvents.
+    void render(float alpha);
+    //advances the simulation by one fixed step of dt seconds. May run on the
+    //simulation thread, state render needs goes through a FrameMailbox.
+    void update(float dt);
     void handleEvents();
     void quit();
     void clean();
@@ -0,0 +1,195 @@
+#include "GameLoop.h"
+#include "Game.h"
+#include "InputRecorder.h"
+#include <thread>
+
+//frame time added to the accumulator at most, after a breakpoint or a long
+//load the simulation catches up this much instead of stalling on updates
+const double MAX_FRAME_SECONDS = 0.25;
+
+//the last stretch of a frame that is spun instead of slept
+const double SPIN_SECONDS = 0.002;
+
+GameLoop* GameLoop::s_pInstance = 0;
+
+GameLoop::GameLoop():
+m_step(1.0 / 60.0),
+m_frameLimit(60.0),
+m_bSimulationThread(true),
+m_runStart(0),
+m_bReplaying(false),
+m_replayTime(0),
+m_stepEnd(0),
+m_totalSeconds(0)
+{
+    m_frequency = static_cast<double>(SDL_GetPerformanceFrequency());
+    m_lastStepEnd.store(0);
+    m_bSimulating.store(false);
+    m_updateStats.calls = m_renderStats.calls = 0;
+    m_updateStats.busySeconds = m_renderStats.busySeconds = 0;
+    m_updateStats.longestSeconds = m_renderStats.longestSeconds = 0;
+}
+
+double GameLoop::now() const
+{
+    if (m_bReplaying) {
+        return m_replayTime;
+    }
+    return (SDL_GetPerformanceCounter() - m_runStart) / m_frequency;
+}
+
+float GameLoop::getAlpha(double stepEnd) const
+{
+    double alpha = (now() - stepEnd) / m_step;
+    return static_cast<float>((alpha < 0) ? 0 : (alpha > 1) ? 1 : alpha);
+}
+
+void GameLoop::addCall(ThreadStats& stats, double seconds)
+{
+    stats.calls++;
+    stats.busySeconds += seconds;
+    stats.longestSeconds = (seconds > stats.longestSeconds) ? seconds : stats.longestSeconds;
+}
+
+void GameLoop::waitUntil(Uint64 deadline) const
+{
+    Uint64 now = SDL_GetPerformanceCounter();
+    if (now >= deadline) {
+        return;
+    }
+    double remaining = (deadline - now) / m_frequency;
+    if (remaining > SPIN_SECONDS) {
+        SDL_Delay(static_cast<Uint32>((remaining - SPIN_SECONDS) * 1000.0));
+    }
+    while (SDL_GetPerformanceCounter() < deadline) {
+    }
+}
+
+void GameLoop::simulate(double& accumulator, double frameTime)
+{
+    while (accumulator >= m_step) {
+        //the step ends where the time left in the accumulator begins
+        m_stepEnd = frameTime - (accumulator - m_step);
+        Uint64 start = SDL_GetPerformanceCounter();
+        TheGame::Instance()->update(static_cast<float>(m_step));
+        addCall(m_updateStats, (SDL_GetPerformanceCounter() - start) / m_frequency);
+        accumulator -= m_step;
+        m_lastStepEnd.store(m_stepEnd);
+    }
+}
+
+void GameLoop::runSimulation()
+{
+    double accumulator = 0;
+    Uint64 previous = m_runStart;
+    while (m_bSimulating.load()) {
+        Uint64 stepStart = SDL_GetPerformanceCounter();
+        double elapsed = (stepStart - previous) / m_frequency;
+        previous = stepStart;
+        accumulator += (elapsed < MAX_FRAME_SECONDS) ? elapsed : MAX_FRAME_SECONDS;
+        simulate(accumulator, (stepStart - m_runStart) / m_frequency);
+
+        //sleep until the next step is due, without spinning a core the
+        //render thread may need. Oversleeping only makes the next call run
+        //two steps.
+        double remaining = m_step - accumulator - (SDL_GetPerformanceCounter() - stepStart) / m_frequency;
+        SDL_Delay((remaining > 0) ? static_cast<Uint32>(remaining * 1000.0) + 1 : 0);
+    }
+}
+
+void GameLoop::runFrames()
+{
+    double accumulator = 0;
+    Uint64 previous = m_runStart;
+    Uint64 deadline = m_runStart;
+    while (TheGame::Instance()->running()) {
+        Uint64 frameStart = SDL_GetPerformanceCounter();
+        double frameTime = (frameStart - m_runStart) / m_frequency;
+        if (!m_bSimulationThread) {
+            double frameSeconds = (frameStart - previous) / m_frequency;
+            previous = frameStart;
+            //a recording keeps the measured time, a replay swaps in the
+            //recorded one until it runs out
+            if (!TheInputRecorder::Instance()->beginFrame(frameSeconds)) {
+                TheGame::Instance()->quit();
+                break;
+            }
+            if (m_bReplaying) {
+                m_replayTime += frameSeconds;
+                frameTime = m_replayTime;
+            }
+            accumulator += (frameSeconds < MAX_FRAME_SECONDS) ? frameSeconds : MAX_FRAME_SECONDS;
+        }
+
+        TheGame::Instance()->handleEvents();
+        Uint64 eventsEnd = SDL_GetPerformanceCounter();
+        if (!m_bSimulationThread) {
+            simulate(accumulator, frameTime);
+        }
+        Uint64 renderStart = SDL_GetPerformanceCounter();
+        TheGame::Instance()->render(getAlpha(m_lastStepEnd.load()));
+        Uint64 renderEnd = SDL_GetPerformanceCounter();
+        //events and render, updates are counted apart on either thread
+        addCall(m_renderStats, (eventsEnd - frameStart + renderEnd - renderStart) / m_frequency);
+
+        if (m_frameLimit > 0) {
+            //deadlines advance by whole periods so the rate does not drift,
+            //a frame that missed its deadline starts the count again
+            Uint64 period = static_cast<Uint64>(m_frequency / m_frameLimit);
+            deadline += period;
+            if (deadline < renderEnd) {
+                deadline = renderEnd;
+            }
+            waitUntil(deadline);
+        }
+    }
+}
+
+void GameLoop::run()
+{
+    m_updateStats.calls = m_renderStats.calls = 0;
+    m_updateStats.busySeconds = m_renderStats.busySeconds = 0;
+    m_updateStats.longestSeconds = m_renderStats.longestSeconds = 0;
+    m_runStart = SDL_GetPerformanceCounter();
+    m_stepEnd = 0;
+    m_lastStepEnd.store(0);
+    m_bReplaying = TheInputRecorder::Instance()->isReplaying();
+    m_replayTime = 0;
+    if (m_bReplaying || TheInputRecorder::Instance()->isRecording()) {
+        m_bSimulationThread = false;
+    }
+
+    if (m_bSimulationThread) {
+        m_bSimulating.store(true);
+        std::thread simulation(&GameLoop::runSimulation, this);
+        runFrames();
+        m_bSimulating.store(false);
+        simulation.join();
+    } else {
+        runFrames();
+    }
+    //wall time, also on a replay
+    m_totalSeconds = (SDL_GetPerformanceCounter() - m_runStart) / m_frequency;
+    m_bReplaying = false;
+}
+
+void GameLoop::printStats(std::ostream& out) const
+{
+    if (m_renderStats.calls == 0 || m_totalSeconds <= 0) {
+        return;
+    }
+    const char* names[2] = {"update", "render"};
+    const ThreadStats* stats[2] = {&m_updateStats, &m_renderStats};
+    out << m_renderStats.calls << " frames in " << m_totalSeconds << " s, "
+        << m_renderStats.calls / m_totalSeconds << " fps, "
+        << (m_bSimulationThread ? "simulation thread" : "single thread") << std::endl;
+    for (int i = 0; i < 2; i++) {
+        if (stats[i]->calls == 0) {
+            continue;
+        }
+        out << "\t" << names[i] << ": " << stats[i]->calls << " calls, "
+            << stats[i]->busySeconds * 1000.0 / stats[i]->calls << " ms average, "
+            << stats[i]->longestSeconds * 1000.0 << " ms longest, busy "
+            << stats[i]->busySeconds * 100.0 / m_totalSeconds << "% of the run" << std::endl;
+    }
+}
@@ -0,0 +1,102 @@
+#ifndef GAME_LOOP_H
+#define GAME_LOOP_H
+
+#include <SDL.h>
+#include <atomic>
+#include <ostream>
+
+//Drives TheGame with a fixed simulation step. Frame time is measured with the
+//high resolution performance counter and added to an accumulator, update(dt)
+//runs once per whole step in it and render(alpha) gets how far the frame is
+//past the end of the last step, so rendering can blend the last two
+//simulation states and the simulation runs at the same speed whatever the
+//frame rate.
+//
+//With a simulation thread update runs there on its own accumulator while
+//handleEvents and render stay on the thread with the GL context. The game
+//then hands its state to render through a FrameMailbox, stamping each
+//snapshot with getStepEnd() and blending with getAlpha() of that stamp.
+//
+//With a frame limit every frame is held to its deadline: SDL_Delay sleeps the
+//whole milliseconds that are safe to sleep and the rest is spun away, as
+//sleeps overshoot by up to a scheduler tick. A limit of 0 is uncapped.
+//
+//While TheInputRecorder records or replays the loop runs single threaded, so
+//steps are tied to frames. A replay advances the clock by the recorded frame
+//times instead of the performance counter, now() included, and ends with the
+//recording: every build then runs the same steps with the same input and
+//alphas, only the timings differ.
+class GameLoop
+{
+public:
+    static GameLoop* Instance()
+    {
+        if (s_pInstance == 0) {
+            s_pInstance = new GameLoop();
+        }
+
+        return s_pInstance;
+    }
+
+    void setStep(double stepSeconds) { m_step = stepSeconds; }
+    double getStep() const { return m_step; }
+
+    //frames per second, 0 for uncapped
+    void setFrameLimit(double frameLimit) { m_frameLimit = frameLimit; }
+    double getFrameLimit() const { return m_frameLimit; }
+
+    void setSimulationThread(bool simulationThread) { m_bSimulationThread = simulationThread; }
+    bool getSimulationThread() const { return m_bSimulationThread; }
+
+    //runs until TheGame stops running
+    void run();
+
+    //seconds since run started, on a replay the recorded time of this frame
+    double now() const;
+    //inside update: the time the step being simulated ends at
+    double getStepEnd() const { return m_stepEnd; }
+    //how far now is past stepEnd in steps, 0 to 1
+    float getAlpha(double stepEnd) const;
+
+    //per thread timings of the last run
+    struct ThreadStats {
+        int calls;
+        double busySeconds;
+        double longestSeconds;
+    };
+    const ThreadStats& getUpdateStats() const { return m_updateStats; }
+    const ThreadStats& getRenderStats() const { return m_renderStats; }
+    void printStats(std::ostream& out) const;
+
+private:
+    GameLoop();
+
+    void runSimulation();
+    void runFrames();
+    //updates for the steps in accumulator, frameTime seconds into the run
+    void simulate(double& accumulator, double frameTime);
+    void waitUntil(Uint64 deadline) const;
+    static void addCall(ThreadStats& stats, double seconds);
+
+    static GameLoop* s_pInstance;
+
+    double m_step;
+    double m_frameLimit;
+    bool m_bSimulationThread;
+    double m_frequency;
+    Uint64 m_runStart;
+    bool m_bReplaying;
+    double m_replayTime;
+
+    double m_stepEnd;
+    std::atomic<double> m_lastStepEnd;
+    std::atomic<bool> m_bSimulating;
+
+    ThreadStats m_updateStats;
+    ThreadStats m_renderStats;
+    double m_totalSeconds;
+};
+
+typedef GameLoop TheGameLoop;
+
+#endif
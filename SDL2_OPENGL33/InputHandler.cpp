@@ -1,23 +1,29 @@
 #include <iostream>
+#include <string.h>
 #include "InputHandler.h"
 #include "Game.h"
+#include "InputRecorder.h"
 
 InputHandler* InputHandler::s_pInstance = 0;
+const int InputHandler::m_eventRingSize;
 
 InputHandler::InputHandler() :
     m_bJoysticksInitialised(false),
     m_mousePosition(new Vector2D(0, 0)),
-    m_keystate(0)
+    m_mouseDelta(0, 0),
+    m_eventCount(0),
+    m_nextEvent(0),
+    m_droppedEvents(0)
 {
     for (int i = 0; i < 3; i++) {
         m_mouseButtonStates.push_back(false);
     }
+    memset(m_keystate, 0, sizeof(m_keystate));
 }
 
 InputHandler::~InputHandler()
 {
     delete m_mousePosition;
-    delete m_keystate;
 
     m_joystickValues.clear();
     m_joysticks.clear();
@@ -105,65 +111,176 @@ int InputHandler::yvalue(int joy, int stick)
 
 bool InputHandler::isKeyDown(SDL_Scancode key)
 {
-    if (m_keystate != 0) {
-        if (m_keystate[key] == 1) {
-            return true;
-        } else {
-            return false;
-        }
-    }
+    return m_keystate[key] == 1;
+}
 
-    return false;
+int InputHandler::getEventCount() const
+{
+    return m_eventCount;
+}
+
+const InputEvent& InputHandler::getEvent(int index) const
+{
+    int slot = m_nextEvent - m_eventCount + index;
+    return m_events[(slot < 0) ? slot + m_eventRingSize : slot];
 }
 
 void InputHandler::update()
 {
+    m_eventCount = 0;
+    m_droppedEvents = 0;
+    m_mouseDelta = Vector2D(0, 0);
+
+    //everything that arrived since the last frame, not just one event
+    InputRecorder* recorder = TheInputRecorder::Instance();
     SDL_Event event;
-    if (SDL_PollEvent(&event))
+    InputEvent input;
+    while (SDL_PollEvent(&event)) {
+        if (!translateEvent(event, input)) {
+            continue;
+        }
+        //a replay only takes closing the window from the live queue, a
+        //recording ends where the run does and needs no quit
+        if (input.type != INPUT_QUIT) {
+            if (recorder->isReplaying()) {
+                continue;
+            }
+            if (recorder->isRecording()) {
+                recorder->recordEvent(input);
+            }
+        }
+        addEvent(input);
+    }
+
+    if (recorder->isReplaying()) {
+        for (int i = 0; i < recorder->getFrameEventCount(); i++) {
+            addEvent(recorder->getFrameEvent(i));
+        }
+    }
+}
+
+bool InputHandler::translateEvent(const SDL_Event& event, InputEvent& input)
+{
+    memset(&input, 0, sizeof(input));
+    input.timestamp = event.common.timestamp;
+    switch (event.type)
+    {
+    case SDL_QUIT:
+        input.type = INPUT_QUIT;
+        break;
+    case SDL_JOYAXISMOTION:
+        input.type = INPUT_JOYSTICK_AXIS;
+        input.device = static_cast<Uint8>(event.jaxis.which);
+        input.code = event.jaxis.axis;
+        input.x = event.jaxis.value;
+        break;
+    case SDL_JOYBUTTONDOWN:
+    case SDL_JOYBUTTONUP:
+        input.type = (event.type == SDL_JOYBUTTONDOWN) ? INPUT_JOYSTICK_BUTTON_DOWN : INPUT_JOYSTICK_BUTTON_UP;
+        input.device = static_cast<Uint8>(event.jbutton.which);
+        input.code = event.jbutton.button;
+        break;
+    case SDL_MOUSEBUTTONDOWN:
+    case SDL_MOUSEBUTTONUP:
+        input.type = (event.type == SDL_MOUSEBUTTONDOWN) ? INPUT_MOUSE_BUTTON_DOWN : INPUT_MOUSE_BUTTON_UP;
+        input.code = event.button.button;
+        input.x = static_cast<Sint16>(event.button.x);
+        input.y = static_cast<Sint16>(event.button.y);
+        break;
+    case SDL_MOUSEMOTION:
+        input.type = INPUT_MOUSE_MOTION;
+        input.x = static_cast<Sint16>(event.motion.x);
+        input.y = static_cast<Sint16>(event.motion.y);
+        input.dx = static_cast<Sint16>(event.motion.xrel);
+        input.dy = static_cast<Sint16>(event.motion.yrel);
+        break;
+    case SDL_KEYDOWN:
+    case SDL_KEYUP:
+        input.type = (event.type == SDL_KEYDOWN) ? INPUT_KEY_DOWN : INPUT_KEY_UP;
+        input.code = static_cast<Uint16>(event.key.keysym.scancode);
+        break;
+    default:
+        return false;
+    }
+    return true;
+}
+
+void InputHandler::addEvent(const InputEvent& input)
+{
+    m_events[m_nextEvent] = input;
+    m_nextEvent = (m_nextEvent + 1) % m_eventRingSize;
+    if (m_eventCount < m_eventRingSize) {
+        m_eventCount++;
+    } else {
+        m_droppedEvents++;
+    }
+
+    switch (input.type)
     {
-        switch (event.type)
-        {
-        case SDL_QUIT:
-            TheGame::Instance()->quit();
-            break;
-        case SDL_JOYAXISMOTION:
-            onJoystickAxisMove(event);
-            break;
-        case SDL_JOYBUTTONDOWN:
-            onJoystickButtonDown(event);
-            break;
-        case SDL_JOYBUTTONUP:
-            onJoystickButtonUp(event);
-            break;
-        case SDL_MOUSEBUTTONDOWN:
-            onMouseButtonDown(event);
-            break;
-        case SDL_MOUSEBUTTONUP:
-            onMouseButtonUp(event);
-            break;
-        case SDL_MOUSEMOTION:
-            onMouseMove(event);
-            break;
-        case SDL_KEYDOWN:
-            onKeyDown();
-            break;
-        case SDL_KEYUP:
-            onKeyUp();
-            break;
-        default:
-            break;
+    case INPUT_QUIT:
+        TheGame::Instance()->quit();
+        break;
+    case INPUT_JOYSTICK_AXIS:
+        onJoystickAxisMove(input);
+        break;
+    case INPUT_JOYSTICK_BUTTON_DOWN:
+        onJoystickButtonDown(input);
+        break;
+    case INPUT_JOYSTICK_BUTTON_UP:
+        onJoystickButtonUp(input);
+        break;
+    case INPUT_MOUSE_BUTTON_DOWN:
+        onMouseButtonDown(input);
+        break;
+    case INPUT_MOUSE_BUTTON_UP:
+        onMouseButtonUp(input);
+        break;
+    case INPUT_MOUSE_MOTION:
+        onMouseMove(input);
+        break;
+    case INPUT_KEY_DOWN:
+        onKeyDown(input);
+        break;
+    case INPUT_KEY_UP:
+        onKeyUp(input);
+        break;
+    default:
+        break;
+    }
+}
+
+bool InputHandler::hasJoystick(int device, int button)
+{
+    //a replay may come from a machine with other joysticks, their state is
+    //made up as their events arrive
+    if (TheInputRecorder::Instance()->isReplaying()) {
+        while (static_cast<int>(m_joystickValues.size()) <= device) {
+            m_joystickValues.push_back(std::make_pair(new Vector2D(0, 0),
+                new Vector2D(0, 0)));
+        }
+        while (static_cast<int>(m_buttonStates.size()) <= device) {
+            m_buttonStates.push_back(std::vector<bool>());
+        }
+        if (button >= static_cast<int>(m_buttonStates[device].size())) {
+            m_buttonStates[device].resize(button + 1, false);
         }
     }
+
+    if (device >= static_cast<int>(m_joystickValues.size())) {
+        return false;
+    }
+    return button < static_cast<int>(m_buttonStates[device].size());
 }
 
-void InputHandler::onJoystickAxisMove(SDL_Event& event)
+void InputHandler::onJoystickAxisMove(const InputEvent& event)
 {
-    int whichOne = event.jaxis.which;
-    int axis = static_cast<int>(event.jaxis.axis);
-    int value = static_cast<int>(event.jaxis.value);
-    std::cout << "jaxis:" << event.jaxis.which << std::endl;
-    std::cout << "axis:" << axis << std::endl;
-    std::cout << "value:" << value << std::endl;
+    int whichOne = event.device;
+    int axis = event.code;
+    int value = event.x;
+    //a stick streams axis events, printing each one held up the frame
+    if (!hasJoystick(whichOne, -1)) {
+        return;
+    }
     //left stick move left or right
     if (axis == 0) {
         if (value > m_joystickDeadZone) {
@@ -193,7 +310,7 @@ void InputHandler::onJoystickAxisMove(SDL_Event& event)
         } else if (value < -m_joystickDeadZone) {
             m_joystickValues[whichOne].second->setX(-1);
         } else {
-            m_joystickValues[whichOne].first->setX(0);
+            m_joystickValues[whichOne].second->setX(0);
         }
     }
 
@@ -209,50 +326,55 @@ void InputHandler::onJoystickAxisMove(SDL_Event& event)
     }
 }
 
-void InputHandler::onJoystickButtonDown(SDL_Event& event)
+void InputHandler::onJoystickButtonDown(const InputEvent& event)
 {
-    m_buttonStates[event.jaxis.which][event.jbutton.button] = true;
+    if (hasJoystick(event.device, event.code)) {
+        m_buttonStates[event.device][event.code] = true;
+    }
 }
 
-void InputHandler::onJoystickButtonUp(SDL_Event& event)
+void InputHandler::onJoystickButtonUp(const InputEvent& event)
 {
-    m_buttonStates[event.jaxis.which][event.jbutton.button] = false;
+    if (hasJoystick(event.device, event.code)) {
+        m_buttonStates[event.device][event.code] = false;
+    }
 }
 
-void InputHandler::onMouseButtonDown(SDL_Event& event)
+void InputHandler::onMouseButtonDown(const InputEvent& event)
 {
-    if (event.button.button == SDL_BUTTON_LEFT) {
+    if (event.code == SDL_BUTTON_LEFT) {
         m_mouseButtonStates[LEFT] = true;
     }
 
-    if (event.button.button == SDL_BUTTON_MIDDLE) {
+    if (event.code == SDL_BUTTON_MIDDLE) {
         m_mouseButtonStates[MIDDLE] = true;
     }
 
-    if (event.button.button == SDL_BUTTON_RIGHT) {
+    if (event.code == SDL_BUTTON_RIGHT) {
         m_mouseButtonStates[RIGHT] = true;
     }
 }
 
-void InputHandler::onMouseButtonUp(SDL_Event& event)
+void InputHandler::onMouseButtonUp(const InputEvent& event)
 {
-    if (event.button.button == SDL_BUTTON_LEFT) {
+    if (event.code == SDL_BUTTON_LEFT) {
         m_mouseButtonStates[LEFT] = false;
     }
 
-    if (event.button.button == SDL_BUTTON_MIDDLE) {
+    if (event.code == SDL_BUTTON_MIDDLE) {
         m_mouseButtonStates[MIDDLE] = false;
     }
 
-    if (event.button.button == SDL_BUTTON_RIGHT) {
+    if (event.code == SDL_BUTTON_RIGHT) {
         m_mouseButtonStates[RIGHT] = false;
     }
 }
 
-void InputHandler::onMouseMove(SDL_Event& event)
+void InputHandler::onMouseMove(const InputEvent& event)
 {
-    m_mousePosition->setX(static_cast<float>(event.motion.x));
-    m_mousePosition->setY(static_cast<float>(event.motion.y));
+    m_mousePosition->setX(static_cast<float>(event.x));
+    m_mousePosition->setY(static_cast<float>(event.y));
+    m_mouseDelta += Vector2D(event.dx, event.dy);
 }
 
 void InputHandler::resetMouseButton()
@@ -262,12 +384,16 @@ void InputHandler::resetMouseButton()
     m_mouseButtonStates[MIDDLE] = false;
 }
 
-void InputHandler::onKeyDown()
+void InputHandler::onKeyDown(const InputEvent& event)
 {
-    m_keystate = SDL_GetKeyboardState(0);
+    if (event.code < SDL_NUM_SCANCODES) {
+        m_keystate[event.code] = 1;
+    }
 }
 
-void InputHandler::onKeyUp()
+void InputHandler::onKeyUp(const InputEvent& event)
 {
-    m_keystate = SDL_GetKeyboardState(0);
+    if (event.code < SDL_NUM_SCANCODES) {
+        m_keystate[event.code] = 0;
+    }
 }
\ No newline at end of file
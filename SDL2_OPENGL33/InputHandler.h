@@ -13,9 +13,42 @@ enum mouse_buttons
     RIGHT = 2
 };
 
+enum input_event_type
+{
+    INPUT_KEY_DOWN,
+    INPUT_KEY_UP,
+    INPUT_MOUSE_MOTION,
+    INPUT_MOUSE_BUTTON_DOWN,
+    INPUT_MOUSE_BUTTON_UP,
+    INPUT_JOYSTICK_AXIS,
+    INPUT_JOYSTICK_BUTTON_DOWN,
+    INPUT_JOYSTICK_BUTTON_UP,
+    INPUT_QUIT
+};
+
+//one SDL event as the input handler keeps it, 16 bytes
+struct InputEvent
+{
+    Uint32 timestamp;   //SDL ticks, milliseconds
+    Uint8 type;         //an input_event_type
+    Uint8 device;       //joystick
+    Uint16 code;        //scancode, mouse or joystick button, joystick axis
+    Sint16 x, y;        //mouse position, joystick axis value in x
+    Sint16 dx, dy;      //relative mouse motion
+};
+
+//Every update drains the whole SDL event queue. The events are kept in a
+//preallocated ring with their timestamps, the ones of the last update stay
+//readable until the next, and mouse motion is summed into a delta per
+//update, so cameras turn by what the mouse moved however many events it
+//took.
 class InputHandler
 {
 public:
+    //events of one update kept at most, older ones of a flood are dropped
+    //after they changed the state
+    static const int m_eventRingSize = 1024;
+
     static InputHandler* Instance()
     {
         if (s_pInstance == 0) {
@@ -49,6 +82,17 @@ public:
         return m_mousePosition;
     }
 
+    //mouse motion summed over the events of the last update
+    Vector2D getMouseDelta() const {
+        return m_mouseDelta;
+    }
+
+    //events of the last update, oldest first
+    int getEventCount() const;
+    const InputEvent& getEvent(int index) const;
+    //events of the last update that did not fit the ring
+    int getDroppedEventCount() const { return m_droppedEvents; }
+
     bool isKeyDown(SDL_Scancode key);
 
     void resetMouseButton();
@@ -57,19 +101,26 @@ private:
     InputHandler();
     ~InputHandler();
 
+    //the fields of an SDL event kept, false for the ones nobody reads
+    static bool translateEvent(const SDL_Event& event, InputEvent& input);
+    //stores input in the ring and updates the state from it
+    void addEvent(const InputEvent& input);
+
     //handle keyboard event
-    void onKeyDown();
-    void onKeyUp();
+    void onKeyDown(const InputEvent& event);
+    void onKeyUp(const InputEvent& event);
 
     //handle mouse events
-    void onMouseMove(SDL_Event& event);
-    void onMouseButtonDown(SDL_Event& event);
-    void onMouseButtonUp(SDL_Event& event);
+    void onMouseMove(const InputEvent& event);
+    void onMouseButtonDown(const InputEvent& event);
+    void onMouseButtonUp(const InputEvent& event);
 
     //handle joystick events
-    void onJoystickAxisMove(SDL_Event& event);
-    void onJoystickButtonDown(SDL_Event& event);
-    void onJoystickButtonUp(SDL_Event& event);
+    //device is known and has button, -1 for none
+    bool hasJoystick(int device, int button);
+    void onJoystickAxisMove(const InputEvent& event);
+    void onJoystickButtonDown(const InputEvent& event);
+    void onJoystickButtonUp(const InputEvent& event);
 
     static const int m_joystickDeadZone = 10000;
     static InputHandler* s_pInstance;
@@ -81,7 +132,13 @@ private:
     std::vector<std::vector<bool>> m_buttonStates;
     std::vector<bool> m_mouseButtonStates;
     Vector2D* m_mousePosition;
-    const Uint8* m_keystate;
+    Vector2D m_mouseDelta;
+    Uint8 m_keystate[SDL_NUM_SCANCODES];
+
+    InputEvent m_events[m_eventRingSize];
+    int m_eventCount;       //stored by this update, at most the ring size
+    int m_nextEvent;        //ring position the next event goes to
+    int m_droppedEvents;
 };
 
 typedef InputHandler TheInputHandler;
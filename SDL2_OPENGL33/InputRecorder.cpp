@@ -0,0 +1,141 @@
+#include <iostream>
+#include <fstream>
+#include "InputRecorder.h"
+
+InputRecorder* InputRecorder::s_pInstance = 0;
+const Uint32 InputRecorder::m_magic;
+const Uint32 InputRecorder::m_version;
+
+InputRecorder::InputRecorder() :
+    m_bRecording(false),
+    m_bReplaying(false),
+    m_frame(0)
+{
+}
+
+bool InputRecorder::startRecording(const std::string& file)
+{
+    stop();
+    //a file that cannot be written is better found before the run
+    std::ofstream out(file.c_str(), std::ios_base::out | std::ios_base::binary | std::ios_base::app);
+    if (!out) {
+        std::cerr << "Cannot write input recording: " << file << std::endl;
+        return false;
+    }
+    m_file = file;
+    m_frameSeconds.clear();
+    m_frameFirstEvent.clear();
+    m_events.clear();
+    m_bRecording = true;
+    return true;
+}
+
+bool InputRecorder::startReplay(const std::string& file)
+{
+    stop();
+    std::ifstream in(file.c_str(), std::ios_base::in | std::ios_base::binary);
+    RecordingHeader header;
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+        std::cerr << "Cannot read input recording: " << file << std::endl;
+        return false;
+    }
+    if (header.magic != m_magic || header.version != m_version || header.eventSize != sizeof(InputEvent)) {
+        std::cerr << "Not an input recording of this version: " << file << std::endl;
+        return false;
+    }
+
+    m_frameSeconds.resize(header.frames);
+    m_frameFirstEvent.resize(header.frames);
+    m_events.clear();
+    for (Uint32 f = 0; f < header.frames; f++) {
+        Uint32 count = 0;
+        in.read(reinterpret_cast<char*>(&m_frameSeconds[f]), sizeof(double));
+        in.read(reinterpret_cast<char*>(&count), sizeof(count));
+        m_frameFirstEvent[f] = static_cast<Uint32>(m_events.size());
+        m_events.resize(m_events.size() + count);
+        if (count > 0) {
+            in.read(reinterpret_cast<char*>(&m_events[m_frameFirstEvent[f]]), count * sizeof(InputEvent));
+        }
+        if (!in) {
+            std::cerr << "Input recording cut short: " << file << std::endl;
+            return false;
+        }
+    }
+    m_file = file;
+    m_frame = -1;
+    m_bReplaying = true;
+    return true;
+}
+
+bool InputRecorder::stop()
+{
+    bool written = true;
+    if (m_bRecording) {
+        std::ofstream out(m_file.c_str(), std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+        RecordingHeader header;
+        header.magic = m_magic;
+        header.version = m_version;
+        header.eventSize = sizeof(InputEvent);
+        header.frames = static_cast<Uint32>(m_frameSeconds.size());
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        for (size_t f = 0; f < m_frameSeconds.size(); f++) {
+            Uint32 end = (f + 1 < m_frameSeconds.size()) ? m_frameFirstEvent[f + 1] : static_cast<Uint32>(m_events.size());
+            Uint32 count = end - m_frameFirstEvent[f];
+            out.write(reinterpret_cast<const char*>(&m_frameSeconds[f]), sizeof(double));
+            out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+            if (count > 0) {
+                out.write(reinterpret_cast<const char*>(&m_events[m_frameFirstEvent[f]]), count * sizeof(InputEvent));
+            }
+        }
+        written = out.good();
+        if (written) {
+            std::cout << "Recorded " << header.frames << " frames and " << m_events.size() << " input events to " << m_file << std::endl;
+        } else {
+            std::cerr << "Cannot write input recording: " << m_file << std::endl;
+        }
+    }
+    m_bRecording = false;
+    m_bReplaying = false;
+    return written;
+}
+
+bool InputRecorder::beginFrame(double& seconds)
+{
+    if (m_bRecording) {
+        m_frameSeconds.push_back(seconds);
+        m_frameFirstEvent.push_back(static_cast<Uint32>(m_events.size()));
+        return true;
+    }
+    if (m_bReplaying) {
+        if (m_frame + 1 >= static_cast<int>(m_frameSeconds.size())) {
+            return false;
+        }
+        m_frame++;
+        seconds = m_frameSeconds[m_frame];
+    }
+    return true;
+}
+
+void InputRecorder::recordEvent(const InputEvent& event)
+{
+    //events before the first frame belong to it
+    if (m_frameSeconds.empty()) {
+        m_frameSeconds.push_back(0);
+        m_frameFirstEvent.push_back(0);
+    }
+    m_events.push_back(event);
+}
+
+int InputRecorder::getFrameEventCount() const
+{
+    if (!m_bReplaying || m_frame < 0) {
+        return 0;
+    }
+    Uint32 end = (m_frame + 1 < static_cast<int>(m_frameSeconds.size())) ? m_frameFirstEvent[m_frame + 1] : static_cast<Uint32>(m_events.size());
+    return static_cast<int>(end - m_frameFirstEvent[m_frame]);
+}
+
+const InputEvent& InputRecorder::getFrameEvent(int index) const
+{
+    return m_events[m_frameFirstEvent[m_frame] + index];
+}
@@ -0,0 +1,83 @@
+#ifndef INPUT_RECORDER_H
+#define INPUT_RECORDER_H
+
+#include <vector>
+#include <string>
+#include <SDL.h>
+
+#include "InputHandler.h"
+
+//Records the input of a run and plays it back, so the same camera path can
+//be timed across builds. A recording keeps every frame's time and the
+//InputEvents InputHandler took that frame. On replay InputHandler takes the
+//events from the file instead of SDL and GameLoop advances its clock by the
+//recorded frame times, so every frame runs the same fixed steps with the
+//same input whatever the machine, and the run ends with the file. Both
+//need the single thread loop, where steps are tied to frames.
+//
+//The file is written when recording stops and read whole before a replay,
+//so disk access does not show up in the frame times:
+//	RecordingHeader
+//	per frame: double seconds, Uint32 event count, InputEvent[count]
+class InputRecorder
+{
+public:
+    static const Uint32 m_magic = 0x31524E49;   //"INR1"
+    static const Uint32 m_version = 1;
+
+    struct RecordingHeader {
+        Uint32 magic;
+        Uint32 version;
+        Uint32 eventSize;   //sizeof(InputEvent) when it was written
+        Uint32 frames;
+    };
+
+    static InputRecorder* Instance()
+    {
+        if (s_pInstance == 0) {
+            s_pInstance = new InputRecorder();
+        }
+
+        return s_pInstance;
+    }
+
+    bool startRecording(const std::string& file);
+    bool startReplay(const std::string& file);
+    //writes a recording, ends a replay
+    bool stop();
+
+    bool isRecording() const { return m_bRecording; }
+    bool isReplaying() const { return m_bReplaying; }
+
+    //GameLoop, once per frame before handleEvents: a recording starts a new
+    //frame taking seconds, a replay replaces seconds with the recorded
+    //time and returns false once the file is played out
+    bool beginFrame(double& seconds);
+
+    //InputHandler, recording: an event of this frame
+    void recordEvent(const InputEvent& event);
+    //replaying: the events of this frame
+    int getFrameEventCount() const;
+    const InputEvent& getFrameEvent(int index) const;
+
+    int getFrameCount() const { return static_cast<int>(m_frameSeconds.size()); }
+
+private:
+    InputRecorder();
+
+    static InputRecorder* s_pInstance;
+
+    bool m_bRecording;
+    bool m_bReplaying;
+    std::string m_file;
+
+    //every frame's time and its first event in m_events
+    std::vector<double> m_frameSeconds;
+    std::vector<Uint32> m_frameFirstEvent;
+    std::vector<InputEvent> m_events;
+    int m_frame;    //replaying
+};
+
+typedef InputRecorder TheInputRecorder;
+
+#endif
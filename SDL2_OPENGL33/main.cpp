@@ -1,27 +1,52 @@
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+
 #include "Game.h"
+#include "GameLoop.h"
+#include "InputRecorder.h"
 
 const int FPS = 60;
-const int DELAY_TIME = static_cast<int>(1000.0f / FPS);
+const double STEP_SECONDS = 1.0 / 60.0;
 
 int main(int argc, char** grgs)
 {
-    Uint32 frameStart;
-    Uint32 frameTime;
+    //--benchmark runs uncapped and prints the frame statistics at the end,
+    //--fps n limits the frame rate to n, 0 is uncapped, --single-thread
+    //runs update on the render thread. --record file saves the input of the
+    //run, --replay file runs it again as a benchmark, the same camera path
+    //on every build and machine.
+    bool benchmark = false;
+    TheGameLoop::Instance()->setStep(STEP_SECONDS);
+    TheGameLoop::Instance()->setFrameLimit(FPS);
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(grgs[i], "--benchmark") == 0) {
+            benchmark = true;
+            TheGameLoop::Instance()->setFrameLimit(0);
+        } else if (strcmp(grgs[i], "--fps") == 0 && i + 1 < argc) {
+            TheGameLoop::Instance()->setFrameLimit(atof(grgs[++i]));
+        } else if (strcmp(grgs[i], "--single-thread") == 0) {
+            TheGameLoop::Instance()->setSimulationThread(false);
+        } else if (strcmp(grgs[i], "--record") == 0 && i + 1 < argc) {
+            if (!TheInputRecorder::Instance()->startRecording(grgs[++i])) {
+                return -1;
+            }
+        } else if (strcmp(grgs[i], "--replay") == 0 && i + 1 < argc) {
+            if (!TheInputRecorder::Instance()->startReplay(grgs[++i])) {
+                return -1;
+            }
+            benchmark = true;
+            TheGameLoop::Instance()->setFrameLimit(0);
+        }
+    }
 
     GAME_STATUS_TAG res;
     res = TheGame::Instance()->init("SDL_OpenGL", 100, 100, 1024, 768, false);
     if (res == GAME_INIT_SUCCESS) {
-        while (TheGame::Instance()->running()) {
-            frameStart = SDL_GetTicks();
-
-            TheGame::Instance()->handleEvents();
-            TheGame::Instance()->update();
-            TheGame::Instance()->render();
-
-            frameTime = SDL_GetTicks() - frameStart;
-            if (frameTime < DELAY_TIME) {
-                SDL_Delay(static_cast<int>(DELAY_TIME - frameTime));
-            }
+        TheGameLoop::Instance()->run();
+        TheInputRecorder::Instance()->stop();
+        if (benchmark) {
+            TheGameLoop::Instance()->printStats(std::cout);
         }
     } else {
         return -1;
@@ -30,4 +55,4 @@ int main(int argc, char** grgs)
     TheGame::Instance()->clean();
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,367 @@
+#include "AABBTree.h"
+
+const int CAABBTree::NULL_NODE;
+
+static float SurfaceArea(const glm::vec3& min, const glm::vec3& max) {
+	glm::vec3 d = max - min;
+	return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+CAABBTree::CAABBTree(float m)
+{
+	margin = m;
+	root = NULL_NODE;
+	freeList = NULL_NODE;
+	proxyCount = 0;
+	nodesTested = 0;
+}
+
+CAABBTree::~CAABBTree(void)
+{
+}
+
+void CAABBTree::Clear() {
+	nodes.clear();
+	proxyNodes.clear();
+	freeProxies.clear();
+	root = NULL_NODE;
+	freeList = NULL_NODE;
+	proxyCount = 0;
+}
+
+//take a node from the free list or grow the pool, invalidates Node references
+int CAABBTree::AllocateNode() {
+	int index;
+	if (freeList != NULL_NODE) {
+		index = freeList;
+		freeList = nodes[index].parent;
+	} else {
+		index = static_cast<int>(nodes.size());
+		nodes.push_back(Node());
+	}
+	Node& node = nodes[index];
+	node.parent = NULL_NODE;
+	node.child1 = NULL_NODE;
+	node.child2 = NULL_NODE;
+	node.height = 0;
+	node.userData = -1;
+	node.proxy = NULL_NODE;
+	return index;
+}
+
+void CAABBTree::FreeNode(int index) {
+	nodes[index].parent = freeList;
+	nodes[index].height = -1;
+	freeList = index;
+}
+
+int CAABBTree::CreateProxy(const glm::vec3& min, const glm::vec3& max, int userData) {
+	int leaf = AllocateNode();
+	nodes[leaf].min = min - glm::vec3(margin);
+	nodes[leaf].max = max + glm::vec3(margin);
+	nodes[leaf].userData = userData;
+
+	int proxy;
+	if (!freeProxies.empty()) {
+		proxy = freeProxies.back();
+		freeProxies.pop_back();
+	} else {
+		proxy = static_cast<int>(proxyNodes.size());
+		proxyNodes.push_back(NULL_NODE);
+	}
+	proxyNodes[proxy] = leaf;
+	nodes[leaf].proxy = proxy;
+
+	InsertLeaf(leaf);
+	proxyCount++;
+	return proxy;
+}
+
+void CAABBTree::DestroyProxy(int proxy) {
+	int leaf = proxyNodes[proxy];
+	RemoveLeaf(leaf);
+	FreeNode(leaf);
+	proxyNodes[proxy] = NULL_NODE;
+	freeProxies.push_back(proxy);
+	proxyCount--;
+}
+
+bool CAABBTree::MoveProxy(int proxy, const glm::vec3& min, const glm::vec3& max) {
+	int leaf = proxyNodes[proxy];
+	Node& node = nodes[leaf];
+	if (glm::all(glm::lessThanEqual(node.min, min)) && glm::all(glm::lessThanEqual(max, node.max))) {
+		return false;
+	}
+	RemoveLeaf(leaf);
+	nodes[leaf].min = min - glm::vec3(margin);
+	nodes[leaf].max = max + glm::vec3(margin);
+	InsertLeaf(leaf);
+	return true;
+}
+
+int CAABBTree::GetUserData(int proxy) const {
+	return nodes[proxyNodes[proxy]].userData;
+}
+
+void CAABBTree::Optimize() {
+	if (root == NULL_NODE) {
+		Clear();
+		return;
+	}
+
+	//preorder with the first child first, the order CullFrustum visits
+	vector<Node> ordered;
+	ordered.reserve(proxyCount * 2);
+	vector<pair<int, int> > pending;	//old node and its new parent
+	pending.push_back(make_pair(root, NULL_NODE));
+	while (!pending.empty()) {
+		int old = pending.back().first;
+		int parent = pending.back().second;
+		pending.pop_back();
+
+		int index = static_cast<int>(ordered.size());
+		ordered.push_back(nodes[old]);
+		Node& node = ordered.back();
+		node.parent = parent;
+		if (parent != NULL_NODE) {
+			//the first child is always placed right after its parent
+			if (index == parent + 1) {
+				ordered[parent].child1 = index;
+			} else {
+				ordered[parent].child2 = index;
+			}
+		}
+		if (node.child1 == NULL_NODE) {
+			proxyNodes[node.proxy] = index;
+		} else {
+			pending.push_back(make_pair(node.child2, index));
+			pending.push_back(make_pair(node.child1, index));
+		}
+	}
+
+	nodes.swap(ordered);
+	root = 0;
+	freeList = NULL_NODE;
+}
+
+int CAABBTree::GetHeight() const {
+	return (root == NULL_NODE) ? 0 : nodes[root].height;
+}
+
+//walk down to the sibling that grows the total surface area the least, the
+//descent stops when pairing with the current node is cheaper than going on
+void CAABBTree::InsertLeaf(int leaf) {
+	if (root == NULL_NODE) {
+		root = leaf;
+		nodes[root].parent = NULL_NODE;
+		return;
+	}
+
+	glm::vec3 leafMin = nodes[leaf].min;
+	glm::vec3 leafMax = nodes[leaf].max;
+	int index = root;
+	while (nodes[index].child1 != NULL_NODE) {
+		const Node& node = nodes[index];
+		float area = SurfaceArea(node.min, node.max);
+		float combinedArea = SurfaceArea(glm::min(node.min, leafMin), glm::max(node.max, leafMax));
+
+		//a new parent here costs the combined box, going down also grows
+		//every node on the way by this much
+		float cost = 2.0f * combinedArea;
+		float inheritance = 2.0f * (combinedArea - area);
+
+		float childCost[2];
+		int children[2] = {node.child1, node.child2};
+		for (int i = 0; i < 2; i++) {
+			const Node& child = nodes[children[i]];
+			float grown = SurfaceArea(glm::min(child.min, leafMin), glm::max(child.max, leafMax));
+			if (child.child1 == NULL_NODE) {
+				childCost[i] = grown + inheritance;
+			} else {
+				childCost[i] = grown - SurfaceArea(child.min, child.max) + inheritance;
+			}
+		}
+
+		if (cost < childCost[0] && cost < childCost[1]) {
+			break;
+		}
+		index = (childCost[0] < childCost[1]) ? children[0] : children[1];
+	}
+
+	int sibling = index;
+	int oldParent = nodes[sibling].parent;
+	int newParent = AllocateNode();
+	nodes[newParent].parent = oldParent;
+	nodes[newParent].min = glm::min(nodes[sibling].min, leafMin);
+	nodes[newParent].max = glm::max(nodes[sibling].max, leafMax);
+	nodes[newParent].height = nodes[sibling].height + 1;
+	nodes[newParent].child1 = sibling;
+	nodes[newParent].child2 = leaf;
+	nodes[sibling].parent = newParent;
+	nodes[leaf].parent = newParent;
+
+	if (oldParent == NULL_NODE) {
+		root = newParent;
+	} else if (nodes[oldParent].child1 == sibling) {
+		nodes[oldParent].child1 = newParent;
+	} else {
+		nodes[oldParent].child2 = newParent;
+	}
+
+	FixUpwards(newParent);
+}
+
+//the sibling takes the place of the leaf's parent
+void CAABBTree::RemoveLeaf(int leaf) {
+	if (leaf == root) {
+		root = NULL_NODE;
+		return;
+	}
+
+	int parent = nodes[leaf].parent;
+	int grandParent = nodes[parent].parent;
+	int sibling = (nodes[parent].child1 == leaf) ? nodes[parent].child2 : nodes[parent].child1;
+
+	if (grandParent == NULL_NODE) {
+		root = sibling;
+		nodes[sibling].parent = NULL_NODE;
+		FreeNode(parent);
+		return;
+	}
+
+	if (nodes[grandParent].child1 == parent) {
+		nodes[grandParent].child1 = sibling;
+	} else {
+		nodes[grandParent].child2 = sibling;
+	}
+	nodes[sibling].parent = grandParent;
+	FreeNode(parent);
+	FixUpwards(grandParent);
+}
+
+//refit boxes and heights from node to the root, rebalancing every level
+void CAABBTree::FixUpwards(int index) {
+	while (index != NULL_NODE) {
+		index = Balance(index);
+		Node& node = nodes[index];
+		const Node& child1 = nodes[node.child1];
+		const Node& child2 = nodes[node.child2];
+		node.height = 1 + glm::max(child1.height, child2.height);
+		node.min = glm::min(child1.min, child2.min);
+		node.max = glm::max(child1.max, child2.max);
+		index = node.parent;
+	}
+}
+
+//if the two subtrees of a node differ in height by more than one, the higher
+//child is rotated up into its place: the node becomes that child's first
+//child and takes over its lower grandchild. Returns the node now at the place.
+int CAABBTree::Balance(int iA) {
+	Node& A = nodes[iA];
+	if (A.child1 == NULL_NODE || A.height < 2) {
+		return iA;
+	}
+
+	int iB = A.child1;
+	int iC = A.child2;
+	int balance = nodes[iC].height - nodes[iB].height;
+	if (balance >= -1 && balance <= 1) {
+		return iA;
+	}
+
+	//rotate the higher child up, the other child stays under a
+	int iUp = (balance > 1) ? iC : iB;
+	int iStay = (balance > 1) ? iB : iC;
+	Node& up = nodes[iUp];
+	int iF = up.child1;
+	int iG = up.child2;
+
+	up.child1 = iA;
+	up.parent = A.parent;
+	A.parent = iUp;
+	if (up.parent == NULL_NODE) {
+		root = iUp;
+	} else if (nodes[up.parent].child1 == iA) {
+		nodes[up.parent].child1 = iUp;
+	} else {
+		nodes[up.parent].child2 = iUp;
+	}
+
+	//the higher grandchild stays with up, the lower one moves under a
+	int iKeep = (nodes[iF].height > nodes[iG].height) ? iF : iG;
+	int iMove = (iKeep == iF) ? iG : iF;
+	up.child2 = iKeep;
+	if (balance > 1) {
+		A.child2 = iMove;
+	} else {
+		A.child1 = iMove;
+	}
+	nodes[iMove].parent = iA;
+
+	const Node& stay = nodes[iStay];
+	const Node& move = nodes[iMove];
+	const Node& keep = nodes[iKeep];
+	A.min = glm::min(stay.min, move.min);
+	A.max = glm::max(stay.max, move.max);
+	A.height = 1 + glm::max(stay.height, move.height);
+	up.min = glm::min(A.min, keep.min);
+	up.max = glm::max(A.max, keep.max);
+	up.height = 1 + glm::max(A.height, keep.height);
+	return iUp;
+}
+
+//each stack entry carries the planes its box still straddles; a box fully
+//inside a plane drops it for the whole subtree, a subtree inside all six is
+//collected without further tests
+void CAABBTree::CullFrustum(const glm::vec4 planes[6], vector<int>& visible) const {
+	nodesTested = 0;
+	if (root == NULL_NODE) {
+		return;
+	}
+
+	glm::vec3 absNormals[6];
+	for (int i = 0; i < 6; i++) {
+		absNormals[i] = glm::abs(glm::vec3(planes[i]));
+	}
+
+	stack.clear();
+	stack.push_back(make_pair(root, 0x3F));
+	while (!stack.empty()) {
+		int index = stack.back().first;
+		int mask = stack.back().second;
+		stack.pop_back();
+		const Node& node = nodes[index];
+
+		if (mask != 0) {
+			nodesTested++;
+			glm::vec3 center = (node.min + node.max) * 0.5f;
+			glm::vec3 extent = (node.max - node.min) * 0.5f;
+			bool outside = false;
+			for (int i = 0; i < 6; i++) {
+				if ((mask & (1 << i)) == 0) {
+					continue;
+				}
+				float d = glm::dot(glm::vec3(planes[i]), center) + planes[i].w;
+				float r = glm::dot(absNormals[i], extent);
+				if (d < -r) {
+					outside = true;
+					break;
+				}
+				if (d >= r) {
+					mask &= ~(1 << i);
+				}
+			}
+			if (outside) {
+				continue;
+			}
+		}
+
+		if (node.child1 == NULL_NODE) {
+			visible.push_back(node.userData);
+		} else {
+			//first child on top, it is the next node in an optimized pool
+			stack.push_back(make_pair(node.child2, mask));
+			stack.push_back(make_pair(node.child1, mask));
+		}
+	}
+}
@@ -0,0 +1,71 @@
+#ifndef AABB_TREE_H
+#define AABB_TREE_H
+
+#include <glm.hpp>
+#include <vector>
+
+using namespace std;
+
+//Dynamic bounding volume hierarchy for scene culling. Every object is a leaf
+//(a proxy) with a box enlarged by a margin, so small moves do not touch the
+//tree at all. Larger moves reinsert the leaf and the ancestors are refit and
+//rebalanced with rotations on the way up. Nodes live in one pool indexed by
+//int, freed nodes are reused through a free list, and Optimize() lays the
+//pool out in traversal order again once updates have scattered it.
+class CAABBTree
+{
+public:
+	static const int NULL_NODE = -1;
+
+	CAABBTree(float margin = 0.1f);
+	~CAABBTree(void);
+
+	//returns the proxy id, userData is what CullFrustum reports
+	int CreateProxy(const glm::vec3& min, const glm::vec3& max, int userData);
+	void DestroyProxy(int proxy);
+	//true when the box left the enlarged box and the leaf was reinserted
+	bool MoveProxy(int proxy, const glm::vec3& min, const glm::vec3& max);
+	int GetUserData(int proxy) const;
+	void Clear();
+	//reorder the pool depth first so culling walks memory front to back,
+	//proxy ids stay valid
+	void Optimize();
+
+	//append the user data of every proxy touching the frustum, planes as
+	//returned by CAbstractCamera::GetFrustumPlanes
+	void CullFrustum(const glm::vec4 planes[6], vector<int>& visible) const;
+
+	int GetProxyCount() const { return proxyCount; }
+	int GetHeight() const;
+	//nodes CullFrustum tested against at least one plane in its last call
+	int GetNodesTested() const { return nodesTested; }
+
+private:
+	struct Node {
+		glm::vec3 min, max;	//enlarged for leaves
+		int parent;		//next free node while on the free list
+		int child1, child2;	//NULL_NODE for leaves
+		int height;		//0 for leaves, -1 while free
+		int userData;
+		int proxy;		//NULL_NODE for internal nodes
+	};
+
+	int AllocateNode();
+	void FreeNode(int node);
+	void InsertLeaf(int leaf);
+	void RemoveLeaf(int leaf);
+	int Balance(int node);
+	void FixUpwards(int node);
+
+	vector<Node> nodes;
+	vector<int> proxyNodes;		//proxy id -> leaf node, NULL_NODE once destroyed
+	vector<int> freeProxies;
+	int root;
+	int freeList;
+	int proxyCount;
+	float margin;
+	mutable vector<pair<int, int> > stack;	//node and plane mask, reused by CullFrustum
+	mutable int nodesTested;
+};
+
+#endif
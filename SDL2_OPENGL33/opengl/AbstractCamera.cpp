@@ -1,11 +1,25 @@
 #include "AbstractCamera.h"  
+#include "TaskPool.h"
+#include <string.h>
+
+//SSE is part of every x64 target and of x86 builds with /arch:SSE or later
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define CAMERA_CULL_SSE
+#include <xmmintrin.h>
+#endif
 
 glm::vec3 CAbstractCamera::UP = glm::vec3(0,1,0);
 
+//objects culled by one task at least, larger batches are split on the
+//TaskPool. A multiple of 32, the bits of a mask word.
+const int CULL_TASK_OBJECTS = 8192;
+
 CAbstractCamera::CAbstractCamera(void) 
 { 
 	Znear = 0.1f;
 	Zfar  = 1000;
+	depthRange = DEPTH_NEGATIVE_ONE_TO_ONE;
+	frustumDirty = true;
 }
 
 CAbstractCamera::~CAbstractCamera(void)
@@ -18,8 +32,25 @@ void CAbstractCamera::SetupProjection(const float fovy, const float aspRatio, co
 	Zfar = fr;
 	fov = fovy;
 	aspect_ratio = aspRatio; 
+	depthRange = DEPTH_NEGATIVE_ONE_TO_ONE;
+	frustumDirty = true;
 } 
 
+void CAbstractCamera::SetupOrthographic(const float left, const float right, const float bottom, const float top, const float nr, const float fr) {
+	P = glm::ortho(left, right, bottom, top, nr, fr);
+	Znear = nr;
+	Zfar = fr;
+	aspect_ratio = (right - left) / (top - bottom);
+	depthRange = DEPTH_NEGATIVE_ONE_TO_ONE;
+	frustumDirty = true;
+}
+
+void CAbstractCamera::SetProjectionMatrix(const glm::mat4& proj, DepthRange range) {
+	P = proj;
+	depthRange = range;
+	frustumDirty = true;
+}
+
 const glm::mat4 CAbstractCamera::GetViewMatrix() const {
 	return V;
 }
@@ -42,6 +73,8 @@ const float CAbstractCamera::GetFOV() const {
 void CAbstractCamera::SetFOV(const float fovInDegrees) {
 	fov = fovInDegrees;
 	P = glm::perspective(fovInDegrees, aspect_ratio, Znear, Zfar); 
+	depthRange = DEPTH_NEGATIVE_ONE_TO_ONE;
+	frustumDirty = true;
 }
 const float CAbstractCamera::GetAspectRatio() const {
 	return aspect_ratio;
@@ -58,40 +91,88 @@ glm::mat4 CAbstractCamera::GetMatrixUsingYawPitchRoll(const float yaw, const flo
     return R;
 }
 
+//row i of a column major glm matrix
+static glm::vec4 Row(const glm::mat4& m, int i) {
+	return glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+}
+
+void CAbstractCamera::ExtractFrustumPlanes(const glm::mat4& clip, CPlane fp[6], DepthRange range, bool normalize) {
+	glm::vec4 x = Row(clip, 0);
+	glm::vec4 y = Row(clip, 1);
+	glm::vec4 z = Row(clip, 2);
+	glm::vec4 w = Row(clip, 3);
+
+	//a point is inside when -w <= x <= w and so on, each side is one plane
+	glm::vec4 eq[6];
+	eq[0] = w - y;
+	eq[1] = w + y;
+	eq[2] = w + x;
+	eq[3] = w - x;
+	switch (range) {
+	case DEPTH_ZERO_TO_ONE:
+		eq[4] = z;
+		eq[5] = w - z;
+		break;
+	case DEPTH_REVERSED:
+		eq[4] = w - z;
+		eq[5] = z;
+		break;
+	default:
+		eq[4] = w + z;
+		eq[5] = w - z;
+		break;
+	}
+
+	for (int i = 0; i < 6; i++) {
+		fp[i].N = glm::vec3(eq[i]);
+		fp[i].d = eq[i].w;
+		float length = glm::length(fp[i].N);
+		if (length < 1e-6f) {
+			//no plane, e.g. the far plane of an infinite projection
+			fp[i].N = glm::vec3(0);
+			fp[i].d = 1;
+		} else if (normalize) {
+			fp[i].N /= length;
+			fp[i].d /= length;
+		}
+	}
+}
+
  void CAbstractCamera::CalcFrustumPlanes() {
- 	
-	glm::vec3 cN = position + look*Znear;
-	glm::vec3 cF = position + look*Zfar; 
-
-	float Hnear = 2.0f * tan(glm::radians(fov / 2.0f) ) * Znear;
-	float Wnear = Hnear * aspect_ratio;
-	float Hfar = 2.0f * tan(glm::radians(fov / 2.0f)) * Zfar;
-	float Wfar = Hfar * aspect_ratio;
-	float hHnear = Hnear/2.0f;
-	float hWnear = Wnear/2.0f;
-	float hHfar = Hfar/2.0f;
-	float hWfar = Wfar/2.0f;
-
-
-	farPts[0] = cF + up*hHfar - right*hWfar;
-	farPts[1] = cF - up*hHfar - right*hWfar;
-	farPts[2] = cF - up*hHfar + right*hWfar;
-	farPts[3] = cF + up*hHfar + right*hWfar;
-
-	nearPts[0] = cN + up*hHnear - right*hWnear;
-	nearPts[1] = cN - up*hHnear - right*hWnear;
-	nearPts[2] = cN - up*hHnear + right*hWnear;
-	nearPts[3] = cN + up*hHnear + right*hWnear;
-
-	planes[0] = CPlane::FromPoints(nearPts[3],nearPts[0],farPts[0]);
-	planes[1] = CPlane::FromPoints(nearPts[1],nearPts[2],farPts[2]);
-	planes[2] = CPlane::FromPoints(nearPts[0],nearPts[1],farPts[1]);
-	planes[3] = CPlane::FromPoints(nearPts[2],nearPts[3],farPts[2]);
-	planes[4] = CPlane::FromPoints(nearPts[0],nearPts[3],nearPts[2]);
-	planes[5] = CPlane::FromPoints(farPts[3] ,farPts[0] ,farPts[1]);
+	if (!frustumDirty) {
+		return;
+	}
+	frustumDirty = false;
+
+	glm::mat4 PV = P*V;
+	ExtractFrustumPlanes(PV, planes, depthRange, true);
+
+	//corners are the clip space cube mapped back to world space
+	float zNear = -1, zFar = 1;
+	if (depthRange == DEPTH_ZERO_TO_ONE) {
+		zNear = 0;
+	} else if (depthRange == DEPTH_REVERSED) {
+		zNear = 1;
+		zFar = 0;
+	}
+	const float cornerX[4] = {-1, -1, 1, 1};
+	const float cornerY[4] = { 1, -1, -1, 1};
+	glm::mat4 invPV = glm::inverse(PV);
+	bool hasFar = (planes[5].N != glm::vec3(0));
+	for (int i = 0; i < 4; i++) {
+		glm::vec4 n = invPV*glm::vec4(cornerX[i], cornerY[i], zNear, 1);
+		nearPts[i] = glm::vec3(n)/n.w;
+		if (hasFar) {
+			glm::vec4 f = invPV*glm::vec4(cornerX[i], cornerY[i], zFar, 1);
+			farPts[i] = glm::vec3(f)/f.w;
+		} else {
+			farPts[i] = nearPts[i];
+		}
+	}
  }
 
  bool CAbstractCamera::IsPointInFrustum(const glm::vec3& point) {
+	CalcFrustumPlanes();
 	for(int i=0; i < 6; i++) 
 	{
 		if (planes[i].GetDistance(point) < 0)
@@ -101,6 +182,7 @@ glm::mat4 CAbstractCamera::GetMatrixUsingYawPitchRoll(const float yaw, const flo
 }
  
  bool CAbstractCamera::IsSphereInFrustum(const glm::vec3& center, const float radius) {
+	CalcFrustumPlanes();
 	for(int i=0; i < 6; i++) 
 	{
 		float d = planes[i].GetDistance(center);
@@ -112,6 +194,7 @@ glm::mat4 CAbstractCamera::GetMatrixUsingYawPitchRoll(const float yaw, const flo
 
 
   bool CAbstractCamera::IsBoxInFrustum(const glm::vec3& min, const glm::vec3& max) {
+	CalcFrustumPlanes();
 	for(int i=0; i < 6; i++) 
 	{
 		glm::vec3 p=min, n=max;
@@ -137,10 +220,231 @@ glm::mat4 CAbstractCamera::GetMatrixUsingYawPitchRoll(const float yaw, const flo
   }
 
 void CAbstractCamera::GetFrustumPlanes(glm::vec4 fp[6]) {
+	CalcFrustumPlanes();
 	for(int i=0;i<6;i++) 
 		fp[i]=glm::vec4(planes[i].N, planes[i].d);	
 }
 
+static void ClearMask(unsigned int* visible, int count) {
+	memset(visible, 0, ((count + 31) / 32) * sizeof(unsigned int));
+}
+
+int CAbstractCamera::SpheresOutside(int i, const float* x, const float* y, const float* z, const float* radius, int g, int n) {
+	int outside = 0;
+	for (int j = 0; j < n; j++) {
+		if (planes[i].GetDistance(glm::vec3(x[g+j], y[g+j], z[g+j])) < -radius[g+j]) {
+			outside |= 1 << j;
+		}
+	}
+	return outside;
+}
+
+int CAbstractCamera::BoxesOutside(int i, const float* minX, const float* minY, const float* minZ, const float* maxX, const float* maxY, const float* maxZ, int g, int n) {
+	const glm::vec3& N = planes[i].N;
+	//the corner furthest along the normal, as in IsBoxInFrustum
+	const float* px = (N.x >= 0) ? maxX : minX;
+	const float* py = (N.y >= 0) ? maxY : minY;
+	const float* pz = (N.z >= 0) ? maxZ : minZ;
+	int outside = 0;
+	for (int j = 0; j < n; j++) {
+		if (planes[i].GetDistance(glm::vec3(px[g+j], py[g+j], pz[g+j])) < 0) {
+			outside |= 1 << j;
+		}
+	}
+	return outside;
+}
+
+//the same hints as the SSE path: a group the hinted plane rejects is done,
+//otherwise the first plane in order that rejects the whole group becomes its
+//hint. A group only rejected by several planes together keeps its hint.
+void CAbstractCamera::CullSpheresRange(const float* x, const float* y, const float* z, const float* radius, int begin, int count, unsigned int* visible, unsigned char* planeHints) {
+	for (int g = begin; g < count; g += 4) {
+		int n = (count - g < 4) ? count - g : 4;
+		int all = (1 << n) - 1;
+		if (planeHints && SpheresOutside(planeHints[g >> 2], x, y, z, radius, g, n) == all) {
+			continue;
+		}
+		int outside = 0;
+		for (int i = 0; i < 6; i++) {
+			int planeOutside = SpheresOutside(i, x, y, z, radius, g, n);
+			outside |= planeOutside;
+			if (planeOutside == all) {
+				if (planeHints) {
+					planeHints[g >> 2] = (unsigned char)i;
+				}
+				break;
+			}
+		}
+		visible[g >> 5] |= (unsigned int)(~outside & all) << (g & 31);
+	}
+}
+
+void CAbstractCamera::CullBoxesRange(const float* minX, const float* minY, const float* minZ, const float* maxX, const float* maxY, const float* maxZ, int begin, int count, unsigned int* visible, unsigned char* planeHints) {
+	for (int g = begin; g < count; g += 4) {
+		int n = (count - g < 4) ? count - g : 4;
+		int all = (1 << n) - 1;
+		if (planeHints && BoxesOutside(planeHints[g >> 2], minX, minY, minZ, maxX, maxY, maxZ, g, n) == all) {
+			continue;
+		}
+		int outside = 0;
+		for (int i = 0; i < 6; i++) {
+			int planeOutside = BoxesOutside(i, minX, minY, minZ, maxX, maxY, maxZ, g, n);
+			outside |= planeOutside;
+			if (planeOutside == all) {
+				if (planeHints) {
+					planeHints[g >> 2] = (unsigned char)i;
+				}
+				break;
+			}
+		}
+		visible[g >> 5] |= (unsigned int)(~outside & all) << (g & 31);
+	}
+}
+
+void CAbstractCamera::CullSpheresScalar(const float* x, const float* y, const float* z, const float* radius, int count, unsigned int* visible, unsigned char* planeHints) {
+	CalcFrustumPlanes();
+	ClearMask(visible, count);
+	CullSpheresRange(x, y, z, radius, 0, count, visible, planeHints);
+}
+
+void CAbstractCamera::CullBoxesScalar(const float* minX, const float* minY, const float* minZ, const float* maxX, const float* maxY, const float* maxZ, int count, unsigned int* visible, unsigned char* planeHints) {
+	CalcFrustumPlanes();
+	ClearMask(visible, count);
+	CullBoxesRange(minX, minY, minZ, maxX, maxY, maxZ, 0, count, visible, planeHints);
+}
+
+//four objects against one plane per step. A group the hinted plane rejects
+//skips the other five, which pays off when neighbouring objects in the
+//arrays are also close in space.
+void CAbstractCamera::CullSpheres(const float* x, const float* y, const float* z, const float* radius, int count, unsigned int* visible, unsigned char* planeHints) {
+	CalcFrustumPlanes();
+	ClearMask(visible, count);
+	if (count < 2 * CULL_TASK_OBJECTS) {
+		CullSpheresBlock(x, y, z, radius, 0, count, visible, planeHints);
+		return;
+	}
+	//blocks of whole mask words, no two tasks write the same word
+	TaskPool::Instance()->ParallelFor((count + 31) / 32, CULL_TASK_OBJECTS / 32, [&](int firstWord, int endWord) {
+		CullSpheresBlock(x, y, z, radius, firstWord * 32, (endWord * 32 < count) ? endWord * 32 : count, visible, planeHints);
+	});
+}
+
+void CAbstractCamera::CullSpheresBlock(const float* x, const float* y, const float* z, const float* radius, int begin, int end, unsigned int* visible, unsigned char* planeHints) {
+	int simdEnd = begin;
+#ifdef CAMERA_CULL_SSE
+	simdEnd = begin + ((end - begin) & ~3);
+	__m128 nx[6], ny[6], nz[6], nd[6];
+	for (int i = 0; i < 6; i++) {
+		nx[i] = _mm_set1_ps(planes[i].N.x);
+		ny[i] = _mm_set1_ps(planes[i].N.y);
+		nz[i] = _mm_set1_ps(planes[i].N.z);
+		nd[i] = _mm_set1_ps(planes[i].d);
+	}
+	const __m128 zero = _mm_setzero_ps();
+	for (int g = begin; g < simdEnd; g += 4) {
+		__m128 cx = _mm_loadu_ps(x + g);
+		__m128 cy = _mm_loadu_ps(y + g);
+		__m128 cz = _mm_loadu_ps(z + g);
+		__m128 negR = _mm_sub_ps(zero, _mm_loadu_ps(radius + g));
+		if (planeHints) {
+			int h = planeHints[g >> 2];
+			__m128 dist = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx[h], cx), _mm_mul_ps(ny[h], cy)), _mm_mul_ps(nz[h], cz)), nd[h]);
+			if (_mm_movemask_ps(_mm_cmplt_ps(dist, negR)) == 0xF) {
+				continue;
+			}
+		}
+		//all six planes without branches, cheaper than stopping early
+		__m128 outMask[6];
+		__m128 out = zero;
+		for (int i = 0; i < 6; i++) {
+			__m128 dist = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx[i], cx), _mm_mul_ps(ny[i], cy)), _mm_mul_ps(nz[i], cz)), nd[i]);
+			outMask[i] = _mm_cmplt_ps(dist, negR);
+			out = _mm_or_ps(out, outMask[i]);
+		}
+		int outside = _mm_movemask_ps(out);
+		if (planeHints && outside == 0xF) {
+			//remember a plane that rejects the whole group, if one does
+			for (int i = 0; i < 6; i++) {
+				if (_mm_movemask_ps(outMask[i]) == 0xF) {
+					planeHints[g >> 2] = (unsigned char)i;
+					break;
+				}
+			}
+		}
+		visible[g >> 5] |= (unsigned int)(~outside & 0xF) << (g & 31);
+	}
+#endif
+	CullSpheresRange(x, y, z, radius, simdEnd, end, visible, planeHints);
+}
+
+void CAbstractCamera::CullBoxes(const float* minX, const float* minY, const float* minZ, const float* maxX, const float* maxY, const float* maxZ, int count, unsigned int* visible, unsigned char* planeHints) {
+	CalcFrustumPlanes();
+	ClearMask(visible, count);
+	if (count < 2 * CULL_TASK_OBJECTS) {
+		CullBoxesBlock(minX, minY, minZ, maxX, maxY, maxZ, 0, count, visible, planeHints);
+		return;
+	}
+	TaskPool::Instance()->ParallelFor((count + 31) / 32, CULL_TASK_OBJECTS / 32, [&](int firstWord, int endWord) {
+		CullBoxesBlock(minX, minY, minZ, maxX, maxY, maxZ, firstWord * 32, (endWord * 32 < count) ? endWord * 32 : count, visible, planeHints);
+	});
+}
+
+void CAbstractCamera::CullBoxesBlock(const float* minX, const float* minY, const float* minZ, const float* maxX, const float* maxY, const float* maxZ, int begin, int end, unsigned int* visible, unsigned char* planeHints) {
+	int simdEnd = begin;
+#ifdef CAMERA_CULL_SSE
+	simdEnd = begin + ((end - begin) & ~3);
+	__m128 nx[6], ny[6], nz[6], nd[6];
+	const float* px[6];
+	const float* py[6];
+	const float* pz[6];
+	for (int i = 0; i < 6; i++) {
+		const glm::vec3& N = planes[i].N;
+		nx[i] = _mm_set1_ps(N.x);
+		ny[i] = _mm_set1_ps(N.y);
+		nz[i] = _mm_set1_ps(N.z);
+		nd[i] = _mm_set1_ps(planes[i].d);
+		//the corner furthest along the normal, as in IsBoxInFrustum
+		px[i] = (N.x >= 0) ? maxX : minX;
+		py[i] = (N.y >= 0) ? maxY : minY;
+		pz[i] = (N.z >= 0) ? maxZ : minZ;
+	}
+	const __m128 zero = _mm_setzero_ps();
+	for (int g = begin; g < simdEnd; g += 4) {
+		if (planeHints) {
+			int h = planeHints[g >> 2];
+			__m128 dist = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(nx[h], _mm_loadu_ps(px[h] + g)),
+				_mm_mul_ps(ny[h], _mm_loadu_ps(py[h] + g))),
+				_mm_mul_ps(nz[h], _mm_loadu_ps(pz[h] + g))), nd[h]);
+			if (_mm_movemask_ps(_mm_cmplt_ps(dist, zero)) == 0xF) {
+				continue;
+			}
+		}
+		__m128 outMask[6];
+		__m128 out = zero;
+		for (int i = 0; i < 6; i++) {
+			__m128 dist = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(nx[i], _mm_loadu_ps(px[i] + g)),
+				_mm_mul_ps(ny[i], _mm_loadu_ps(py[i] + g))),
+				_mm_mul_ps(nz[i], _mm_loadu_ps(pz[i] + g))), nd[i]);
+			outMask[i] = _mm_cmplt_ps(dist, zero);
+			out = _mm_or_ps(out, outMask[i]);
+		}
+		int outside = _mm_movemask_ps(out);
+		if (planeHints && outside == 0xF) {
+			for (int i = 0; i < 6; i++) {
+				if (_mm_movemask_ps(outMask[i]) == 0xF) {
+					planeHints[g >> 2] = (unsigned char)i;
+					break;
+				}
+			}
+		}
+		visible[g >> 5] |= (unsigned int)(~outside & 0xF) << (g & 31);
+	}
+#endif
+	CullBoxesRange(minX, minY, minZ, maxX, maxY, maxZ, simdEnd, end, visible, planeHints);
+}
+
 void CAbstractCamera::Rotate(const float y, const float p, const float r) {
 	  yaw=glm::radians(y);
 	pitch=glm::radians(p);
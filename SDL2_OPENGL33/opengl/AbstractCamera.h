@@ -7,10 +7,20 @@
 class CAbstractCamera
 {
 public:
+	//how clip space z maps to depth, decides which rows bound near and far
+	enum DepthRange {
+		DEPTH_NEGATIVE_ONE_TO_ONE,	//OpenGL default, near at z=-w, far at z=w
+		DEPTH_ZERO_TO_ONE,		//glClipControl zero to one, near at z=0, far at z=w
+		DEPTH_REVERSED			//zero to one reversed, near at z=w, far at z=0
+	};
+
 	CAbstractCamera(void);
 	~CAbstractCamera(void);
 	 
 	void SetupProjection(const float fovy, const float aspectRatio, const float near=0.1f, const float far=1000.0f);
+	void SetupOrthographic(const float left, const float right, const float bottom, const float top, const float near=0.1f, const float far=1000.0f);
+	//any other projection, e.g. glm::infinitePerspective or a reversed-Z matrix
+	void SetProjectionMatrix(const glm::mat4& P, DepthRange range = DEPTH_NEGATIVE_ONE_TO_ONE);
 	
 	virtual void Update() = 0;
 	virtual void Rotate(const float yaw, const float pitch, const float roll); 
@@ -28,13 +38,32 @@ public:
 	const float GetAspectRatio() const; 
 	
 	
+	//planes from P*V, only recomputed after V or P changed
 	void CalcFrustumPlanes();
+	//Gribb-Hartmann extraction from the rows of a clip matrix, giving world
+	//space planes for P*V and object space planes for P*V*M, in the order
+	//top, bottom, left, right, near, far. Unnormalized planes only give the
+	//sign of a distance, enough for points and boxes but not spheres. The
+	//degenerate far plane of an infinite projection accepts everything.
+	static void ExtractFrustumPlanes(const glm::mat4& clip, CPlane planes[6], DepthRange range = DEPTH_NEGATIVE_ONE_TO_ONE, bool normalize = true);
 	bool IsPointInFrustum(const glm::vec3& point);
 	bool IsSphereInFrustum(const glm::vec3& center, const float radius);
 	bool IsBoxInFrustum(const glm::vec3& min, const glm::vec3& max);
 	void GetFrustumPlanes(glm::vec4 planes[6]);
 
-	//frustum points
+	//batch culling against the planes of the last CalcFrustumPlanes. Volumes
+	//come as one array per component; bit i of visible ((count+31)/32 words)
+	//is set when object i is at least partly inside. planeHints is optional,
+	//one byte per group of four objects, zeroed before the first frame: the
+	//plane that rejected a group is tested first for it in the next frame.
+	//Large batches are split across the TaskPool.
+	void CullSpheres(const float* x, const float* y, const float* z, const float* radius, int count, unsigned int* visible, unsigned char* planeHints = 0);
+	void CullBoxes(const float* minX, const float* minY, const float* minZ, const float* maxX, const float* maxY, const float* maxZ, int count, unsigned int* visible, unsigned char* planeHints = 0);
+	//the same without SSE, also used for the last count%4 objects
+	void CullSpheresScalar(const float* x, const float* y, const float* z, const float* radius, int count, unsigned int* visible, unsigned char* planeHints = 0);
+	void CullBoxesScalar(const float* minX, const float* minY, const float* minZ, const float* maxX, const float* maxY, const float* maxZ, int count, unsigned int* visible, unsigned char* planeHints = 0);
+
+	//frustum points, the far ones equal the near ones without a far plane
 	glm::vec3 farPts[4];
 	glm::vec3 nearPts[4];
 
@@ -50,6 +79,19 @@ protected:
 
 	//Frsutum planes
 	CPlane planes[6];
+	DepthRange depthRange;
+	bool frustumDirty;	//set whenever V or P change
+
+private:
+	//bit j set when object g+j of n is outside plane i
+	int SpheresOutside(int i, const float* x, const float* y, const float* z, const float* radius, int g, int n);
+	int BoxesOutside(int i, const float* minX, const float* minY, const float* minZ, const float* maxX, const float* maxY, const float* maxZ, int g, int n);
+	//groups of four starting at begin, ORs into visible
+	void CullSpheresRange(const float* x, const float* y, const float* z, const float* radius, int begin, int count, unsigned int* visible, unsigned char* planeHints);
+	void CullBoxesRange(const float* minX, const float* minY, const float* minZ, const float* maxX, const float* maxY, const float* maxZ, int begin, int count, unsigned int* visible, unsigned char* planeHints);
+	//objects [begin, end) with SSE, begin a multiple of 32
+	void CullSpheresBlock(const float* x, const float* y, const float* z, const float* radius, int begin, int end, unsigned int* visible, unsigned char* planeHints);
+	void CullBoxesBlock(const float* minX, const float* minY, const float* minZ, const float* maxX, const float* maxY, const float* maxZ, int begin, int end, unsigned int* visible, unsigned char* planeHints);
 };
 
 #endif
@@ -25,6 +25,7 @@ void CFreeCamera::Update() {
 
 	glm::vec3 tgt  = position+look;
 	V = glm::lookAt(position, tgt, up); 
+	frustumDirty = true;
 }
 
 void CFreeCamera::Walk(const float dt) {
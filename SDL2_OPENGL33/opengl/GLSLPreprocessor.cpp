@@ -0,0 +1,271 @@
+#include "GLSLPreprocessor.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string.h>
+
+map<string, GLSLPreprocessor::Chunk> GLSLPreprocessor::_chunks;
+vector<string> GLSLPreprocessor::_fileNames;
+
+static string LineDirective(int line, int fileId) {
+	ostringstream directive;
+	directive<<"#line "<<line<<" "<<fileId<<"\n";
+	return directive.str();
+}
+
+//does text at pos start with directive once leading blanks are skipped
+static bool IsDirective(const string& text, size_t pos, size_t end, const char* directive, size_t& after) {
+	while (pos < end && (text[pos] == ' ' || text[pos] == '\t')) {
+		pos++;
+	}
+	size_t length = strlen(directive);
+	if (end - pos < length || text.compare(pos, length, directive) != 0) {
+		return false;
+	}
+	after = pos + length;
+	return true;
+}
+
+//whether the line from pos to end leaves a block comment open, given whether
+//it starts in one. Only lines that start outside a comment can hold a
+//directive.
+static bool EndsInComment(const string& text, size_t pos, size_t end, bool inComment) {
+	while (pos + 1 < end) {
+		if (inComment) {
+			if (text[pos] == '*' && text[pos + 1] == '/') {
+				inComment = false;
+				pos += 2;
+				continue;
+			}
+		} else if (text[pos] == '/' && text[pos + 1] == '/') {
+			break;
+		} else if (text[pos] == '/' && text[pos + 1] == '*') {
+			inComment = true;
+			pos += 2;
+			continue;
+		}
+		pos++;
+	}
+	return inComment;
+}
+
+//collapse "." and ".." so one file always maps to one chunk
+static string NormalizePath(const string& path) {
+	vector<string> parts;
+	size_t pos = 0;
+	while (pos <= path.size()) {
+		size_t end = path.find_first_of("/\\", pos);
+		if (end == string::npos) {
+			end = path.size();
+		}
+		string part = path.substr(pos, end - pos);
+		if (part == "..") {
+			if (!parts.empty() && parts.back() != "..") {
+				parts.pop_back();
+			} else {
+				parts.push_back(part);
+			}
+		} else if (!part.empty() && part != ".") {
+			parts.push_back(part);
+		}
+		pos = end + 1;
+	}
+
+	string normalized = (!path.empty() && path[0] == '/') ? "/" : "";
+	for (size_t i = 0; i < parts.size(); i++) {
+		if (i > 0) {
+			normalized.push_back('/');
+		}
+		normalized.append(parts[i]);
+	}
+	return normalized;
+}
+
+bool GLSLPreprocessor::ReadFile(const string& filename, string& contents) {
+	ifstream fp(filename.c_str(), ios_base::in | ios_base::binary);
+	if (!fp) {
+		return false;
+	}
+	fp.seekg(0, ios_base::end);
+	streamoff size = fp.tellg();
+	fp.seekg(0, ios_base::beg);
+	contents.resize(static_cast<size_t>(size));
+	if (size > 0 && !fp.read(&contents[0], size)) {
+		return false;
+	}
+	return true;
+}
+
+int GLSLPreprocessor::GetFileId(const string& filename) {
+	vector<string>::iterator it = find(_fileNames.begin(), _fileNames.end(), filename);
+	if (it != _fileNames.end()) {
+		return static_cast<int>(it - _fileNames.begin()) + 1;
+	}
+	//0 is what drivers report for sources without #line, so start at 1
+	_fileNames.push_back(filename);
+	return static_cast<int>(_fileNames.size());
+}
+
+string GLSLPreprocessor::GetFileName(int fileId) {
+	if (fileId < 1 || fileId > static_cast<int>(_fileNames.size())) {
+		return "";
+	}
+	return _fileNames[fileId - 1];
+}
+
+GLSLPreprocessor::Chunk* GLSLPreprocessor::GetChunk(const string& filename) {
+	Chunk& chunk = _chunks[filename];
+	if (!chunk.loaded) {
+		chunk.expanded = false;
+		if (!ReadFile(filename, chunk.contents)) {
+			_chunks.erase(filename);
+			return 0;
+		}
+		chunk.loaded = true;
+	}
+	return &chunk;
+}
+
+void GLSLPreprocessor::Invalidate(const string& filename) {
+	for (map<string, Chunk>::iterator it = _chunks.begin(); it != _chunks.end(); ++it) {
+		Chunk& chunk = it->second;
+		if (it->first == filename) {
+			chunk.loaded = false;
+			chunk.expanded = false;
+		} else if (find(chunk.files.begin(), chunk.files.end(), filename) != chunk.files.end()) {
+			chunk.expanded = false;
+		}
+	}
+}
+
+bool GLSLPreprocessor::Process(const string& filename, string& source, vector<string>* files) {
+	set<string> included;
+	vector<string> expandedFiles;
+	vector<string> skipped;
+	source.clear();
+	if (!Expand(NormalizePath(filename), included, source, expandedFiles, skipped)) {
+		return false;
+	}
+	if (files) {
+		*files = expandedFiles;
+	}
+	return true;
+}
+
+//skipped collects include-once hits on files expanded outside this chunk, an
+//expansion that has any depends on its includer and is not cached
+bool GLSLPreprocessor::Expand(const string& filename, set<string>& included, string& out, vector<string>& files, vector<string>& skipped) {
+	Chunk* chunk = GetChunk(filename);
+	if (chunk == 0) {
+		return false;
+	}
+	included.insert(filename);
+
+	//reuse the expansion unless one of its includes is already in this program
+	if (chunk->expanded) {
+		bool reusable = true;
+		for (size_t i = 1; i < chunk->files.size() && reusable; i++) {
+			reusable = (included.count(chunk->files[i]) == 0);
+		}
+		if (reusable) {
+			out.append(chunk->expansion);
+			files.insert(files.end(), chunk->files.begin(), chunk->files.end());
+			included.insert(chunk->files.begin(), chunk->files.end());
+			return true;
+		}
+	}
+
+	const string& text = chunk->contents;
+	int fileId = GetFileId(filename);
+	string directory;
+	size_t slash = filename.find_last_of("/\\");
+	if (slash != string::npos) {
+		directory = filename.substr(0, slash + 1);
+	}
+
+	string expansion;
+	vector<string> chunkFiles(1, filename);
+	vector<string> chunkSkipped;
+	size_t after = 0;
+
+	//#version has to stay the first statement, number lines after it instead.
+	//Only a directive counts, not the word in a comment.
+	bool hasVersion = false;
+	bool inComment = false;
+	for (size_t pos = 0; pos < text.size() && !hasVersion; ) {
+		size_t end = text.find('\n', pos);
+		if (end == string::npos) {
+			end = text.size();
+		}
+		hasVersion = !inComment && IsDirective(text, pos, end, "#version", after);
+		inComment = EndsInComment(text, pos, end, inComment);
+		pos = end + 1;
+	}
+	if (!hasVersion) {
+		expansion.append(LineDirective(1, fileId));
+	}
+
+	size_t pos = 0;
+	int line = 1;
+	inComment = false;
+	while (pos < text.size()) {
+		size_t end = text.find('\n', pos);
+		size_t next = (end == string::npos) ? text.size() : end + 1;
+		if (end == string::npos) {
+			end = text.size();
+		}
+
+		bool directive = !inComment;
+		inComment = EndsInComment(text, pos, end, inComment);
+		if (directive && IsDirective(text, pos, end, "#include", after)) {
+			size_t open = text.find_first_of("\"<", after);
+			size_t close = (open < end) ? text.find_first_of("\">", open + 1) : string::npos;
+			if (open >= end || close >= end) {
+				cerr<<filename<<"("<<line<<"): malformed #include"<<endl;
+				return false;
+			}
+			string path = NormalizePath(directory + text.substr(open + 1, close - open - 1));
+			if (included.count(path)) {
+				//include once, remember when the earlier copy lives outside this chunk
+				if (find(chunkFiles.begin(), chunkFiles.end(), path) == chunkFiles.end()) {
+					chunkSkipped.push_back(path);
+				}
+			} else {
+				vector<string> childSkipped;
+				if (!Expand(path, included, expansion, chunkFiles, childSkipped)) {
+					cerr<<filename<<"("<<line<<"): cannot include "<<path<<endl;
+					return false;
+				}
+				for (size_t i = 0; i < childSkipped.size(); i++) {
+					if (find(chunkFiles.begin(), chunkFiles.end(), childSkipped[i]) == chunkFiles.end()) {
+						chunkSkipped.push_back(childSkipped[i]);
+					}
+				}
+			}
+			expansion.append(LineDirective(line + 1, fileId));
+		} else {
+			expansion.append(text, pos, next - pos);
+			if (next == end) {
+				expansion.push_back('\n');
+			}
+			if (directive && IsDirective(text, pos, end, "#version", after)) {
+				expansion.append(LineDirective(line + 1, fileId));
+			}
+		}
+
+		pos = next;
+		line++;
+	}
+
+	if (chunkSkipped.empty()) {
+		chunk->expanded = true;
+		chunk->expansion = expansion;
+		chunk->files = chunkFiles;
+	}
+	skipped.insert(skipped.end(), chunkSkipped.begin(), chunkSkipped.end());
+
+	out.append(expansion);
+	files.insert(files.end(), chunkFiles.begin(), chunkFiles.end());
+	return true;
+}
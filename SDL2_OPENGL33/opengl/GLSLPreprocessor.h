@@ -0,0 +1,48 @@
+#ifndef GLSL_PREPROCESSOR_H
+#define GLSL_PREPROCESSOR_H
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+//Resolves #include "file" directives in shader sources. Every file is read
+//once per process and expanded chunks are shared between programs. Each file
+//gets a number used as the #line source string so compile logs can be
+//mapped back with GetFileName().
+class GLSLPreprocessor
+{
+public:
+    //expand filename and everything it includes into source, files lists
+    //every file that went into the result starting with filename itself
+    static bool Process(const string& filename, string& source, vector<string>* files = 0);
+
+    //read a whole file with a single read
+    static bool ReadFile(const string& filename, string& contents);
+
+    //file behind a #line source string number, empty if unknown
+    static string GetFileName(int fileId);
+    static int GetFileId(const string& filename);
+
+    //drop cached contents of filename and of every chunk that includes it
+    static void Invalidate(const string& filename);
+
+private:
+    struct Chunk {
+        bool loaded;
+        string contents;	//file as read from disk
+        bool expanded;
+        string expansion;	//contents with includes resolved, shared when reusable
+        vector<string> files;	//files pulled into expansion, itself first
+    };
+
+    static bool Expand(const string& filename, set<string>& included, string& out, vector<string>& files, vector<string>& skipped);
+    static Chunk* GetChunk(const string& filename);
+
+    static map<string, Chunk> _chunks;
+    static vector<string> _fileNames;
+};
+
+#endif
@@ -1,63 +1,200 @@
 #include "GLSLShader.h"
+#include "GLSLPreprocessor.h"
+#include "GLSLShaderWatcher.h"
 #include <iostream>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <gtc/type_ptr.hpp>
+
+#include <stdio.h>
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool GLSLShader::_hotReload = false;
+string GLSLShader::_cacheDirectory;
+GLSLShader::ProgramCacheStats GLSLShader::_cacheStats = {0, 0, 0, 0.0, 0.0, 0.0};
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+//header in front of every cached program binary
+struct ProgramBinaryHeader {
+	unsigned int magic;
+	GLenum format;
+	GLint length;
+	float compileMs;	//what building from source cost, to report the time saved
+};
+static const unsigned int PROGRAM_BINARY_MAGIC = 0x31425047;	//"GPB1"
+
+//FNV-1a, cheap and good enough to order a handful of names
+static unsigned int HashName(const string& name) {
+	unsigned int hash = 2166136261u;
+	for (size_t i = 0; i < name.size(); i++) {
+		hash ^= static_cast<unsigned char>(name[i]);
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static bool CompareVariables(const GLSLShader::ShaderVariable& a, const GLSLShader::ShaderVariable& b) {
+	if (a.hash != b.hash) {
+		return a.hash < b.hash;
+	}
+	return a.name < b.name;
+}
+
+//binary search on the sorted table, never inserts
+static const GLSLShader::ShaderVariable* FindVariable(const vector<GLSLShader::ShaderVariable>& table, const string& name) {
+	GLSLShader::ShaderVariable key;
+	key.hash = HashName(name);
+	key.name = name;
+	vector<GLSLShader::ShaderVariable>::const_iterator it = lower_bound(table.begin(), table.end(), key, CompareVariables);
+	if (it != table.end() && it->hash == key.hash && it->name == name) {
+		return &(*it);
+	}
+	//accept the explicit first element name of arrays as well
+	if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0) {
+		return FindVariable(table, name.substr(0, name.size() - 3));
+	}
+	return 0;
+}
+
+//location of a name, array elements like "lights[2]" resolve to the first
+//element's location plus the index, -1 if not active
+static GLint FindLocation(const vector<GLSLShader::ShaderVariable>& table, const string& name) {
+	const GLSLShader::ShaderVariable* var = FindVariable(table, name);
+	if (var) {
+		return var->location;
+	}
+	size_t open = name.rfind('[');
+	if (open == string::npos || open == 0 || name[name.size() - 1] != ']' || open + 2 >= name.size()) {
+		return -1;
+	}
+	GLint index = 0;
+	for (size_t i = open + 1; i < name.size() - 1; i++) {
+		if (name[i] < '0' || name[i] > '9') {
+			return -1;
+		}
+		index = index * 10 + (name[i] - '0');
+	}
+	var = FindVariable(table, name.substr(0, open));
+	if (var == 0 || var->location == -1 || index >= var->size) {
+		return -1;
+	}
+	return var->location + index;
+}
+
+//drop the [0] GL appends to array names
+static string TrimArrayName(const char* name) {
+	string trimmed(name);
+	if (trimmed.size() > 3 && trimmed.compare(trimmed.size() - 3, 3, "[0]") == 0) {
+		trimmed.erase(trimmed.size() - 3);
+	}
+	return trimmed;
+}
+
+//64 bit FNV-1a for the cache key, a collision would load the wrong program
+static void HashBytes(unsigned long long& hash, const char* data, size_t length) {
+	for (size_t i = 0; i < length; i++) {
+		hash ^= static_cast<unsigned char>(data[i]);
+		hash *= 1099511628211ull;
+	}
+}
+
+static void HashGLString(unsigned long long& hash, GLenum name) {
+	const char* value = reinterpret_cast<const char*>(glGetString(name));
+	if (value) {
+		HashBytes(hash, value, strlen(value) + 1);
+	}
+}
 
 GLSLShader::GLSLShader(void)
 {
+	_program=0;
+	_previousProgram=0;
+	_linkPending=false;
 	_totalShaders=0;
 	_shaders[VERTEX_SHADER]=0;
 	_shaders[FRAGMENT_SHADER]=0;
 	_shaders[GEOMETRY_SHADER]=0;
-	_attributeList.clear();
-	_uniformLocationList.clear();
+	_uniformSlots.clear();
 }
 
 GLSLShader::~GLSLShader(void)
 {
-	_attributeList.clear();	
-	_uniformLocationList.clear();
+	//only a shader loaded with hot reload on is watched
+	GLSLShaderWatcher* watcher = GLSLShaderWatcher::Existing();
+	if (watcher) {
+		watcher->Unwatch(this);
+	}
+	_attributes.clear();
+	_uniforms.clear();
+	_uniformBlocks.clear();
+	_uniformSlots.clear();
 }
 
 void GLSLShader::DeleteShaderProgram() {	
+	//only a shader loaded with hot reload on is watched
+	GLSLShaderWatcher* watcher = GLSLShaderWatcher::Existing();
+	if (watcher) {
+		watcher->Unwatch(this);
+	}
 	glDeleteProgram(_program);
 }
 
 void GLSLShader::LoadFromString(GLenum type, const string& source) {	
-	GLuint shader = glCreateShader (type);
+	if (_totalShaders == 3) {
+		cerr<<"Too many shader stages"<<endl;
+		return;
+	}
+	_types[_totalShaders] = type;
+	_sources[_totalShaders] = source;
+	_files[_totalShaders].clear();
+	_shaders[_totalShaders++] = 0;
+}
+
+GLuint GLSLShader::CompileShader(int stage) {
+	GLuint shader = glCreateShader (_types[stage]);
 
-	const char * ptmp = source.c_str();
+	const char * ptmp = _sources[stage].c_str();
 	glShaderSource (shader, 1, &ptmp, NULL);
-	
-	//check whether the shader loads fine
-	GLint status;
 	glCompileShader (shader);
-	glGetShaderiv (shader, GL_COMPILE_STATUS, &status);
+	return shader;
+}
+
+//check whether the shader compiled fine, blocks until the driver is done
+bool GLSLShader::CheckCompileStatus(int stage) {
+	GLint status;
+	glGetShaderiv (_shaders[stage], GL_COMPILE_STATUS, &status);
 	if (status == GL_FALSE) {
 		GLint infoLogLength;		
-		glGetShaderiv (shader, GL_INFO_LOG_LENGTH, &infoLogLength);
+		glGetShaderiv (_shaders[stage], GL_INFO_LOG_LENGTH, &infoLogLength);
 		GLchar *infoLog= new GLchar[infoLogLength];
-		glGetShaderInfoLog (shader, infoLogLength, NULL, infoLog);
+		glGetShaderInfoLog (_shaders[stage], infoLogLength, NULL, infoLog);
 		cerr<<"Compile log: "<<infoLog<<endl;
 		delete [] infoLog;
+		//the source string numbers in the log are #line file ids
+		for (size_t i = 0; i < _files[stage].size(); i++) {
+			cerr<<"\t"<<GLSLPreprocessor::GetFileId(_files[stage][i])<<": "<<_files[stage][i]<<endl;
+		}
+		return false;
 	}
-	_shaders[_totalShaders++]=shader;
+	return true;
 }
 
-
-void GLSLShader::CreateAndLinkProgram() {
-	_program = glCreateProgram ();
-	if (_shaders[VERTEX_SHADER] != 0) {
-		glAttachShader (_program, _shaders[VERTEX_SHADER]);
-	}
-	if (_shaders[FRAGMENT_SHADER] != 0) {
-		glAttachShader (_program, _shaders[FRAGMENT_SHADER]);
-	}
-	if (_shaders[GEOMETRY_SHADER] != 0) {
-		glAttachShader (_program, _shaders[GEOMETRY_SHADER]);
-	}
-	
-	//link and check whether the program links fine
+//check whether the program links fine, blocks until the driver is done
+bool GLSLShader::CheckLinkStatus() {
 	GLint status;
-	glLinkProgram (_program);
 	glGetProgramiv (_program, GL_LINK_STATUS, &status);
 	if (status == GL_FALSE) {
 		GLint infoLogLength;
@@ -67,11 +204,225 @@ void GLSLShader::CreateAndLinkProgram() {
 		glGetProgramInfoLog (_program, infoLogLength, NULL, infoLog);
 		cerr<<"Link log: "<<infoLog<<endl;
 		delete [] infoLog;
+		return false;
 	}
+	return true;
+}
+
+void GLSLShader::CreateAndLinkProgram() {
+	BeginCreateAndLinkProgram();
+	FinishCreateAndLinkProgram();
+}
+
+//submit compile and link without asking for any status, so the driver can
+//work on it while other programs are submitted
+void GLSLShader::BeginCreateAndLinkProgram() {
+	_program = glCreateProgram ();
+	_linkPending = false;
+
+	_cachePath = ProgramCachePath();
+	if (!_cachePath.empty() && LoadProgramBinary(_cachePath)) {
+		return;
+	}
+
+	_linkStart = chrono::high_resolution_clock::now();
+	for (int i = 0; i < _totalShaders; i++) {
+		_shaders[i] = CompileShader(i);
+		glAttachShader (_program, _shaders[i]);
+	}
+	if (!_cachePath.empty()) {
+		glProgramParameteri(_program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+	glLinkProgram (_program);
+	_linkPending = true;
+}
+
+bool GLSLShader::IsLinkComplete() const {
+	if (!_linkPending || !ParallelCompileSupported()) {
+		return true;
+	}
+	GLint done = GL_TRUE;
+	glGetProgramiv(_program, GL_COMPLETION_STATUS_KHR, &done);
+	return done == GL_TRUE;
+}
+
+void GLSLShader::FinishCreateAndLinkProgram() {
+	CompleteLink();
+	UpdateInterface();
+	if (_hotReload) {
+		WatchFiles();
+	}
+}
+
+//status checks and cache write of a submitted link, true if the program is usable
+bool GLSLShader::CompleteLink() {
+	if (!_linkPending) {
+		return true;
+	}
+
+	//the log of a failed stage is more useful than the link log alone
+	for (int i = 0; i < _totalShaders; i++) {
+		CheckCompileStatus(i);
+	}
+	bool linked = CheckLinkStatus();
+
+	for (int i = 0; i < _totalShaders; i++) {
+		glDeleteShader(_shaders[i]);
+		_shaders[i] = 0;
+	}
+
+	float compileMs = chrono::duration<float, milli>(chrono::high_resolution_clock::now() - _linkStart).count();
+	if (!_cachePath.empty()) {
+		_cacheStats.misses++;
+		_cacheStats.compileMs += compileMs;
+		if (linked) {
+			SaveProgramBinary(_cachePath, compileMs);
+		}
+	}
+	_linkPending = false;
+	return linked;
+}
+
+void GLSLShader::UpdateInterface() {
+	ReflectProgram();
+
+	//handles resolved before a relink must point at the new locations
+	for (size_t i = 0; i < _uniformSlots.size(); i++) {
+		_uniformSlots[i].location = FindLocation(_uniforms, _uniformSlots[i].name);
+	}
+	InvalidateUniformCache();
+}
+
+void GLSLShader::CreateAndLinkPrograms(GLSLShader** shaders, int count) {
+	if (ParallelCompileSupported()) {
+#ifdef GL_KHR_parallel_shader_compile
+		if (glMaxShaderCompilerThreadsKHR) {
+			//let the driver pick as many threads as it likes
+			glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+		}
+#endif
+	}
+
+	for (int i = 0; i < count; i++) {
+		shaders[i]->BeginCreateAndLinkProgram();
+	}
+
+	//finish programs in the order the driver completes them
+	vector<bool> finished(count, false);
+	int remaining = count;
+	while (remaining > 0) {
+		bool progress = false;
+		for (int i = 0; i < count; i++) {
+			if (!finished[i] && shaders[i]->IsLinkComplete()) {
+				shaders[i]->FinishCreateAndLinkProgram();
+				finished[i] = true;
+				remaining--;
+				progress = true;
+			}
+		}
+		if (!progress) {
+			this_thread::yield();
+		}
+	}
+}
+
+bool GLSLShader::ParallelCompileSupported() {
+	static int supported = -1;
+	if (supported == -1) {
+		supported = 0;
+		GLint count = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+		for (GLint i = 0; i < count && !supported; i++) {
+			const char* name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+			if (name && (strcmp(name, "GL_KHR_parallel_shader_compile") == 0 ||
+				strcmp(name, "GL_ARB_parallel_shader_compile") == 0)) {
+				supported = 1;
+			}
+		}
+	}
+	return supported == 1;
+}
+
+//enumerate the active interface once so lookups never have to ask GL
+void GLSLShader::ReflectProgram() {
+	_attributes.clear();
+	_uniforms.clear();
+	_uniformBlocks.clear();
+
+	GLint count = 0, maxLength = 0;
+	glGetProgramiv(_program, GL_ACTIVE_ATTRIBUTES, &count);
+	glGetProgramiv(_program, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+	vector<GLchar> name(maxLength + 1);
+	for (GLint i = 0; i < count; i++) {
+		ShaderVariable var;
+		glGetActiveAttrib(_program, i, maxLength + 1, NULL, &var.size, &var.type, &name[0]);
+		var.name = TrimArrayName(&name[0]);
+		var.hash = HashName(var.name);
+		var.location = glGetAttribLocation(_program, &name[0]);
+		var.arrayStride = -1;
+		_attributes.push_back(var);
+	}
+
+	glGetProgramiv(_program, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(_program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+	name.resize(maxLength + 1);
+	for (GLint i = 0; i < count; i++) {
+		ShaderVariable var;
+		GLuint index = i;
+		glGetActiveUniform(_program, index, maxLength + 1, NULL, &var.size, &var.type, &name[0]);
+		glGetActiveUniformsiv(_program, 1, &index, GL_UNIFORM_ARRAY_STRIDE, &var.arrayStride);
+		var.name = TrimArrayName(&name[0]);
+		var.hash = HashName(var.name);
+		var.location = glGetUniformLocation(_program, &name[0]);
+		_uniforms.push_back(var);
+	}
+
+	glGetProgramiv(_program, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+	glGetProgramiv(_program, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxLength);
+	name.resize(maxLength + 1);
+	for (GLint i = 0; i < count; i++) {
+		ShaderVariable var;
+		glGetActiveUniformBlockName(_program, i, maxLength + 1, NULL, &name[0]);
+		glGetActiveUniformBlockiv(_program, i, GL_UNIFORM_BLOCK_DATA_SIZE, &var.size);
+		var.name = &name[0];
+		var.hash = HashName(var.name);
+		var.location = i;
+		var.type = GL_NONE;
+		var.arrayStride = -1;
+		_uniformBlocks.push_back(var);
+	}
+
+	sort(_attributes.begin(), _attributes.end(), CompareVariables);
+	sort(_uniforms.begin(), _uniforms.end(), CompareVariables);
+	sort(_uniformBlocks.begin(), _uniformBlocks.end(), CompareVariables);
+}
+
+const GLSLShader::ShaderVariable* GLSLShader::FindAttribute(const string& attribute) const {
+	return FindVariable(_attributes, attribute);
+}
+
+const GLSLShader::ShaderVariable* GLSLShader::FindUniform(const string& uniform) const {
+	return FindVariable(_uniforms, uniform);
+}
 
-	glDeleteShader(_shaders[VERTEX_SHADER]);
-	glDeleteShader(_shaders[FRAGMENT_SHADER]);
-	glDeleteShader(_shaders[GEOMETRY_SHADER]);
+const GLSLShader::ShaderVariable* GLSLShader::FindUniformBlock(const string& block) const {
+	return FindVariable(_uniformBlocks, block);
+}
+
+void GLSLShader::DumpInterface(ostream& out) const {
+	out<<"Program "<<_program<<endl;
+	for (size_t i = 0; i < _attributes.size(); i++) {
+		const ShaderVariable& var = _attributes[i];
+		out<<"\tattribute "<<var.name<<" location="<<var.location<<" type=0x"<<hex<<var.type<<dec<<" size="<<var.size<<endl;
+	}
+	for (size_t i = 0; i < _uniforms.size(); i++) {
+		const ShaderVariable& var = _uniforms[i];
+		out<<"\tuniform "<<var.name<<" location="<<var.location<<" type=0x"<<hex<<var.type<<dec<<" size="<<var.size<<" stride="<<var.arrayStride<<endl;
+	}
+	for (size_t i = 0; i < _uniformBlocks.size(); i++) {
+		const ShaderVariable& var = _uniformBlocks[i];
+		out<<"\tblock "<<var.name<<" index="<<var.location<<" bytes="<<var.size<<endl;
+	}
 }
 
 void GLSLShader::Use() {
@@ -83,35 +434,379 @@ void GLSLShader::UnUse() {
 }
 
 void GLSLShader::AddAttribute(const string& attribute) {
-	_attributeList[attribute]= glGetAttribLocation(_program, attribute.c_str());	
+	if (FindAttribute(attribute) == 0) {
+		cerr<<"Attribute not active: "<<attribute<<endl;
+	}
 }
 
 //An indexer that returns the location of the attribute
-GLuint GLSLShader::operator [](const string& attribute) {
-	return _attributeList[attribute];
+GLuint GLSLShader::operator [](const string& attribute) const {
+	const ShaderVariable* var = FindAttribute(attribute);
+	return var ? var->location : GLuint(-1);
 }
 
 void GLSLShader::AddUniform(const string& uniform) {
-	_uniformLocationList[uniform] = glGetUniformLocation(_program, uniform.c_str());
+	if (FindUniform(uniform) == 0 && FindLocation(_uniforms, uniform) == -1) {
+		cerr<<"Uniform not active: "<<uniform<<endl;
+	}
 }
 
-GLuint GLSLShader::operator()(const string& uniform){
-	return _uniformLocationList[uniform];
+GLuint GLSLShader::operator()(const string& uniform) const {
+	return FindLocation(_uniforms, uniform);
+}
+
+GLSLShader::UniformHandle GLSLShader::GetUniform(const string& uniform) {
+	for (size_t i = 0; i < _uniformSlots.size(); i++) {
+		if (_uniformSlots[i].name == uniform) {
+			return static_cast<UniformHandle>(i);
+		}
+	}
+
+	GLint location = FindLocation(_uniforms, uniform);
+	if (location == -1) {
+		cerr<<"Uniform not active: "<<uniform<<endl;
+		return INVALID_UNIFORM;
+	}
+
+	UniformSlot slot;
+	slot.name = uniform;
+	slot.location = location;
+	slot.cachedBytes = 0;
+	_uniformSlots.push_back(slot);
+	return static_cast<UniformHandle>(_uniformSlots.size() - 1);
+}
+
+//returns true when the value differs from the last upload and has to be sent
+bool GLSLShader::UpdateCache(UniformHandle handle, GLenum type, int count, const void* value, int bytes) {
+	if (handle < 0 || handle >= static_cast<UniformHandle>(_uniformSlots.size())) {
+		return false;
+	}
+
+	UniformSlot& slot = _uniformSlots[handle];
+	if (bytes > MAX_CACHED_BYTES) {
+		//too big to cache, always upload
+		slot.cachedBytes = 0;
+		return true;
+	}
+	if (slot.cachedBytes == bytes && memcmp(slot.cache, value, bytes) == 0) {
+		return false;
+	}
+	memcpy(slot.cache, value, bytes);
+	slot.cachedBytes = bytes;
+	slot.cachedType = type;
+	slot.cachedCount = count;
+	return true;
+}
+
+void GLSLShader::UploadUniform(UniformHandle handle, GLenum type, int count, const void* value) {
+	GLint location = _uniformSlots[handle].location;
+	switch (type) {
+	case GL_FLOAT_MAT4:
+		glUniformMatrix4fv(location, count, GL_FALSE, static_cast<const GLfloat*>(value));
+		break;
+	case GL_FLOAT_VEC4:
+		glUniform4fv(location, count, static_cast<const GLfloat*>(value));
+		break;
+	case GL_FLOAT_VEC3:
+		glUniform3fv(location, count, static_cast<const GLfloat*>(value));
+		break;
+	case GL_FLOAT_VEC2:
+		glUniform2fv(location, count, static_cast<const GLfloat*>(value));
+		break;
+	case GL_FLOAT:
+		glUniform1fv(location, count, static_cast<const GLfloat*>(value));
+		break;
+	case GL_INT:
+		glUniform1iv(location, count, static_cast<const GLint*>(value));
+		break;
+	}
+}
+
+void GLSLShader::SetUniform(UniformHandle handle, const glm::mat4& value) {
+	if (UpdateCache(handle, GL_FLOAT_MAT4, 1, glm::value_ptr(value), sizeof(glm::mat4))) {
+		UploadUniform(handle, GL_FLOAT_MAT4, 1, glm::value_ptr(value));
+	}
+}
+
+void GLSLShader::SetUniform(UniformHandle handle, const glm::vec4& value) {
+	if (UpdateCache(handle, GL_FLOAT_VEC4, 1, glm::value_ptr(value), sizeof(glm::vec4))) {
+		UploadUniform(handle, GL_FLOAT_VEC4, 1, glm::value_ptr(value));
+	}
+}
+
+void GLSLShader::SetUniform(UniformHandle handle, const glm::vec3& value) {
+	if (UpdateCache(handle, GL_FLOAT_VEC3, 1, glm::value_ptr(value), sizeof(glm::vec3))) {
+		UploadUniform(handle, GL_FLOAT_VEC3, 1, glm::value_ptr(value));
+	}
+}
+
+void GLSLShader::SetUniform(UniformHandle handle, const glm::vec2* values, int count) {
+	if (UpdateCache(handle, GL_FLOAT_VEC2, count, glm::value_ptr(values[0]), count * sizeof(glm::vec2))) {
+		UploadUniform(handle, GL_FLOAT_VEC2, count, glm::value_ptr(values[0]));
+	}
+}
+
+void GLSLShader::SetUniform(UniformHandle handle, float value) {
+	if (UpdateCache(handle, GL_FLOAT, 1, &value, sizeof(float))) {
+		UploadUniform(handle, GL_FLOAT, 1, &value);
+	}
+}
+
+void GLSLShader::SetSampler(UniformHandle handle, GLint textureUnit) {
+	if (UpdateCache(handle, GL_INT, 1, &textureUnit, sizeof(GLint))) {
+		UploadUniform(handle, GL_INT, 1, &textureUnit);
+	}
+}
+
+void GLSLShader::InvalidateUniformCache() {
+	for (size_t i = 0; i < _uniformSlots.size(); i++) {
+		_uniformSlots[i].cachedBytes = 0;
+	}
+}
+
+void GLSLShader::EnableHotReload(bool enable) {
+	_hotReload = enable;
+}
+
+void GLSLShader::WatchFiles() {
+	vector<string> files;
+	for (int i = 0; i < _totalShaders; i++) {
+		files.insert(files.end(), _files[i].begin(), _files[i].end());
+	}
+	if (!files.empty()) {
+		GLSLShaderWatcher::Instance()->Watch(this, files);
+	}
+}
+
+bool GLSLShader::Reload() {
+	if (!BeginReload()) {
+		return false;
+	}
+	return FinishReload();
+}
+
+//rebuild every stage from its files into a new program, the current program
+//stays in place until FinishReload knows the new one works
+bool GLSLShader::BeginReload() {
+	string sources[3];
+	vector<string> files[3];
+	for (int i = 0; i < _totalShaders; i++) {
+		if (_files[i].empty()) {
+			//stage came from a string, nothing to reload from
+			sources[i] = _sources[i];
+			continue;
+		}
+		if (!GLSLPreprocessor::Process(_files[i][0], sources[i], &files[i])) {
+			cerr<<"Error reloading shader: "<<_files[i][0]<<endl;
+			return false;
+		}
+	}
+
+	_previousProgram = _program;
+	for (int i = 0; i < _totalShaders; i++) {
+		_previousSources[i].swap(_sources[i]);
+		_previousFiles[i].swap(_files[i]);
+		_sources[i].swap(sources[i]);
+		_files[i].swap(files[i]);
+	}
+	BeginCreateAndLinkProgram();
+	return true;
+}
+
+bool GLSLShader::FinishReload() {
+	if (!CompleteLink()) {
+		cerr<<"Reload failed, keeping the previous program"<<endl;
+		glDeleteProgram(_program);
+		_program = _previousProgram;
+		_previousProgram = 0;
+		for (int i = 0; i < _totalShaders; i++) {
+			_sources[i].swap(_previousSources[i]);
+			_files[i].swap(_previousFiles[i]);
+		}
+		//the failed sources may still include new files worth watching
+		WatchFiles();
+		return false;
+	}
+
+	glDeleteProgram(_previousProgram);
+	_previousProgram = 0;
+	for (int i = 0; i < _totalShaders; i++) {
+		_previousSources[i].clear();
+		_previousFiles[i].clear();
+	}
+
+	//keep the handle cache, it holds the values to restore into the new program
+	vector<UniformSlot> slots = _uniformSlots;
+	UpdateInterface();
+	WatchFiles();
+
+	//uniform values live in the program object, upload again what was set
+	//through handles. Values set with raw glUniform* calls are lost, and
+	//VAOs keep the old attribute locations unless they are fixed in the shader.
+	GLint current = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &current);
+	glUseProgram(_program);
+	for (size_t i = 0; i < slots.size(); i++) {
+		const UniformSlot& slot = slots[i];
+		if (slot.cachedBytes == 0) {
+			continue;
+		}
+		UploadUniform(static_cast<UniformHandle>(i), slot.cachedType, slot.cachedCount, slot.cache);
+		_uniformSlots[i].cachedBytes = slot.cachedBytes;
+		_uniformSlots[i].cachedType = slot.cachedType;
+		_uniformSlots[i].cachedCount = slot.cachedCount;
+		memcpy(_uniformSlots[i].cache, slot.cache, slot.cachedBytes);
+	}
+	glUseProgram(current);
+	return true;
 }
 
-#include <fstream>
 void GLSLShader::LoadFromFile(GLenum whichShader, const string& filename){
-	ifstream fp;
-	fp.open(filename.c_str(), ios_base::in);
-	if(fp) {		 
-		string line, buffer;
-		while(getline(fp, line)) {
-			buffer.append(line);
-			buffer.append("\r\n");
-		}		 
-		//copy to source
-		LoadFromString(whichShader, buffer);		
+	string buffer;
+	vector<string> files;
+	if (GLSLPreprocessor::Process(filename, buffer, &files)) {
+		int stage = _totalShaders;
+		LoadFromString(whichShader, buffer);
+		if (_totalShaders > stage) {
+			_files[stage] = files;
+		}
 	} else {
 		cerr<<"Error loading shader: "<<filename<<endl;
 	}
 }
+
+bool GLSLShader::ProgramCacheSupported() {
+	static int supported = -1;
+	if (supported == -1) {
+		GLint formats = 0;
+		if (GLEW_ARB_get_program_binary) {
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		}
+		supported = (formats > 0) ? 1 : 0;
+		if (!supported && !_cacheDirectory.empty()) {
+			cerr<<"Program binaries not supported, shader cache disabled"<<endl;
+		}
+	}
+	return supported == 1;
+}
+
+//the key covers every source and the driver, an update of either misses
+string GLSLShader::ProgramCachePath() const {
+	if (_cacheDirectory.empty() || !ProgramCacheSupported()) {
+		return "";
+	}
+
+	unsigned long long hash = 14695981039346656037ull;
+	HashGLString(hash, GL_VENDOR);
+	HashGLString(hash, GL_RENDERER);
+	HashGLString(hash, GL_VERSION);
+	HashGLString(hash, GL_SHADING_LANGUAGE_VERSION);
+	for (int i = 0; i < _totalShaders; i++) {
+		HashBytes(hash, reinterpret_cast<const char*>(&_types[i]), sizeof(GLenum));
+		HashBytes(hash, _sources[i].c_str(), _sources[i].size() + 1);
+	}
+
+	ostringstream path;
+	path<<_cacheDirectory<<"/"<<hex;
+	path.width(16);
+	path.fill('0');
+	path<<hash<<".bin";
+	return path.str();
+}
+
+bool GLSLShader::LoadProgramBinary(const string& path) {
+	ifstream fp(path.c_str(), ios_base::in | ios_base::binary);
+	if (!fp) {
+		return false;
+	}
+
+	ProgramBinaryHeader header;
+	if (!fp.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+		header.magic != PROGRAM_BINARY_MAGIC || header.length <= 0) {
+		return false;
+	}
+	vector<char> binary(header.length);
+	if (!fp.read(&binary[0], header.length)) {
+		return false;
+	}
+
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+	glProgramBinary(_program, header.format, &binary[0], header.length);
+	GLint status;
+	glGetProgramiv(_program, GL_LINK_STATUS, &status);
+	double loadMs = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+
+	if (status == GL_FALSE) {
+		//driver changed its mind about the format, start over from source
+		_cacheStats.rejected++;
+		glDeleteProgram(_program);
+		_program = glCreateProgram();
+		return false;
+	}
+
+	_cacheStats.hits++;
+	_cacheStats.loadMs += loadMs;
+	_cacheStats.savedMs += header.compileMs - loadMs;
+	return true;
+}
+
+void GLSLShader::SaveProgramBinary(const string& path, float compileMs) {
+	ProgramBinaryHeader header;
+	header.magic = PROGRAM_BINARY_MAGIC;
+	header.compileMs = compileMs;
+	glGetProgramiv(_program, GL_PROGRAM_BINARY_LENGTH, &header.length);
+	if (header.length <= 0) {
+		return;
+	}
+	vector<char> binary(header.length);
+	glGetProgramBinary(_program, header.length, NULL, &header.format, &binary[0]);
+
+#ifdef _WIN32
+	_mkdir(_cacheDirectory.c_str());
+#else
+	mkdir(_cacheDirectory.c_str(), 0755);
+#endif
+	//written next to it and renamed over it, so a crash or another instance
+	//saving the same program never leaves a truncated file to load
+	stringstream temporary;
+#ifdef _WIN32
+	temporary<<path<<"."<<_getpid()<<".tmp";
+#else
+	temporary<<path<<"."<<getpid()<<".tmp";
+#endif
+	string temporaryPath = temporary.str();
+	ofstream fp(temporaryPath.c_str(), ios_base::out | ios_base::binary | ios_base::trunc);
+	if (!fp) {
+		cerr<<"Cannot write program cache: "<<path<<endl;
+		return;
+	}
+	fp.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	fp.write(&binary[0], header.length);
+	fp.close();
+	if (!fp) {
+		cerr<<"Cannot write program cache: "<<path<<endl;
+		remove(temporaryPath.c_str());
+		return;
+	}
+#ifdef _WIN32
+	//rename does not replace an existing file here
+	remove(path.c_str());
+#endif
+	if (rename(temporaryPath.c_str(), path.c_str()) != 0) {
+		remove(temporaryPath.c_str());
+	}
+}
+
+void GLSLShader::SetProgramCacheDirectory(const string& directory) {
+	_cacheDirectory = directory;
+}
+
+const GLSLShader::ProgramCacheStats& GLSLShader::GetProgramCacheStats() {
+	return _cacheStats;
+}
+
+void GLSLShader::PrintProgramCacheStats(ostream& out) {
+	out<<"Program cache: "<<_cacheStats.hits<<" hits, "<<_cacheStats.misses<<" misses ("
+		<<_cacheStats.rejected<<" rejected), "<<_cacheStats.compileMs<<" ms compiling, "
+		<<_cacheStats.loadMs<<" ms loading, "<<_cacheStats.savedMs<<" ms saved"<<endl;
+}
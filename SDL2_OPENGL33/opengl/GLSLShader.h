@@ -2,36 +2,162 @@
 #define GLSL_SHADER_H
 
 #include <GL/glew.h>
-#include <map>
+#include <chrono>
+#include <iosfwd>
 #include <string>
+#include <vector>
+#include <glm.hpp>
 
 using namespace std;
 
 class GLSLShader
 {
 public:
+    //handle to a uniform resolved once with GetUniform(), an index into the
+    //program's uniform slot table so setting a uniform needs no string lookup
+    typedef int UniformHandle;
+    static const UniformHandle INVALID_UNIFORM = -1;
+
+    //one active uniform, uniform block or attribute, filled by reflection at link time
+    struct ShaderVariable {
+        unsigned int hash;	//hash of name, primary sort key
+        string name;		//without the trailing [0] of arrays
+        GLint location;		//-1 for uniforms inside a block, block index for blocks
+        GLenum type;		//GL_NONE for blocks
+        GLint size;		//array length, data size in bytes for blocks
+        GLint arrayStride;	//bytes between array elements inside a block, -1 otherwise
+    };
+
+    //counters of the on-disk program binary cache since startup
+    struct ProgramCacheStats {
+        int hits;
+        int misses;
+        int rejected;		//binaries the driver refused, counted as misses too
+        double loadMs;		//time spent in glProgramBinary
+        double compileMs;	//time spent compiling and linking from source
+        double savedMs;		//compile time the hits would have cost minus loadMs
+    };
+
     GLSLShader(void);
-    ~GLSLShader(void);	
+    ~GLSLShader(void);
+    //sources are kept and only compiled by CreateAndLinkProgram, which first
+    //tries the program binary cache. Files may #include "other" files.
     void LoadFromString(GLenum whichShader, const string& source);
     void LoadFromFile(GLenum whichShader, const string& filename);
     void CreateAndLinkProgram();
+
+    //CreateAndLinkProgram in two halves: Begin submits compile and link
+    //without querying any status, Finish checks status, logs and reflects
+    void BeginCreateAndLinkProgram();
+    bool IsLinkComplete() const;
+    void FinishCreateAndLinkProgram();
+
+    //build several programs at once, submitting all of them before the first
+    //status query so drivers with KHR_parallel_shader_compile work in parallel
+    static void CreateAndLinkPrograms(GLSLShader** shaders, int count);
+
     void Use();
     void UnUse();
+    GLuint GetProgram() const { return _program; }
+    //check that the attribute/uniform is active, the locations themselves are
+    //reflected by CreateAndLinkProgram
     void AddAttribute(const string& attribute);
     void AddUniform(const string& uniform);
 
-    //An indexer that returns the location of the attribute/uniform
-    GLuint operator[](const string& attribute);
-    GLuint operator()(const string& uniform);
+    //An indexer that returns the location of the attribute/uniform, -1 if not active
+    GLuint operator[](const string& attribute) const;
+    GLuint operator()(const string& uniform) const;
     void DeleteShaderProgram();
 
+    //reflected program interface, sorted by hash then name
+    const vector<ShaderVariable>& GetActiveAttributes() const { return _attributes; }
+    const vector<ShaderVariable>& GetActiveUniforms() const { return _uniforms; }
+    const vector<ShaderVariable>& GetActiveUniformBlocks() const { return _uniformBlocks; }
+    const ShaderVariable* FindAttribute(const string& attribute) const;
+    const ShaderVariable* FindUniform(const string& uniform) const;
+    const ShaderVariable* FindUniformBlock(const string& block) const;
+    //print every active attribute, uniform and block
+    void DumpInterface(ostream& out) const;
+
+    //resolve a uniform name into a handle, do this at init and keep the handle
+    UniformHandle GetUniform(const string& uniform);
+
+    //typed setters, the program must be in use. A value equal to the last one
+    //uploaded through the same handle is skipped.
+    void SetUniform(UniformHandle handle, const glm::mat4& value);
+    void SetUniform(UniformHandle handle, const glm::vec4& value);
+    void SetUniform(UniformHandle handle, const glm::vec3& value);
+    void SetUniform(UniformHandle handle, const glm::vec2* values, int count);
+    void SetUniform(UniformHandle handle, float value);
+    void SetSampler(UniformHandle handle, GLint textureUnit);
+
+    //forget the cached values, needed after uploading through raw glUniform* calls
+    void InvalidateUniformCache();
+
+    //rebuild the program from its files, the old program stays if the new one
+    //fails. Begin/Finish split it like BeginCreateAndLinkProgram.
+    bool Reload();
+    bool BeginReload();
+    bool FinishReload();
+
+    //register programs built from files with GLSLShaderWatcher from now on
+    static void EnableHotReload(bool enable);
+
+    //store linked programs under this directory, an empty name disables the cache
+    static void SetProgramCacheDirectory(const string& directory);
+    static const ProgramCacheStats& GetProgramCacheStats();
+    static void PrintProgramCacheStats(ostream& out);
+
 private:
     enum ShaderType {VERTEX_SHADER, FRAGMENT_SHADER, GEOMETRY_SHADER};
+
+    //largest value the cache holds, a mat4 or four vec4
+    static const int MAX_CACHED_BYTES = 16 * sizeof(GLfloat);
+
+    struct UniformSlot {
+        string name;
+        GLint location;
+        int cachedBytes;	//0 while nothing has been uploaded
+        GLenum cachedType;	//how cache was uploaded, to replay it after a reload
+        int cachedCount;
+        GLubyte cache[MAX_CACHED_BYTES];
+    };
+
+    bool UpdateCache(UniformHandle handle, GLenum type, int count, const void* value, int bytes);
+    void UploadUniform(UniformHandle handle, GLenum type, int count, const void* value);
+    bool CompleteLink();
+    void UpdateInterface();
+    void WatchFiles();
+    void ReflectProgram();
+    GLuint CompileShader(int stage);
+    bool CheckCompileStatus(int stage);
+    bool CheckLinkStatus();
+    string ProgramCachePath() const;
+    bool LoadProgramBinary(const string& path);
+    void SaveProgramBinary(const string& path, float compileMs);
+
+    static bool ProgramCacheSupported();
+    static bool ParallelCompileSupported();
+    static bool _hotReload;
+    static string _cacheDirectory;
+    static ProgramCacheStats _cacheStats;
+
     GLuint	_program;
     int _totalShaders;
     GLuint _shaders[3];//0->vertexshader, 1->fragmentshader, 2->geometryshader
-    map<string,GLuint> _attributeList;
-    map<string,GLuint> _uniformLocationList;
-};	
+    GLenum _types[3];
+    string _sources[3];
+    vector<string> _files[3];	//files each stage was built from, for compile logs
+    bool _linkPending;		//Begin submitted a link that Finish has not checked yet
+    string _cachePath;
+    chrono::high_resolution_clock::time_point _linkStart;
+    GLuint _previousProgram;	//program kept while a reload is in flight
+    string _previousSources[3];
+    vector<string> _previousFiles[3];
+    vector<ShaderVariable> _attributes;
+    vector<ShaderVariable> _uniforms;
+    vector<ShaderVariable> _uniformBlocks;
+    vector<UniformSlot> _uniformSlots;
+};
 
-#endif
\ No newline at end of file
+#endif
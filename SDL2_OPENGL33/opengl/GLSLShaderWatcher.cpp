@@ -0,0 +1,163 @@
+#include "GLSLShaderWatcher.h"
+#include "GLSLShader.h"
+#include "GLSLPreprocessor.h"
+#include <iostream>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#else
+#include <sys/stat.h>
+#endif
+
+GLSLShaderWatcher* GLSLShaderWatcher::s_pInstance = 0;
+
+#ifndef __linux__
+//how often modification times are checked without inotify
+const int POLL_INTERVAL_MS = 500;
+#endif
+
+//directory part of a file name including the trailing separator
+static string DirectoryOf(const string& file) {
+	size_t slash = file.find_last_of("/\\");
+	return (slash == string::npos) ? "" : file.substr(0, slash + 1);
+}
+
+GLSLShaderWatcher::GLSLShaderWatcher()
+{
+#ifdef __linux__
+	_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (_inotify < 0) {
+		cerr<<"inotify not available, shader hot reload disabled"<<endl;
+	}
+#else
+	_lastPoll = chrono::steady_clock::now();
+#endif
+}
+
+GLSLShaderWatcher::~GLSLShaderWatcher()
+{
+#ifdef __linux__
+	if (_inotify >= 0) {
+		close(_inotify);
+	}
+#endif
+}
+
+void GLSLShaderWatcher::Watch(GLSLShader* shader, const vector<string>& files) {
+	Unwatch(shader);
+	_filesByShader[shader] = files;
+	for (size_t i = 0; i < files.size(); i++) {
+		_shadersByFile[files[i]].insert(shader);
+#ifdef __linux__
+		WatchDirectory(DirectoryOf(files[i]));
+#else
+		if (_modified.count(files[i]) == 0) {
+			struct stat info;
+			_modified[files[i]] = (stat(files[i].c_str(), &info) == 0) ? info.st_mtime : -1;
+		}
+#endif
+	}
+}
+
+void GLSLShaderWatcher::Unwatch(GLSLShader* shader) {
+	map<GLSLShader*, vector<string> >::iterator it = _filesByShader.find(shader);
+	if (it == _filesByShader.end()) {
+		return;
+	}
+	for (size_t i = 0; i < it->second.size(); i++) {
+		set<GLSLShader*>& shaders = _shadersByFile[it->second[i]];
+		shaders.erase(shader);
+		if (shaders.empty()) {
+			_shadersByFile.erase(it->second[i]);
+		}
+	}
+	_filesByShader.erase(it);
+}
+
+//editors often save by replacing the file, so watch the directory and not
+//the file itself
+void GLSLShaderWatcher::WatchDirectory(const string& directory) {
+#ifdef __linux__
+	if (_inotify < 0 || _watchedDirectories.count(directory)) {
+		return;
+	}
+	string path = directory.empty() ? "." : directory;
+	int wd = inotify_add_watch(_inotify, path.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+	if (wd < 0) {
+		cerr<<"Cannot watch shader directory: "<<path<<endl;
+		return;
+	}
+	_directories[wd] = directory;
+	_watchedDirectories.insert(directory);
+#endif
+}
+
+void GLSLShaderWatcher::CollectChanges(set<string>& changed) {
+#ifdef __linux__
+	if (_inotify < 0) {
+		return;
+	}
+	char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	for (;;) {
+		ssize_t length = read(_inotify, buffer, sizeof(buffer));
+		if (length <= 0) {
+			//EAGAIN, nothing changed since the last frame
+			break;
+		}
+		for (char* p = buffer; p < buffer + length; ) {
+			const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(p);
+			if (event->len > 0) {
+				string file = _directories[event->wd] + event->name;
+				if (_shadersByFile.count(file)) {
+					changed.insert(file);
+				}
+			}
+			p += sizeof(struct inotify_event) + event->len;
+		}
+	}
+#else
+	chrono::steady_clock::time_point now = chrono::steady_clock::now();
+	if (chrono::duration_cast<chrono::milliseconds>(now - _lastPoll).count() < POLL_INTERVAL_MS) {
+		return;
+	}
+	_lastPoll = now;
+	for (map<string, set<GLSLShader*> >::iterator it = _shadersByFile.begin(); it != _shadersByFile.end(); ++it) {
+		struct stat info;
+		long long modified = (stat(it->first.c_str(), &info) == 0) ? info.st_mtime : -1;
+		if (modified != _modified[it->first]) {
+			_modified[it->first] = modified;
+			changed.insert(it->first);
+		}
+	}
+#endif
+}
+
+void GLSLShaderWatcher::Update() {
+	set<string> changed;
+	CollectChanges(changed);
+	if (changed.empty()) {
+		return;
+	}
+
+	set<GLSLShader*> affected;
+	for (set<string>::iterator it = changed.begin(); it != changed.end(); ++it) {
+		cout<<"Shader changed: "<<*it<<endl;
+		GLSLPreprocessor::Invalidate(*it);
+		map<string, set<GLSLShader*> >::iterator shaders = _shadersByFile.find(*it);
+		if (shaders != _shadersByFile.end()) {
+			affected.insert(shaders->second.begin(), shaders->second.end());
+		}
+	}
+
+	//submit every rebuild before checking any, like CreateAndLinkPrograms
+	vector<GLSLShader*> reloading;
+	for (set<GLSLShader*>::iterator it = affected.begin(); it != affected.end(); ++it) {
+		if ((*it)->BeginReload()) {
+			reloading.push_back(*it);
+		}
+	}
+	for (size_t i = 0; i < reloading.size(); i++) {
+		reloading[i]->FinishReload();
+	}
+}
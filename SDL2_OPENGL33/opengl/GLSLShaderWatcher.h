@@ -0,0 +1,62 @@
+#ifndef GLSL_SHADER_WATCHER_H
+#define GLSL_SHADER_WATCHER_H
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <chrono>
+
+using namespace std;
+
+class GLSLShader;
+
+//Watches the files shaders were loaded from and reloads the programs when one
+//of them changes. Uses inotify on Linux and polls modification times
+//elsewhere. Changes are applied by Update() on the GL thread at the frame
+//boundary; a frame without changes costs one non-blocking read.
+class GLSLShaderWatcher
+{
+public:
+    static GLSLShaderWatcher* Instance()
+    {
+        if (s_pInstance == 0) {
+            s_pInstance = new GLSLShaderWatcher();
+        }
+
+        return s_pInstance;
+    }
+    //the watcher if one was created, without creating it and its inotify
+    //descriptor for programs that never watch a file
+    static GLSLShaderWatcher* Existing() { return s_pInstance; }
+
+    //replaces the file list of a shader that is already watched
+    void Watch(GLSLShader* shader, const vector<string>& files);
+    void Unwatch(GLSLShader* shader);
+
+    //reload every program with a changed file, call once per frame
+    void Update();
+
+private:
+    GLSLShaderWatcher();
+    ~GLSLShaderWatcher();
+
+    void WatchDirectory(const string& directory);
+    void CollectChanges(set<string>& changed);
+
+    static GLSLShaderWatcher* s_pInstance;
+
+    map<string, set<GLSLShader*> > _shadersByFile;
+    map<GLSLShader*, vector<string> > _filesByShader;
+
+#ifdef __linux__
+    int _inotify;
+    map<int, string> _directories;	//watch descriptor -> directory prefix
+    set<string> _watchedDirectories;
+#else
+    map<string, long long> _modified;	//last seen modification time per file
+    chrono::steady_clock::time_point _lastPoll;
+#endif
+};
+
+#endif
@@ -0,0 +1,179 @@
+#include "GridMesh.h"
+#include "TaskPool.h"
+
+//SSE2 is part of every x64 target and of x86 builds with /arch:SSE2 or later
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GRID_MESH_SSE
+#include <emmintrin.h>
+#endif
+
+const GLuint GridMesh::RESTART_INDEX;
+const int GridMesh::BAND_WIDTH;
+
+//vertices filled by one task at least
+const int MIN_TASK_VERTICES = 16384;
+
+//the two triangles of quad (i, j), diagonals alternate like a checkerboard
+static GLuint* EmitQuad(GLuint* id, int i, int j, int width) {
+	int row = width+1;
+	int i0 = i * row + j;
+	int i1 = i0 + 1;
+	int i2 = i0 + row;
+	int i3 = i2 + 1;
+	if ((j+i)%2) {
+		*id++ = i0; *id++ = i2; *id++ = i1;
+		*id++ = i1; *id++ = i2; *id++ = i3;
+	} else {
+		*id++ = i0; *id++ = i2; *id++ = i3;
+		*id++ = i0; *id++ = i3; *id++ = i1;
+	}
+	return id;
+}
+
+//quads jBegin to jEnd of row i. Two neighbouring quads always have both
+//diagonals, so a pair is a fixed pattern of 12 offsets from its first vertex.
+static GLuint* EmitQuadRun(GLuint* id, int i, int jBegin, int jEnd, int width) {
+	int j = jBegin;
+#ifdef GRID_MESH_SSE
+	int row = width+1;
+	__m128i pattern[3];
+	if ((jBegin+i)%2) {
+		pattern[0] = _mm_setr_epi32(0, row, 1, 1);
+		pattern[1] = _mm_setr_epi32(row, row+1, 1, row+1);
+		pattern[2] = _mm_setr_epi32(row+2, 1, row+2, 2);
+	} else {
+		pattern[0] = _mm_setr_epi32(0, row, row+1, 0);
+		pattern[1] = _mm_setr_epi32(row+1, 1, 1, row+1);
+		pattern[2] = _mm_setr_epi32(2, 2, row+1, row+2);
+	}
+	__m128i base = _mm_set1_epi32(i * row + j);
+	__m128i step = _mm_set1_epi32(2);
+	for (; j + 2 <= jEnd; j += 2) {
+		_mm_storeu_si128((__m128i*)id, _mm_add_epi32(base, pattern[0]));
+		_mm_storeu_si128((__m128i*)(id + 4), _mm_add_epi32(base, pattern[1]));
+		_mm_storeu_si128((__m128i*)(id + 8), _mm_add_epi32(base, pattern[2]));
+		base = _mm_add_epi32(base, step);
+		id += 12;
+	}
+#endif
+	for (; j < jEnd; j++) {
+		id = EmitQuad(id, i, j, width);
+	}
+	return id;
+}
+
+int GridMesh::GetVertexCount(int width, int depth) {
+	return (width+1)*(depth+1);
+}
+
+int GridMesh::GetIndexCount(int width, int depth, Layout layout) {
+	if (layout == TRIANGLE_STRIPS) {
+		//two per column of each row and a restart between rows
+		return depth*2*(width+1) + (depth-1);
+	}
+	return width*depth*2*3;
+}
+
+GLenum GridMesh::GetPrimitiveType(Layout layout) {
+	return (layout == TRIANGLE_STRIPS) ? GL_TRIANGLE_STRIP : GL_TRIANGLES;
+}
+
+const char* GridMesh::GetLayoutName(Layout layout) {
+	switch (layout) {
+	case TRIANGLES:       return "triangles";
+	case TRIANGLE_STRIPS: return "strips with restart";
+	default:              return "optimized triangles";
+	}
+}
+
+int GridMesh::GetRowsPerTask(int width) {
+	int rows = MIN_TASK_VERTICES / (width+1);
+	return (rows > 1) ? rows : 1;
+}
+
+void GridMesh::FillVertices(glm::vec3* vertices, int width, int depth, const glm::vec2& origin, const glm::vec2& spacing) {
+	TaskPool::Instance()->ParallelFor(depth+1, GetRowsPerTask(width), [=](int firstRow, int endRow) {
+		for (int j = firstRow; j < endRow; j++) {
+			glm::vec3* v = vertices + j * (width+1);
+			float z = origin.y + j * spacing.y;
+			int i = 0;
+#ifdef GRID_MESH_SSE
+			//four vertices are three registers: x0 0 z x1 | 0 z x2 0 | z x3 0 z
+			__m128 zeroZ = _mm_setr_ps(0, z, 0, z);
+			__m128 x0 = _mm_set1_ps(origin.x);
+			__m128 dx = _mm_set1_ps(spacing.x);
+			__m128i column = _mm_setr_epi32(0, 1, 2, 3);
+			__m128i four = _mm_set1_epi32(4);
+			float* out = &v[0].x;
+			for (; i + 4 <= width+1; i += 4) {
+				__m128 x = _mm_add_ps(x0, _mm_mul_ps(_mm_cvtepi32_ps(column), dx));
+				__m128 low = _mm_unpacklo_ps(x, zeroZ);		//x0 0 x1 z
+				__m128 high = _mm_unpackhi_ps(x, zeroZ);	//x2 0 x3 z
+				_mm_storeu_ps(out, _mm_shuffle_ps(low, low, _MM_SHUFFLE(2, 3, 1, 0)));
+				_mm_storeu_ps(out + 4, _mm_shuffle_ps(zeroZ, high, _MM_SHUFFLE(1, 0, 1, 0)));
+				_mm_storeu_ps(out + 8, _mm_shuffle_ps(high, high, _MM_SHUFFLE(3, 1, 2, 3)));
+				column = _mm_add_epi32(column, four);
+				out += 12;
+			}
+#endif
+			for (; i <= width; i++) {
+				v[i] = glm::vec3(origin.x + i * spacing.x, 0, z);
+			}
+		}
+	});
+}
+
+void GridMesh::FillIndices(GLuint* indices, int width, int depth, Layout layout) {
+	TaskPool::Instance()->ParallelFor(depth, GetRowsPerTask(width), [=](int firstRow, int endRow) {
+		FillIndexRows(indices, width, depth, layout, firstRow, endRow);
+	});
+}
+
+//each layout puts row i at a fixed position, so rows can be filled in any
+//order
+void GridMesh::FillIndexRows(GLuint* indices, int width, int depth, Layout layout, int firstRow, int endRow) {
+	int row = width+1;
+	switch (layout) {
+	case TRIANGLES:
+		for (int i = firstRow; i < endRow; i++) {
+			EmitQuadRun(indices + i * width * 6, i, 0, width, width);
+		}
+		break;
+
+	case TRIANGLE_STRIPS:
+		//(i0, i2, i1) then (i1, i2, i3) with the strip's alternating winding,
+		//the same facing as the lists but with all diagonals one way
+		for (int i = firstRow; i < endRow; i++) {
+			GLuint* id = indices + i * (2*row + 1);
+			if (i > 0) {
+				id[-1] = RESTART_INDEX;
+			}
+			int j = 0;
+#ifdef GRID_MESH_SSE
+			__m128i base = _mm_add_epi32(_mm_set1_epi32(i * row), _mm_setr_epi32(0, row, 1, row+1));
+			__m128i step = _mm_set1_epi32(2);
+			for (; j + 2 <= row; j += 2) {
+				_mm_storeu_si128((__m128i*)id, base);
+				base = _mm_add_epi32(base, step);
+				id += 4;
+			}
+#endif
+			for (; j < row; j++) {
+				*id++ = i * row + j;
+				*id++ = (i+1) * row + j;
+			}
+		}
+		break;
+
+	case OPTIMIZED_TRIANGLES:
+		for (int band = 0; band < width; band += BAND_WIDTH) {
+			int bandEnd = (band + BAND_WIDTH < width) ? band + BAND_WIDTH : width;
+			//every band before this one is full width
+			GLuint* bandIndices = indices + band * depth * 6;
+			for (int i = firstRow; i < endRow; i++) {
+				EmitQuadRun(bandIndices + i * (bandEnd - band) * 6, i, band, bandEnd, width);
+			}
+		}
+		break;
+	}
+}
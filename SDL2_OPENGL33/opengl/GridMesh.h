@@ -0,0 +1,54 @@
+#ifndef GRID_MESH_H
+#define GRID_MESH_H
+
+#include <GL/glew.h>
+#include <glm.hpp>
+
+//Vertex and index buffers for regular grids of width x depth quads over (width+1) x
+//(depth+1) vertices stored row after row, the layout every water mesh uses.
+//The same quads can be emitted in three layouts:
+//TRIANGLES			6 indices per quad in row order, alternating diagonals
+//TRIANGLE_STRIPS		one strip per row of quads, rows separated by
+//				RESTART_INDEX, about 2 indices per quad
+//OPTIMIZED_TRIANGLES		the triangles of TRIANGLES reordered in bands a
+//				few quads wide, so the row above is still in the
+//				post-transform cache when the next row is drawn
+//Rows are filled in parallel on the TaskPool with SSE2 inner loops, neither
+//function makes GL calls.
+class GridMesh
+{
+public:
+	enum Layout {
+		TRIANGLES,
+		TRIANGLE_STRIPS,
+		OPTIMIZED_TRIANGLES
+	};
+
+	//written between the strips, RenderableObject maps it to the largest
+	//index of the type it uploads
+	static const GLuint RESTART_INDEX = 0xFFFFFFFF;
+
+	//quads per band of OPTIMIZED_TRIANGLES, two rows of band vertices fit a
+	//16 entry FIFO cache
+	static const int BAND_WIDTH = 7;
+
+	static int GetVertexCount(int width, int depth);
+	static int GetIndexCount(int width, int depth, Layout layout);
+	static GLenum GetPrimitiveType(Layout layout);
+	static bool UsesPrimitiveRestart(Layout layout) { return layout == TRIANGLE_STRIPS; }
+	static const char* GetLayoutName(Layout layout);
+
+	//GetVertexCount(width, depth) vertices, vertex (i, j) is at
+	//(origin.x + i*spacing.x, 0, origin.y + j*spacing.y)
+	static void FillVertices(glm::vec3* vertices, int width, int depth, const glm::vec2& origin, const glm::vec2& spacing);
+
+	//GetIndexCount(width, depth, layout) indices
+	static void FillIndices(GLuint* indices, int width, int depth, Layout layout);
+
+private:
+	static void FillIndexRows(GLuint* indices, int width, int depth, Layout layout, int firstRow, int endRow);
+	//rows per parallel task, enough work to be worth a thread
+	static int GetRowsPerTask(int width);
+};
+
+#endif
@@ -0,0 +1,148 @@
+#include "ImageOps.h"
+#include <math.h>
+#include <string.h>
+
+//SSE2 is part of every x64 target and of x86 builds with /arch:SSE2 or later
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define IMAGE_OPS_SSE
+#include <emmintrin.h>
+#endif
+
+void ImageOps::FlipRows(unsigned char* pixels, int rowBytes, int rows) {
+	for (int y = 0; y * 2 < rows - 1; y++) {
+		unsigned char* top = pixels + y * rowBytes;
+		unsigned char* bottom = pixels + (rows - 1 - y) * rowBytes;
+		int i = 0;
+#ifdef IMAGE_OPS_SSE
+		for (; i + 16 <= rowBytes; i += 16) {
+			__m128i a = _mm_loadu_si128((const __m128i*)(top + i));
+			__m128i b = _mm_loadu_si128((const __m128i*)(bottom + i));
+			_mm_storeu_si128((__m128i*)(top + i), b);
+			_mm_storeu_si128((__m128i*)(bottom + i), a);
+		}
+#endif
+		for (; i < rowBytes; i++) {
+			unsigned char swap = top[i];
+			top[i] = bottom[i];
+			bottom[i] = swap;
+		}
+	}
+}
+
+void ImageOps::ExpandToRGBA(const unsigned char* source, int channels, unsigned char* rgba, int count) {
+	int i = 0;
+	switch (channels) {
+	case 4:
+		memcpy(rgba, source, count * 4);
+		return;
+
+	case 3:
+#ifdef IMAGE_OPS_SSE
+		{
+			//texel k of four moves up by k bytes, one shift each, and the
+			//holes are filled with alpha
+			__m128i mask0 = _mm_setr_epi32(0x00ffffff, 0, 0, 0);
+			__m128i mask1 = _mm_setr_epi32(0, 0x00ffffff, 0, 0);
+			__m128i mask2 = _mm_setr_epi32(0, 0, 0x00ffffff, 0);
+			__m128i mask3 = _mm_setr_epi32(0, 0, 0, 0x00ffffff);
+			__m128i alpha = _mm_set1_epi32(0xff000000);
+			//16 byte loads of 12 byte groups, the last group stays off the end
+			for (; (i + 4) * 3 + 4 <= count * 3; i += 4) {
+				__m128i rgb = _mm_loadu_si128((const __m128i*)(source + i * 3));
+				__m128i out = _mm_or_si128(_mm_and_si128(rgb, mask0), alpha);
+				out = _mm_or_si128(out, _mm_and_si128(_mm_slli_si128(rgb, 1), mask1));
+				out = _mm_or_si128(out, _mm_and_si128(_mm_slli_si128(rgb, 2), mask2));
+				out = _mm_or_si128(out, _mm_and_si128(_mm_slli_si128(rgb, 3), mask3));
+				_mm_storeu_si128((__m128i*)(rgba + i * 4), out);
+			}
+		}
+#endif
+		for (; i < count; i++) {
+			rgba[i * 4] = source[i * 3];
+			rgba[i * 4 + 1] = source[i * 3 + 1];
+			rgba[i * 4 + 2] = source[i * 3 + 2];
+			rgba[i * 4 + 3] = 255;
+		}
+		return;
+
+	case 2:
+		for (; i < count; i++) {
+			rgba[i * 4] = rgba[i * 4 + 1] = rgba[i * 4 + 2] = source[i * 2];
+			rgba[i * 4 + 3] = source[i * 2 + 1];
+		}
+		return;
+
+	default:
+		for (; i < count; i++) {
+			rgba[i * 4] = rgba[i * 4 + 1] = rgba[i * 4 + 2] = source[i];
+			rgba[i * 4 + 3] = 255;
+		}
+		return;
+	}
+}
+
+void ImageOps::CopyRowsToRGBA(const unsigned char* source, int channels, int width, int rows, unsigned char* rgba, bool flip) {
+	for (int y = 0; y < rows; y++) {
+		int sourceRow = flip ? rows - 1 - y : y;
+		ExpandToRGBA(source + sourceRow * width * channels, channels, rgba + y * width * 4, width);
+	}
+}
+
+//sRGB to linear for every 8 bit value, a lookup beats anything SSE2 can
+//compute without a gather
+struct SRGBTable {
+	unsigned char linear[256];
+
+	SRGBTable() {
+		for (int i = 0; i < 256; i++) {
+			float c = i / 255.0f;
+			float value = (c <= 0.04045f) ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+			linear[i] = static_cast<unsigned char>(value * 255.0f + 0.5f);
+		}
+	}
+};
+
+void ImageOps::SRGBToLinear(unsigned char* rgba, int count) {
+	static const SRGBTable table;
+	for (int i = 0; i < count; i++) {
+		rgba[i * 4] = table.linear[rgba[i * 4]];
+		rgba[i * 4 + 1] = table.linear[rgba[i * 4 + 1]];
+		rgba[i * 4 + 2] = table.linear[rgba[i * 4 + 2]];
+	}
+}
+
+//x / 255 rounded, exact for x up to 255 * 255
+static inline unsigned int Divide255(unsigned int x) {
+	x += 128;
+	return (x + (x >> 8)) >> 8;
+}
+
+void ImageOps::PremultiplyAlpha(unsigned char* rgba, int count) {
+	int i = 0;
+#ifdef IMAGE_OPS_SSE
+	//two texels per register at 16 bits a channel, alpha is multiplied by
+	//255 so the same division leaves it as it was
+	__m128i zero = _mm_setzero_si128();
+	__m128i alphaLanes = _mm_setr_epi16(0, 0, 0, -1, 0, 0, 0, -1);
+	__m128i alpha255 = _mm_setr_epi16(0, 0, 0, 255, 0, 0, 0, 255);
+	__m128i half = _mm_set1_epi16(128);
+	for (; i + 4 <= count; i += 4) {
+		__m128i texels = _mm_loadu_si128((const __m128i*)(rgba + i * 4));
+		__m128i result[2];
+		for (int k = 0; k < 2; k++) {
+			__m128i wide = k ? _mm_unpackhi_epi8(texels, zero) : _mm_unpacklo_epi8(texels, zero);
+			__m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(wide, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+			alpha = _mm_or_si128(_mm_andnot_si128(alphaLanes, alpha), alpha255);
+			__m128i product = _mm_add_epi16(_mm_mullo_epi16(wide, alpha), half);
+			result[k] = _mm_srli_epi16(_mm_add_epi16(product, _mm_srli_epi16(product, 8)), 8);
+		}
+		_mm_storeu_si128((__m128i*)(rgba + i * 4), _mm_packus_epi16(result[0], result[1]));
+	}
+#endif
+	for (; i < count; i++) {
+		unsigned int alpha = rgba[i * 4 + 3];
+		rgba[i * 4] = static_cast<unsigned char>(Divide255(rgba[i * 4] * alpha));
+		rgba[i * 4 + 1] = static_cast<unsigned char>(Divide255(rgba[i * 4 + 1] * alpha));
+		rgba[i * 4 + 2] = static_cast<unsigned char>(Divide255(rgba[i * 4 + 2] * alpha));
+	}
+}
@@ -0,0 +1,35 @@
+#ifndef IMAGE_OPS_H
+#define IMAGE_OPS_H
+
+//Kernels for the pixels between the image decoder and GL, all on 8 bit
+//channels and without GL calls. Flips, channel expansion and premultiply run
+//16 bytes at a time with SSE2 where the target has it.
+//
+//GL cannot unpack rows bottom up, so instead of a separate flip pass the flip
+//is fused into the copy into a mapped pixel unpack buffer that an upload
+//through one needs anyway: CopyRowsToRGBA writes the rows in either order and
+//expands them to RGBA on the way, the layout drivers upload fastest.
+class ImageOps
+{
+public:
+	//reverses the order of rows rows of rowBytes each, in place
+	static void FlipRows(unsigned char* pixels, int rowBytes, int rows);
+
+	//count texels of 1 to 4 channels as RGBA. Grey is copied to red, green
+	//and blue, a missing alpha is opaque.
+	static void ExpandToRGBA(const unsigned char* source, int channels, unsigned char* rgba, int count);
+
+	//rows x width texels of source to RGBA rows at rgba, the last source row
+	//first if flip
+	static void CopyRowsToRGBA(const unsigned char* source, int channels, int width, int rows, unsigned char* rgba, bool flip);
+
+	//red, green and blue of count RGBA texels from sRGB to linear through a
+	//table, alpha stays. 8 bits lose precision in the darks, GL_SRGB8_ALPHA8
+	//textures decode in the sampler at full precision.
+	static void SRGBToLinear(unsigned char* rgba, int count);
+
+	//red, green and blue of count RGBA texels multiplied by alpha, rounded
+	static void PremultiplyAlpha(unsigned char* rgba, int count);
+};
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef LOCK_FREE_QUEUE_H
+#define LOCK_FREE_QUEUE_H
+
+#include <atomic>
+#include <stddef.h>
+
+//Bounded multi-producer multi-consumer queue without locks (Dmitry Vyukov's
+//ring of sequenced cells). Every cell carries a sequence number telling
+//whether it is free for the producer of a given position or filled for its
+//consumer, so a push or pop is one compare-and-swap on the shared position
+//and never blocks. TryPush fails when the queue is full, TryPop when it is
+//empty. T must be copyable.
+template <typename T>
+class LockFreeQueue
+{
+public:
+	//capacity is rounded up to a power of two
+	explicit LockFreeQueue(size_t capacity)
+	{
+		size_t size = 2;
+		while (size < capacity) {
+			size *= 2;
+		}
+		mask = size - 1;
+		cells = new Cell[size];
+		for (size_t i = 0; i < size; i++) {
+			cells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+		pushPosition.store(0, std::memory_order_relaxed);
+		popPosition.store(0, std::memory_order_relaxed);
+	}
+
+	~LockFreeQueue()
+	{
+		delete[] cells;
+	}
+
+	bool TryPush(const T& value)
+	{
+		size_t position = pushPosition.load(std::memory_order_relaxed);
+		for (;;) {
+			Cell& cell = cells[position & mask];
+			size_t sequence = cell.sequence.load(std::memory_order_acquire);
+			ptrdiff_t difference = (ptrdiff_t)sequence - (ptrdiff_t)position;
+			if (difference == 0) {
+				if (pushPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+					cell.value = value;
+					cell.sequence.store(position + 1, std::memory_order_release);
+					return true;
+				}
+			} else if (difference < 0) {
+				//the consumer of the previous lap has not emptied it yet
+				return false;
+			} else {
+				position = pushPosition.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	bool TryPop(T& value)
+	{
+		size_t position = popPosition.load(std::memory_order_relaxed);
+		for (;;) {
+			Cell& cell = cells[position & mask];
+			size_t sequence = cell.sequence.load(std::memory_order_acquire);
+			ptrdiff_t difference = (ptrdiff_t)sequence - (ptrdiff_t)(position + 1);
+			if (difference == 0) {
+				if (popPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+					value = cell.value;
+					//free for the producer one lap ahead
+					cell.sequence.store(position + mask + 1, std::memory_order_release);
+					return true;
+				}
+			} else if (difference < 0) {
+				return false;
+			} else {
+				position = popPosition.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+private:
+	struct Cell {
+		std::atomic<size_t> sequence;
+		T value;
+	};
+
+	//positions on their own cache lines, producers and consumers do not
+	//invalidate each other's
+	char padding0[64];
+	Cell* cells;
+	size_t mask;
+	char padding1[64];
+	std::atomic<size_t> pushPosition;
+	char padding2[64];
+	std::atomic<size_t> popPosition;
+	char padding3[64];
+
+	LockFreeQueue(const LockFreeQueue&);
+	LockFreeQueue& operator=(const LockFreeQueue&);
+};
+
+#endif
@@ -0,0 +1,202 @@
+#include "MeshOptimizer.h"
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+using namespace std;
+
+const int MeshOptimizer::CACHE_SIZE;
+
+//scoring constants from Forsyth's paper
+const float CACHE_DECAY_POWER = 1.5f;
+const float LAST_TRIANGLE_SCORE = 0.75f;
+const float VALENCE_BOOST_SCALE = 2.0f;
+const float VALENCE_BOOST_POWER = 0.5f;
+//valences above this share the last table entry
+const int MAX_VALENCE = 32;
+
+namespace {
+	struct ScoreTables {
+		float cache[MeshOptimizer::CACHE_SIZE];
+		float valence[MAX_VALENCE + 1];
+
+		ScoreTables() {
+			for (int i = 0; i < MeshOptimizer::CACHE_SIZE; i++) {
+				if (i < 3) {
+					//the triangle just drawn, no bonus for using it again
+					cache[i] = LAST_TRIANGLE_SCORE;
+				} else {
+					float scale = 1.0f / (MeshOptimizer::CACHE_SIZE - 3);
+					cache[i] = pow(1.0f - (i - 3) * scale, CACHE_DECAY_POWER);
+				}
+			}
+			valence[0] = 0;
+			for (int i = 1; i <= MAX_VALENCE; i++) {
+				//vertices with few triangles left are finished off first
+				valence[i] = VALENCE_BOOST_SCALE * pow(float(i), -VALENCE_BOOST_POWER);
+			}
+		}
+
+		float Score(int cachePosition, int remaining) const {
+			if (remaining == 0) {
+				return -1.0f;
+			}
+			float score = valence[remaining < MAX_VALENCE ? remaining : MAX_VALENCE];
+			if (cachePosition >= 0) {
+				score += cache[cachePosition];
+			}
+			return score;
+		}
+	};
+}
+
+void MeshOptimizer::OptimizeVertexCache(GLuint* indices, int indexCount, int vertexCount) {
+	static const ScoreTables tables;
+	int triangleCount = indexCount / 3;
+	if (triangleCount == 0) {
+		return;
+	}
+
+	//triangles of every vertex, the first remaining[v] entries are the ones
+	//not emitted yet
+	vector<int> remaining(vertexCount, 0);
+	for (int i = 0; i < indexCount; i++) {
+		remaining[indices[i]]++;
+	}
+	vector<int> firstTriangle(vertexCount + 1, 0);
+	for (int v = 0; v < vertexCount; v++) {
+		firstTriangle[v + 1] = firstTriangle[v] + remaining[v];
+	}
+	vector<int> adjacency(indexCount);
+	vector<int> fill(firstTriangle.begin(), firstTriangle.end() - 1);
+	for (int i = 0; i < indexCount; i++) {
+		adjacency[fill[indices[i]]++] = i / 3;
+	}
+
+	vector<int> cachePosition(vertexCount, -1);
+	vector<float> vertexScore(vertexCount);
+	for (int v = 0; v < vertexCount; v++) {
+		vertexScore[v] = tables.Score(-1, remaining[v]);
+	}
+	vector<bool> emitted(triangleCount, false);
+
+	vector<GLuint> output(indexCount);
+	//three spare slots for the vertices of the new triangle
+	int cache[CACHE_SIZE + 3];
+	int cacheCount = 0;
+	int newCache[CACHE_SIZE + 3];
+	//dead ends restart from the first triangle not drawn yet in input order
+	int nextInput = 0;
+	int best = 0;
+
+	for (int out = 0; out < triangleCount; out++) {
+		if (best < 0) {
+			while (emitted[nextInput]) {
+				nextInput++;
+			}
+			best = nextInput;
+		}
+		emitted[best] = true;
+		const GLuint* tri = indices + best * 3;
+		memcpy(&output[out * 3], tri, 3 * sizeof(GLuint));
+
+		//drop the triangle from its vertices' lists and move them to the
+		//front of the cache
+		int newCount = 0;
+		for (int k = 0; k < 3; k++) {
+			int v = tri[k];
+			int* list = &adjacency[firstTriangle[v]];
+			for (int j = 0; j < remaining[v]; j++) {
+				if (list[j] == best) {
+					list[j] = list[remaining[v] - 1];
+					break;
+				}
+			}
+			remaining[v]--;
+			//degenerate triangles name a vertex twice
+			bool listed = false;
+			for (int j = 0; j < newCount; j++) {
+				listed = listed || (newCache[j] == v);
+			}
+			if (!listed) {
+				newCache[newCount++] = v;
+			}
+		}
+		for (int i = 0; i < cacheCount; i++) {
+			int v = cache[i];
+			if (v != (int)tri[0] && v != (int)tri[1] && v != (int)tri[2]) {
+				newCache[newCount++] = v;
+			}
+		}
+
+		//rescore everything in the cache and the vertices just pushed out,
+		//the next triangle is the best one touching them
+		best = -1;
+		float bestScore = -1.0f;
+		for (int i = 0; i < newCount; i++) {
+			int v = newCache[i];
+			cachePosition[v] = (i < CACHE_SIZE) ? i : -1;
+			vertexScore[v] = tables.Score(cachePosition[v], remaining[v]);
+		}
+		for (int i = 0; i < newCount; i++) {
+			int v = newCache[i];
+			const int* list = &adjacency[firstTriangle[v]];
+			for (int j = 0; j < remaining[v]; j++) {
+				int t = list[j];
+				const GLuint* other = indices + t * 3;
+				float score = vertexScore[other[0]] + vertexScore[other[1]] + vertexScore[other[2]];
+				if (score > bestScore) {
+					bestScore = score;
+					best = t;
+				}
+			}
+		}
+
+		cacheCount = (newCount < CACHE_SIZE) ? newCount : CACHE_SIZE;
+		memcpy(cache, newCache, cacheCount * sizeof(int));
+	}
+
+	memcpy(indices, &output[0], indexCount * sizeof(GLuint));
+}
+
+void MeshOptimizer::OptimizeVertexFetch(GLuint* indices, int indexCount, void* vertices, int vertexCount, int vertexSize) {
+	vector<int> remap(vertexCount, -1);
+	int next = 0;
+	for (int i = 0; i < indexCount; i++) {
+		int& target = remap[indices[i]];
+		if (target < 0) {
+			target = next++;
+		}
+		indices[i] = target;
+	}
+	for (int v = 0; v < vertexCount; v++) {
+		if (remap[v] < 0) {
+			remap[v] = next++;
+		}
+	}
+
+	vector<char> ordered(vertexCount * vertexSize);
+	const char* source = static_cast<const char*>(vertices);
+	for (int v = 0; v < vertexCount; v++) {
+		memcpy(&ordered[remap[v] * vertexSize], source + v * vertexSize, vertexSize);
+	}
+	memcpy(vertices, &ordered[0], ordered.size());
+}
+
+float MeshOptimizer::ComputeACMR(const GLuint* indices, int indexCount, int vertexCount, int cacheSize) {
+	if (indexCount < 3) {
+		return 0;
+	}
+	//a vertex is cached while fewer than cacheSize misses happened since it
+	//was last loaded
+	vector<int> loadedAt(vertexCount, -cacheSize - 1);
+	int misses = 0;
+	for (int i = 0; i < indexCount; i++) {
+		int v = indices[i];
+		if (misses - loadedAt[v] > cacheSize) {
+			loadedAt[v] = misses;
+			misses++;
+		}
+	}
+	return float(misses) / (indexCount / 3);
+}
@@ -0,0 +1,29 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <GL/glew.h>
+
+//Reordering of indexed triangle lists for the GPU's vertex caches.
+//OptimizeVertexCache reorders the triangles so recently transformed vertices
+//are reused (Tom Forsyth's linear-speed algorithm), OptimizeVertexFetch then
+//renumbers the vertices in the order they are first used so fetches walk the
+//vertex buffer front to back. Neither changes what is drawn.
+class MeshOptimizer
+{
+public:
+	//cache size the post-transform cache is simulated with
+	static const int CACHE_SIZE = 32;
+
+	static void OptimizeVertexCache(GLuint* indices, int indexCount, int vertexCount);
+
+	//vertices is vertexCount elements of vertexSize bytes, reordered in place
+	//together with the indices. Unreferenced vertices move to the end.
+	static void OptimizeVertexFetch(GLuint* indices, int indexCount, void* vertices, int vertexCount, int vertexSize);
+
+	//average cache miss ratio, transformed vertices per triangle with a FIFO
+	//cache of cacheSize entries. 0.5 is the limit for large regular grids,
+	//3 means no reuse at all.
+	static float ComputeACMR(const GLuint* indices, int indexCount, int vertexCount, int cacheSize = 16);
+};
+
+#endif
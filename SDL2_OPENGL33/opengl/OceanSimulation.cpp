@@ -0,0 +1,446 @@
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <random>
+#include <algorithm>
+
+#include "OceanSimulation.h"
+
+//SSE2 is part of every x64 target and of x86 builds with /arch:SSE2 or later
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OCEAN_FFT_SSE
+#include <emmintrin.h>
+#endif
+
+const float GRAVITY = 9.81f;
+//columns transformed together, four SSE registers per row and plane
+const int STRIP = 16;
+
+#ifdef OCEAN_FFT_SSE
+//sine and cosine of four angles: reduce to [-pi/4, pi/4] around the nearest
+//multiple of pi/2, evaluate both polynomials and fix up by quadrant
+static inline void SinCos(__m128 x, __m128* s, __m128* c) {
+	__m128i q = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(float(2.0 / M_PI))));
+	__m128 qf = _mm_cvtepi32_ps(q);
+	//pi/2 in two parts keeps the reduction exact for larger angles
+	__m128 r = _mm_sub_ps(x, _mm_mul_ps(qf, _mm_set1_ps(1.5703125f)));
+	r = _mm_sub_ps(r, _mm_mul_ps(qf, _mm_set1_ps(4.8382679e-4f)));
+	__m128 r2 = _mm_mul_ps(r, r);
+
+	__m128 sinR = _mm_add_ps(_mm_set1_ps(-1.0f / 5040.0f), _mm_mul_ps(r2, _mm_set1_ps(1.0f / 362880.0f)));
+	sinR = _mm_add_ps(_mm_set1_ps(1.0f / 120.0f), _mm_mul_ps(r2, sinR));
+	sinR = _mm_add_ps(_mm_set1_ps(-1.0f / 6.0f), _mm_mul_ps(r2, sinR));
+	sinR = _mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(r, r2), sinR));
+
+	__m128 cosR = _mm_add_ps(_mm_set1_ps(-1.0f / 720.0f), _mm_mul_ps(r2, _mm_set1_ps(1.0f / 40320.0f)));
+	cosR = _mm_add_ps(_mm_set1_ps(1.0f / 24.0f), _mm_mul_ps(r2, cosR));
+	cosR = _mm_add_ps(_mm_set1_ps(-0.5f), _mm_mul_ps(r2, cosR));
+	cosR = _mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(r2, cosR));
+
+	//odd quadrants swap sine and cosine
+	__m128i one = _mm_set1_epi32(1);
+	__m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, one), one));
+	__m128 sinQ = _mm_or_ps(_mm_and_ps(swap, cosR), _mm_andnot_ps(swap, sinR));
+	__m128 cosQ = _mm_or_ps(_mm_and_ps(swap, sinR), _mm_andnot_ps(swap, cosR));
+	//bit 1 of the quadrant moved to the sign bit
+	__m128i two = _mm_set1_epi32(2);
+	__m128 sinSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(q, two), 30));
+	__m128 cosSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(q, one), two), 30));
+	*s = _mm_xor_ps(sinQ, sinSign);
+	*c = _mm_xor_ps(cosQ, cosSign);
+}
+
+//b *= w, then (a, b) = (a + b, a - b) on four complex values
+static inline void Butterfly(float* aRe, float* aIm, float* bRe, float* bIm, __m128 wRe, __m128 wIm) {
+	__m128 ar = _mm_loadu_ps(aRe), ai = _mm_loadu_ps(aIm);
+	__m128 br = _mm_loadu_ps(bRe), bi = _mm_loadu_ps(bIm);
+	__m128 tr = _mm_sub_ps(_mm_mul_ps(br, wRe), _mm_mul_ps(bi, wIm));
+	__m128 ti = _mm_add_ps(_mm_mul_ps(br, wIm), _mm_mul_ps(bi, wRe));
+	_mm_storeu_ps(aRe, _mm_add_ps(ar, tr));
+	_mm_storeu_ps(aIm, _mm_add_ps(ai, ti));
+	_mm_storeu_ps(bRe, _mm_sub_ps(ar, tr));
+	_mm_storeu_ps(bIm, _mm_sub_ps(ai, ti));
+}
+#endif
+
+//the first two stages of a 4 point inverse transform need no multiplications
+static inline void Radix4(float& r0, float& i0, float& r1, float& i1, float& r2, float& i2, float& r3, float& i3) {
+	float sr01 = r0 + r1, si01 = i0 + i1, dr01 = r0 - r1, di01 = i0 - i1;
+	float sr23 = r2 + r3, si23 = i2 + i3, dr23 = r2 - r3, di23 = i2 - i3;
+	r0 = sr01 + sr23; i0 = si01 + si23;
+	r2 = sr01 - sr23; i2 = si01 - si23;
+	//d01 +- i*d23
+	r1 = dr01 - di23; i1 = di01 + dr23;
+	r3 = dr01 + di23; i3 = di01 - dr23;
+}
+
+COceanSimulation::COceanSimulation(int resolution, float size, const glm::vec2& wind, float amplitude, float chop, int threads)
+{
+	N = resolution;
+	logN = 0;
+	while ((1 << logN) < N) {
+		logN++;
+	}
+	tileSize = size;
+	choppiness = chop;
+	time = 0;
+
+	bitReverse.resize(N);
+	for (int i = 0; i < N; i++) {
+		int r = 0;
+		for (int b = 0; b < logN; b++) {
+			r |= ((i >> b) & 1) << (logN - 1 - b);
+		}
+		bitReverse[i] = r;
+	}
+	//inverse transform, so the twiddles turn counterclockwise
+	twiddleRe.resize(N);
+	twiddleIm.resize(N);
+	for (int h = 1; h < N; h *= 2) {
+		for (int j = 0; j < h; j++) {
+			double angle = M_PI * j / h;
+			twiddleRe[h + j] = float(cos(angle));
+			twiddleIm[h + j] = float(sin(angle));
+		}
+	}
+
+	for (int f = 0; f < 3; f++) {
+		fields[f].re.resize(N * N);
+		fields[f].im.resize(N * N);
+	}
+	displacement.resize(N * N * 4);
+	slope.resize(N * N * 2);
+	stripMax.resize(N / STRIP);
+	maxDisplacement = 0;
+	updateCount = 0;
+
+	BuildSpectrum(wind, amplitude);
+
+	if (threads <= 0) {
+		threads = static_cast<int>(thread::hardware_concurrency());
+	}
+	phase = PHASE_ROWS;
+	generation = 0;
+	busyWorkers = 0;
+	itemCount = 0;
+	nextItem = 0;
+	//the calling thread is one of them
+	for (int i = 1; i < threads; i++) {
+		workers.push_back(thread(&COceanSimulation::WorkerMain, this));
+	}
+}
+
+COceanSimulation::~COceanSimulation(void)
+{
+	{
+		lock_guard<mutex> guard(lock);
+		phase = PHASE_QUIT;
+		generation++;
+	}
+	wake.notify_all();
+	for (size_t i = 0; i < workers.size(); i++) {
+		workers[i].join();
+	}
+}
+
+//Phillips spectrum, index n stands for the wave number 2pi(n - N/2)/tileSize
+void COceanSimulation::BuildSpectrum(const glm::vec2& wind, float amplitude) {
+	kx.resize(N);
+	kz.resize(N);
+	for (int n = 0; n < N; n++) {
+		kx[n] = kz[n] = float(2.0 * M_PI * (n - N / 2) / tileSize);
+	}
+
+	float windSpeed = glm::length(wind);
+	glm::vec2 windDir = wind / windSpeed;
+	float L = windSpeed * windSpeed / GRAVITY;
+	//damp waves much shorter than the largest one
+	float l = L * 0.001f;
+	//spacing of the wave numbers, the sum over them approximates an integral
+	float dk = float(2.0 * M_PI / tileSize);
+
+	mt19937 random(1);
+	normal_distribution<float> gauss;
+	h0Re.resize(N * N);
+	h0Im.resize(N * N);
+	omega.resize(N * N);
+	kxOverK.resize(N * N);
+	kzOverK.resize(N * N);
+	for (int z = 0; z < N; z++) {
+		for (int x = 0; x < N; x++) {
+			int i = z * N + x;
+			float k = sqrt(kx[x] * kx[x] + kz[z] * kz[z]);
+			float xi0 = gauss(random);
+			float xi1 = gauss(random);
+			//the first row and column have no -k partner and would leave an
+			//imaginary residue in the real fields
+			if (x == 0 || z == 0 || k < 1e-6f) {
+				h0Re[i] = h0Im[i] = omega[i] = kxOverK[i] = kzOverK[i] = 0;
+				continue;
+			}
+			float kDotW = (kx[x] * windDir.x + kz[z] * windDir.y) / k;
+			float phillips = amplitude * exp(-1.0f / (k * L * k * L)) / (k * k * k * k) * kDotW * kDotW * exp(-k * k * l * l);
+			//waves running against the wind are weak
+			if (kDotW < 0) {
+				phillips *= 0.07f;
+			}
+			float scale = sqrt(phillips * 0.5f) * dk;
+			h0Re[i] = xi0 * scale;
+			h0Im[i] = xi1 * scale;
+			omega[i] = sqrt(GRAVITY * k);
+			kxOverK[i] = kx[x] / k;
+			kzOverK[i] = kz[z] / k;
+		}
+	}
+
+	h0cRe.resize(N * N);
+	h0cIm.resize(N * N);
+	for (int z = 0; z < N; z++) {
+		for (int x = 0; x < N; x++) {
+			int mirror = ((N - z) % N) * N + (N - x) % N;
+			h0cRe[z * N + x] = h0Re[mirror];
+			h0cIm[z * N + x] = -h0Im[mirror];
+		}
+	}
+}
+
+void COceanSimulation::Update(float t) {
+	time = t;
+	RunPhase(PHASE_ROWS, N);
+	RunPhase(PHASE_COLUMNS, N / STRIP);
+	maxDisplacement = *max_element(stripMax.begin(), stripMax.end());
+	updateCount++;
+}
+
+void COceanSimulation::CopyFrame(OceanFrame& frame) const {
+	frame.displacement.assign(displacement.begin(), displacement.end());
+	frame.slope.assign(slope.begin(), slope.end());
+	frame.maxDisplacement = maxDisplacement;
+	frame.updateCount = updateCount;
+}
+
+//h(k,t) = h0(k)e^(iwt) + conj(h0(-k))e^(-iwt) and from it the packed fields
+//	height + i dx	= h (1 + c kx/k)
+//	dz + i dh/dx	= -kx h - i c kz/k h
+//	dh/dz		= i kz h
+//with c the choppiness
+void COceanSimulation::EvolveRow(int z) {
+	int start = z * N;
+	float* re0 = &fields[0].re[start]; float* im0 = &fields[0].im[start];
+	float* re1 = &fields[1].re[start]; float* im1 = &fields[1].im[start];
+	float* re2 = &fields[2].re[start]; float* im2 = &fields[2].im[start];
+	float rowKz = kz[z];
+
+	int x = 0;
+#ifdef OCEAN_FFT_SSE
+	__m128 t4 = _mm_set1_ps(time);
+	__m128 chop = _mm_set1_ps(choppiness);
+	__m128 kz4 = _mm_set1_ps(rowKz);
+	__m128 one = _mm_set1_ps(1.0f);
+	for (; x < N; x += 4) {
+		int i = start + x;
+		__m128 s, c;
+		SinCos(_mm_mul_ps(_mm_loadu_ps(&omega[i]), t4), &s, &c);
+		__m128 ar = _mm_loadu_ps(&h0Re[i]), ai = _mm_loadu_ps(&h0Im[i]);
+		__m128 br = _mm_loadu_ps(&h0cRe[i]), bi = _mm_loadu_ps(&h0cIm[i]);
+		__m128 hr = _mm_add_ps(_mm_mul_ps(_mm_add_ps(ar, br), c), _mm_mul_ps(_mm_sub_ps(bi, ai), s));
+		__m128 hi = _mm_add_ps(_mm_mul_ps(_mm_add_ps(ai, bi), c), _mm_mul_ps(_mm_sub_ps(ar, br), s));
+
+		__m128 kx4 = _mm_loadu_ps(&kx[x]);
+		__m128 cx = _mm_mul_ps(chop, _mm_loadu_ps(&kxOverK[i]));
+		__m128 cz = _mm_mul_ps(chop, _mm_loadu_ps(&kzOverK[i]));
+		__m128 scale = _mm_add_ps(one, cx);
+		_mm_storeu_ps(re0 + x, _mm_mul_ps(hr, scale));
+		_mm_storeu_ps(im0 + x, _mm_mul_ps(hi, scale));
+		_mm_storeu_ps(re1 + x, _mm_sub_ps(_mm_mul_ps(cz, hi), _mm_mul_ps(kx4, hr)));
+		_mm_storeu_ps(im1 + x, _mm_sub_ps(_mm_setzero_ps(), _mm_add_ps(_mm_mul_ps(kx4, hi), _mm_mul_ps(cz, hr))));
+		_mm_storeu_ps(re2 + x, _mm_mul_ps(_mm_sub_ps(_mm_setzero_ps(), kz4), hi));
+		_mm_storeu_ps(im2 + x, _mm_mul_ps(kz4, hr));
+	}
+#endif
+	for (; x < N; x++) {
+		int i = start + x;
+		float s = sin(omega[i] * time);
+		float c = cos(omega[i] * time);
+		float hr = (h0Re[i] + h0cRe[i]) * c + (h0cIm[i] - h0Im[i]) * s;
+		float hi = (h0Im[i] + h0cIm[i]) * c + (h0Re[i] - h0cRe[i]) * s;
+		float cx = choppiness * kxOverK[i];
+		float cz = choppiness * kzOverK[i];
+		re0[x] = hr * (1 + cx);
+		im0[x] = hi * (1 + cx);
+		re1[x] = cz * hi - kx[x] * hr;
+		im1[x] = -(kx[x] * hi + cz * hr);
+		re2[x] = -rowKz * hi;
+		im2[x] = rowKz * hr;
+	}
+}
+
+//in place radix-2 transform of one contiguous row, the first two stages
+//merged into a radix-4 pass
+void COceanSimulation::TransformRow(float* re, float* im) {
+	for (int i = 0; i < N; i++) {
+		int j = bitReverse[i];
+		if (i < j) {
+			swap(re[i], re[j]);
+			swap(im[i], im[j]);
+		}
+	}
+	for (int i = 0; i < N; i += 4) {
+		Radix4(re[i], im[i], re[i+1], im[i+1], re[i+2], im[i+2], re[i+3], im[i+3]);
+	}
+	for (int h = 4; h < N; h *= 2) {
+		const float* wRe = &twiddleRe[h];
+		const float* wIm = &twiddleIm[h];
+		for (int start = 0; start < N; start += 2 * h) {
+			float* aRe = re + start; float* aIm = im + start;
+			float* bRe = aRe + h; float* bIm = aIm + h;
+#ifdef OCEAN_FFT_SSE
+			for (int j = 0; j < h; j += 4) {
+				Butterfly(aRe + j, aIm + j, bRe + j, bIm + j, _mm_loadu_ps(wRe + j), _mm_loadu_ps(wIm + j));
+			}
+#else
+			for (int j = 0; j < h; j++) {
+				float tr = bRe[j] * wRe[j] - bIm[j] * wIm[j];
+				float ti = bRe[j] * wIm[j] + bIm[j] * wRe[j];
+				bRe[j] = aRe[j] - tr; bIm[j] = aIm[j] - ti;
+				aRe[j] += tr; aIm[j] += ti;
+			}
+#endif
+		}
+	}
+}
+
+//the same down STRIP columns at once, every butterfly covers a row of the
+//strip with one twiddle. Rows of the full field are a power of two apart and
+//would all land in the same few cache sets, so the strip is gathered into a
+//contiguous block first, already in bit reversed row order.
+void COceanSimulation::GatherStrip(const Field& field, int column, float* re, float* im) {
+	for (int i = 0; i < N; i++) {
+		int row = bitReverse[i] * STRIP;
+		copy(&field.re[i * N + column], &field.re[i * N + column] + STRIP, re + row);
+		copy(&field.im[i * N + column], &field.im[i * N + column] + STRIP, im + row);
+	}
+}
+
+void COceanSimulation::TransformStrip(float* re, float* im) {
+	for (int i = 0; i < N; i += 4) {
+		float* r = re + i * STRIP;
+		float* m = im + i * STRIP;
+		for (int c = 0; c < STRIP; c++) {
+			Radix4(r[c], m[c], r[STRIP+c], m[STRIP+c], r[2*STRIP+c], m[2*STRIP+c], r[3*STRIP+c], m[3*STRIP+c]);
+		}
+	}
+	for (int h = 4; h < N; h *= 2) {
+		for (int start = 0; start < N; start += 2 * h) {
+			for (int j = 0; j < h; j++) {
+				float* aRe = re + (start + j) * STRIP; float* aIm = im + (start + j) * STRIP;
+				float* bRe = aRe + h * STRIP; float* bIm = aIm + h * STRIP;
+				float wr = twiddleRe[h + j], wi = twiddleIm[h + j];
+#ifdef OCEAN_FFT_SSE
+				__m128 wRe = _mm_set1_ps(wr), wIm = _mm_set1_ps(wi);
+				for (int c = 0; c < STRIP; c += 4) {
+					Butterfly(aRe + c, aIm + c, bRe + c, bIm + c, wRe, wIm);
+				}
+#else
+				for (int c = 0; c < STRIP; c++) {
+					float tr = bRe[c] * wr - bIm[c] * wi;
+					float ti = bRe[c] * wi + bIm[c] * wr;
+					bRe[c] = aRe[c] - tr; bIm[c] = aIm[c] - ti;
+					aRe[c] += tr; aIm[c] += ti;
+				}
+#endif
+			}
+		}
+	}
+}
+
+//strip holds the three transformed fields, re and im planes of N*STRIP each.
+//Spectrum index n is wave number n - N/2, which leaves a factor (-1)^(x+z).
+void COceanSimulation::WriteStrip(int column, const float* strip) {
+	const int plane = N * STRIP;
+	const float* re0 = strip;
+	const float* im0 = strip + plane;
+	const float* re1 = strip + 2 * plane;
+	const float* im1 = strip + 3 * plane;
+	const float* re2 = strip + 4 * plane;
+	float largest = 0;
+	for (int z = 0; z < N; z++) {
+		float* d = &displacement[(z * N + column) * 4];
+		float* s = &slope[(z * N + column) * 2];
+		for (int c = 0; c < STRIP; c++) {
+			int i = z * STRIP + c;
+			float sign = ((column + c + z) & 1) ? -1.0f : 1.0f;
+			d[c * 4] = sign * im0[i];
+			d[c * 4 + 1] = sign * re0[i];
+			d[c * 4 + 2] = sign * re1[i];
+			d[c * 4 + 3] = 0;
+			s[c * 2] = sign * im1[i];
+			s[c * 2 + 1] = sign * re2[i];
+			largest = max(largest, max(fabs(im0[i]), max(fabs(re0[i]), fabs(re1[i]))));
+		}
+	}
+	stripMax[column / STRIP] = largest;
+}
+
+void COceanSimulation::DoWork() {
+	vector<float> strip;
+	if (phase == PHASE_COLUMNS) {
+		strip.resize(6 * N * STRIP);
+	}
+	for (;;) {
+		int item = nextItem++;
+		if (item >= itemCount) {
+			return;
+		}
+		if (phase == PHASE_ROWS) {
+			EvolveRow(item);
+			for (int f = 0; f < 3; f++) {
+				TransformRow(&fields[f].re[item * N], &fields[f].im[item * N]);
+			}
+		} else {
+			for (int f = 0; f < 3; f++) {
+				float* re = &strip[2 * f * N * STRIP];
+				float* im = re + N * STRIP;
+				GatherStrip(fields[f], item * STRIP, re, im);
+				TransformStrip(re, im);
+			}
+			WriteStrip(item * STRIP, &strip[0]);
+		}
+	}
+}
+
+void COceanSimulation::RunPhase(Phase p, int items) {
+	{
+		lock_guard<mutex> guard(lock);
+		phase = p;
+		itemCount = items;
+		nextItem = 0;
+		busyWorkers = static_cast<int>(workers.size());
+		generation++;
+	}
+	wake.notify_all();
+	DoWork();
+	unique_lock<mutex> guard(lock);
+	while (busyWorkers > 0) {
+		done.wait(guard);
+	}
+}
+
+void COceanSimulation::WorkerMain() {
+	int seen = 0;
+	unique_lock<mutex> guard(lock);
+	for (;;) {
+		while (generation == seen) {
+			wake.wait(guard);
+		}
+		seen = generation;
+		if (phase == PHASE_QUIT) {
+			return;
+		}
+		guard.unlock();
+		DoWork();
+		guard.lock();
+		if (--busyWorkers == 0) {
+			done.notify_one();
+		}
+	}
+}
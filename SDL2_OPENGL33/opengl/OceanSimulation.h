@@ -0,0 +1,122 @@
+#ifndef OCEAN_SIMULATION_H
+#define OCEAN_SIMULATION_H
+
+#include <glm.hpp>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+using namespace std;
+
+//the outputs of one update copied out of the simulation, for drawing on
+//another thread while the next update runs
+struct OceanFrame {
+	vector<float> displacement;
+	vector<float> slope;
+	float maxDisplacement;
+	unsigned int updateCount;
+
+	OceanFrame() : maxDisplacement(0), updateCount(0) {}
+};
+
+//Tessendorf ocean on the CPU, no GL calls. A Phillips spectrum is built once,
+//Update() evolves it to the given time and inverse FFTs it into a tileable
+//height field with horizontal displacement and slopes. The five real fields
+//are packed two per complex FFT, so a frame costs three 2D FFTs. Rows are
+//transformed in place, columns are copied out in strips a few SSE registers
+//wide, so the butterflies of neighbouring columns share one twiddle and the
+//column pass works on contiguous memory without a full transpose. Rows and
+//strips are spread over a pool of worker threads.
+class COceanSimulation
+{
+public:
+	//resolution is a power of two, at least 16. tileSize is the world size of
+	//the tile in metres, wind in m/s along xz. amplitude scales the spectrum
+	//per unit of wave number area, so wave heights do not change with the
+	//tile size or resolution. choppiness scales the horizontal displacement.
+	//threads 0 uses every hardware thread.
+	COceanSimulation(int resolution = 256, float tileSize = 256.0f, const glm::vec2& wind = glm::vec2(20, 0),
+		float amplitude = 0.0005f, float choppiness = 1.0f, int threads = 0);
+	~COceanSimulation(void);
+
+	//evolve the spectrum to time t in seconds and fill the outputs
+	void Update(float t);
+
+	int GetResolution() const { return N; }
+	float GetTileSize() const { return tileSize; }
+	int GetThreadCount() const { return static_cast<int>(workers.size()) + 1; }
+
+	//N*N texels, row z then column x. Displacement is (dx, height, dz, 0),
+	//slope is (dh/dx, dh/dz), both ready to upload as RGBA32F and RG32F.
+	const float* GetDisplacement() const { return &displacement[0]; }
+	const float* GetSlope() const { return &slope[0]; }
+	//largest horizontal or vertical displacement of the last update
+	float GetMaxDisplacement() const { return maxDisplacement; }
+	//counts calls to Update, lets renderers skip uploading the same data twice
+	unsigned int GetUpdateCount() const { return updateCount; }
+	//copies the outputs, reusing frame's storage
+	void CopyFrame(OceanFrame& frame) const;
+
+private:
+	//one complex field as separate real and imaginary planes
+	struct Field {
+		vector<float> re, im;
+	};
+
+	enum Phase {
+		PHASE_ROWS,	//evolve the spectrum and transform rows
+		PHASE_COLUMNS,	//transform column strips and write the outputs
+		PHASE_QUIT
+	};
+
+	void BuildSpectrum(const glm::vec2& wind, float amplitude);
+	void EvolveRow(int z);
+	void TransformRow(float* re, float* im);
+	void GatherStrip(const Field& field, int column, float* re, float* im);
+	void TransformStrip(float* re, float* im);
+	void WriteStrip(int column, const float* strip);
+
+	//run phase on all threads, items are handed out one at a time
+	void RunPhase(Phase phase, int items);
+	void DoWork();
+	void WorkerMain();
+
+	int N;
+	int logN;
+	float tileSize;
+	float choppiness;
+	float time;
+
+	//per wave vector, row z then column x
+	vector<float> h0Re, h0Im;	//h0(k)
+	vector<float> h0cRe, h0cIm;	//conj(h0(-k))
+	vector<float> omega;		//dispersion sqrt(g|k|)
+	vector<float> kxOverK, kzOverK;
+	vector<float> kx;		//per column
+	vector<float> kz;		//per row
+
+	vector<int> bitReverse;
+	vector<float> twiddleRe, twiddleIm;	//stage with half size h starts at h
+
+	//height + i dx, dz + i dh/dx, dh/dz
+	Field fields[3];
+
+	vector<float> displacement;
+	vector<float> slope;
+	vector<float> stripMax;		//largest displacement per column strip
+	float maxDisplacement;
+	unsigned int updateCount;
+
+	vector<thread> workers;
+	mutex lock;
+	condition_variable wake, done;
+	Phase phase;
+	int generation;
+	int busyWorkers;
+	int itemCount;
+	atomic<int> nextItem;
+};
+
+#endif
@@ -0,0 +1,160 @@
+#include "RenderQueue.h"
+#include <algorithm>
+#include <string.h>
+#include <gtc/type_ptr.hpp>
+
+RenderQueue::RenderQueue(void)
+{
+	memset(&stats, 0, sizeof(stats));
+}
+
+RenderQueue::~RenderQueue(void)
+{
+}
+
+RenderQueue::SortKey RenderQueue::MakeKey(GLuint program, GLuint vao, float depth) {
+	//positive floats order like their bits, everything behind the eye is 0
+	unsigned int depthBits = 0;
+	if (depth > 0) {
+		memcpy(&depthBits, &depth, sizeof(depthBits));
+	}
+	return (SortKey(program & 0xFFFF) << 48) | (SortKey(vao & 0xFFFF) << 32) | depthBits;
+}
+
+void RenderQueue::Submit(RenderableObject* object, const glm::mat4& MVP) {
+	Item item;
+	item.object = object;
+	item.program = object->shader.GetProgram();
+	item.MVP = MVP;
+
+	//clip space w of the object origin is its view depth
+	order.push_back(make_pair(MakeKey(item.program, object->vaoID, MVP[3][3]), static_cast<unsigned int>(items.size())));
+	items.push_back(item);
+}
+
+void RenderQueue::Clear() {
+	//keep the capacity, the next frame submits about as much
+	items.clear();
+	order.clear();
+}
+
+//write the matrices of every instanced item in sorted order, so each batch is
+//one contiguous range starting at offset in the stream buffer. False if the
+//stream buffer could not take them, a failed map or an overflow.
+bool RenderQueue::UploadInstances(GLintptr& offset) {
+	offset = 0;
+	GLsizeiptr bytes = 0;
+	for (size_t i = 0; i < order.size(); i++) {
+		if (items[order[i].second].object->IsInstanced()) {
+			bytes += sizeof(glm::mat4);
+		}
+	}
+	if (bytes == 0) {
+		return true;
+	}
+
+	//grow with headroom so a slowly rising count does not recreate every frame
+	if (bytes > instanceStream.GetFrameSize()) {
+		instanceStream.Create(bytes * 2);
+	}
+	instanceStream.BeginFrame();
+	StreamBuffer::Allocation allocation = instanceStream.Allocate(bytes, sizeof(glm::vec4));
+	glm::mat4* pBuffer = static_cast<glm::mat4*>(allocation.ptr);
+	if (pBuffer == 0) {
+		instanceStream.Unmap();
+		return false;
+	}
+	for (size_t i = 0; i < order.size(); i++) {
+		const Item& item = items[order[i].second];
+		if (item.object->IsInstanced()) {
+			*pBuffer++ = item.MVP;
+		}
+	}
+	instanceStream.Unmap();
+	offset = allocation.offset;
+	return true;
+}
+
+void RenderQueue::Flush() {
+	memset(&stats, 0, sizeof(stats));
+	stats.submitted = static_cast<int>(items.size());
+	if (items.empty()) {
+		return;
+	}
+
+	sort(order.begin(), order.end());
+	GLintptr instanceOffset = 0;
+	bool instancesUploaded = UploadInstances(instanceOffset);
+
+	GLuint currentProgram = 0;
+	GLuint currentVAO = 0;
+	bool instanced = false;
+
+	size_t i = 0;
+	while (i < order.size()) {
+		RenderableObject* object = items[order[i].second].object;
+
+		//one batch is a run of the same object
+		size_t end = i + 1;
+		while (end < order.size() && items[order[end].second].object == object) {
+			end++;
+		}
+
+		if (items[order[i].second].program != currentProgram) {
+			object->shader.Use();
+			currentProgram = items[order[i].second].program;
+			stats.programBinds++;
+		}
+		if (object->vaoID != currentVAO) {
+			glBindVertexArray(object->vaoID);
+			currentVAO = object->vaoID;
+			stats.vaoBinds++;
+		}
+		object->SetCustomUniforms();
+
+		if (object->IsInstanced() && instancesUploaded) {
+			//GL 3.3 has no base instance, point the attribute at this batch instead
+			glBindBuffer(GL_ARRAY_BUFFER, instanceStream.GetBuffer());
+			for (int c = 0; c < 4; c++) {
+				GLuint location = object->instanceAttribute + c;
+				glEnableVertexAttribArray(location);
+				glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), reinterpret_cast<const GLvoid*>(instanceOffset + c * sizeof(glm::vec4)));
+				glVertexAttribDivisor(location, 1);
+			}
+			GLsizei count = static_cast<GLsizei>(end - i);
+			object->DrawElements(count);
+			stats.drawCalls++;
+			instanceOffset += count * sizeof(glm::mat4);
+			instanced = true;
+
+			//leave the vao usable by RenderableObject::Render
+			for (int c = 0; c < 4; c++) {
+				glDisableVertexAttribArray(object->instanceAttribute + c);
+			}
+		} else {
+			//also instanced objects whose matrices did not make it into the
+			//stream buffer, one draw each with the matrix as a constant
+			//attribute like RenderableObject::Render
+			for (size_t j = i; j < end; j++) {
+				const glm::mat4& MVP = items[order[j].second].MVP;
+				object->shader.SetUniform(object->mvpUniform, MVP);
+				if (object->IsInstanced()) {
+					for (int c = 0; c < 4; c++) {
+						glVertexAttrib4fv(object->instanceAttribute + c, glm::value_ptr(MVP) + c * 4);
+					}
+				}
+				object->DrawElements();
+				stats.drawCalls++;
+			}
+		}
+		i = end;
+	}
+
+	glBindVertexArray(0);
+	glUseProgram(0);
+	if (instanced) {
+		//fence the region behind the draws that read it
+		instanceStream.EndFrame();
+	}
+	Clear();
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include "RenderableObject.h"
+#include "StreamBuffer.h"
+#include <glm.hpp>
+#include <vector>
+
+//Collects draw submissions for a frame and issues them sorted by program,
+//vertex array and depth. Runs of the same object with an instanced shader
+//become one glDrawElementsInstanced, the per instance matrices are streamed
+//through a StreamBuffer. Other objects still get one draw each but share
+//the program and vertex array binds.
+class RenderQueue
+{
+public:
+	//draw work of the last Flush
+	struct Stats {
+		int submitted;
+		int drawCalls;
+		int programBinds;
+		int vaoBinds;
+	};
+
+	RenderQueue(void);
+	~RenderQueue(void);
+
+	//queue one copy of object, depth is taken from the MVP translation so
+	//opaque instances are drawn front to back
+	void Submit(RenderableObject* object, const glm::mat4& MVP);
+
+	//sort and draw everything submitted since the last Flush
+	void Flush();
+	void Clear();
+
+	const Stats& GetStats() const { return stats; }
+	const StreamBuffer& GetInstanceStream() const { return instanceStream; }
+
+private:
+	struct Item {
+		RenderableObject* object;
+		GLuint program;
+		glm::mat4 MVP;
+	};
+
+	//program:16 | vao:16 | depth:32, the low bits of the GL names are enough
+	//to group, batches compare the full values
+	typedef unsigned long long SortKey;
+	static SortKey MakeKey(GLuint program, GLuint vao, float depth);
+
+	bool UploadInstances(GLintptr& offset);
+
+	vector<Item> items;
+	vector<pair<SortKey, unsigned int> > order;
+
+	StreamBuffer instanceStream;
+
+	Stats stats;
+};
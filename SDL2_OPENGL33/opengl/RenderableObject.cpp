@@ -1,9 +1,20 @@
 #include "RenderableObject.h"
+#include "MeshOptimizer.h"
+#include "TaskPool.h"
 #include <glm.hpp>
+#include <gtc/type_ptr.hpp>
+
+//vertices a 16 bit index can reach from one base vertex
+const int MAX_CHUNK_VERTICES = 65536;
+//with primitive restart the largest 16 bit index is taken
+const GLuint SHORT_RESTART_INDEX = 0xFFFF;
+
+const GLuint RenderableObject::RESTART_INDEX;
 
 RenderableObject::RenderableObject(void)
 {
-	
+	vaoID = vboVerticesID = vboIndicesID = 0;
+	generated = false;
 }
 
 
@@ -13,37 +24,257 @@ RenderableObject::~RenderableObject(void)
 }
 
 void RenderableObject::Init() {
-	//setup vao and vbo stuff
-	glGenVertexArrays(1, &vaoID);
-	glGenBuffers(1, &vboVerticesID);
-	glGenBuffers(1, &vboIndicesID);
+	Generate();
+	Upload();
+}
 
+//everything up to the GL buffers, into staging vectors that Upload frees
+void RenderableObject::Generate() {
 	//get total vertices and indices
 	totalVertices = GetTotalVertices();
 	totalIndices  = GetTotalIndices();
 	primType      = GetPrimitiveType();
+	primitiveRestart = UsesPrimitiveRestart();
+
+	//build the mesh on the CPU first, triangle lists are split into chunks
+	//and reordered for the post-transform cache and for fetch order
+	stagingVertices.resize(totalVertices);
+	stagingIndices.resize(totalIndices);
+	FillVertexBuffer(glm::value_ptr(stagingVertices[0]));
+	FillIndexBuffer(&stagingIndices[0]);
+
+	indexChunks.clear();
+	stagingShortIndices.clear();
+	if (primType == GL_TRIANGLES && !primitiveRestart) {
+		BuildTriangleChunks(stagingVertices, stagingIndices, stagingShortIndices, !IsCacheOptimized());
+	} else if (primitiveRestart) {
+		if (!BuildRestartChunks(stagingIndices, stagingShortIndices)) {
+			IndexChunk chunk = {totalIndices, 0, 0};
+			indexChunks.push_back(chunk);
+		}
+	} else if (totalVertices <= MAX_CHUNK_VERTICES) {
+		stagingShortIndices.assign(stagingIndices.begin(), stagingIndices.end());
+		IndexChunk chunk = {totalIndices, 0, 0};
+		indexChunks.push_back(chunk);
+	} else {
+		IndexChunk chunk = {totalIndices, 0, 0};
+		indexChunks.push_back(chunk);
+	}
+	indexType = stagingShortIndices.empty() ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
+	if (indexType == GL_UNSIGNED_SHORT) {
+		std::vector<GLuint>().swap(stagingIndices);
+	}
+	generated = true;
+}
+
+void RenderableObject::Upload() {
+	if (!generated) {
+		Generate();
+	}
+
+	//setup vao and vbo stuff
+	glGenVertexArrays(1, &vaoID);
+	glGenBuffers(1, &vboVerticesID);
+	glGenBuffers(1, &vboIndicesID);
+
+	//resolve the per-frame uniform once instead of looking it up every Render,
+	//instanced shaders may take the matrix as an attribute only
+	mvpUniform    = shader.FindUniform("MVP") ? shader.GetUniform("MVP") : GLSLShader::INVALID_UNIFORM;
+
+	//per instance matrix, its four columns take consecutive locations
+	const GLSLShader::ShaderVariable* instance = shader.FindAttribute("instanceMVP");
+	instanceAttribute = instance ? instance->location : -1;
 
 	//now allocate buffers
 	glBindVertexArray(vaoID);	
 
 		glBindBuffer (GL_ARRAY_BUFFER, vboVerticesID);
-		glBufferData (GL_ARRAY_BUFFER, totalVertices * sizeof(glm::vec3), 0, GL_STATIC_DRAW);
-		 
-		GLfloat* pBuffer = static_cast<GLfloat*>(glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY));
-			FillVertexBuffer(pBuffer);
-		glUnmapBuffer(GL_ARRAY_BUFFER);
+		glBufferData (GL_ARRAY_BUFFER, totalVertices * sizeof(glm::vec3), &stagingVertices[0], GL_STATIC_DRAW);
 
 		glEnableVertexAttribArray(shader["vVertex"]);
 		glVertexAttribPointer(shader["vVertex"], 3, GL_FLOAT, GL_FALSE,0,0);
 		  
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vboIndicesID);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, totalIndices * sizeof(GLuint), 0, GL_STATIC_DRAW);
-		
-		GLuint* pIBuffer = static_cast<GLuint*>(glMapBuffer(GL_ELEMENT_ARRAY_BUFFER, GL_WRITE_ONLY));
-			FillIndexBuffer(pIBuffer);
-		glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER);
+		if (indexType == GL_UNSIGNED_SHORT) {
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, totalIndices * sizeof(GLushort), &stagingShortIndices[0], GL_STATIC_DRAW);
+		} else {
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, totalIndices * sizeof(GLuint), &stagingIndices[0], GL_STATIC_DRAW);
+		}
 
 	glBindVertexArray(0);
+
+	//the GL has its copy
+	std::vector<glm::vec3>().swap(stagingVertices);
+	std::vector<GLuint>().swap(stagingIndices);
+	std::vector<GLushort>().swap(stagingShortIndices);
+	generated = false;
+}
+
+//Triangles are taken in order until a chunk has used 64k distinct vertices.
+//Each chunk gets its own copy of its vertices, so 16 bit indices reach them
+//all from the chunk's base vertex, and is then optimized on its own. Meshes
+//up to 64k vertices stay one chunk, larger ones repeat the vertices on chunk
+//borders. Without optimize the triangle order is kept and only the vertices
+//are renumbered in the order they are used.
+//Finding the chunks is one serial pass that turns indices into chunk local
+//ones in place, the chunks are then copied and optimized on the TaskPool.
+void RenderableObject::BuildTriangleChunks(std::vector<glm::vec3>& vertices, std::vector<GLuint>& indices, std::vector<GLushort>& shortIndices, bool optimize) {
+	std::vector<int> local(vertices.size(), -1);
+	//global vertex of every chunk vertex, chunk after chunk
+	std::vector<GLuint> chunkVertexIds;
+	chunkVertexIds.reserve(vertices.size());
+	int start = 0;
+	while (start + 3 <= totalIndices) {
+		int base = static_cast<int>(chunkVertexIds.size());
+		int end = start;
+		for (; end + 3 <= totalIndices; end += 3) {
+			GLuint* tri = &indices[end];
+			int added = (local[tri[0]] < 0) +
+				(local[tri[1]] < 0 && tri[1] != tri[0]) +
+				(local[tri[2]] < 0 && tri[2] != tri[0] && tri[2] != tri[1]);
+			if (chunkVertexIds.size() - base + added > size_t(MAX_CHUNK_VERTICES)) {
+				break;
+			}
+			for (int k = 0; k < 3; k++) {
+				if (local[tri[k]] < 0) {
+					local[tri[k]] = static_cast<int>(chunkVertexIds.size()) - base;
+					chunkVertexIds.push_back(tri[k]);
+				}
+				tri[k] = local[tri[k]];
+			}
+		}
+		for (size_t i = base; i < chunkVertexIds.size(); i++) {
+			local[chunkVertexIds[i]] = -1;
+		}
+		IndexChunk chunk = {end - start, GLintptr(start * sizeof(GLushort)), base};
+		indexChunks.push_back(chunk);
+		start = end;
+	}
+
+	std::vector<glm::vec3> chunked(chunkVertexIds.size());
+	shortIndices.resize(totalIndices);
+	TaskPool::Instance()->ParallelFor(static_cast<int>(indexChunks.size()), [&](int c) {
+		const IndexChunk& chunk = indexChunks[c];
+		int first = static_cast<int>(chunk.offset / sizeof(GLushort));
+		int vertexCount = ((c + 1 < int(indexChunks.size())) ? indexChunks[c + 1].baseVertex : int(chunked.size())) - chunk.baseVertex;
+		GLuint* chunkIndices = &indices[first];
+		glm::vec3* chunkVertices = &chunked[chunk.baseVertex];
+		for (int i = 0; i < vertexCount; i++) {
+			chunkVertices[i] = vertices[chunkVertexIds[chunk.baseVertex + i]];
+		}
+		if (optimize) {
+			MeshOptimizer::OptimizeVertexCache(chunkIndices, chunk.count, vertexCount);
+		}
+		MeshOptimizer::OptimizeVertexFetch(chunkIndices, chunk.count, chunkVertices, vertexCount, sizeof(glm::vec3));
+		for (int i = 0; i < chunk.count; i++) {
+			shortIndices[first + i] = static_cast<GLushort>(chunkIndices[i]);
+		}
+	});
+
+	vertices.swap(chunked);
+	totalVertices = static_cast<int>(vertices.size());
+}
+
+//Restarted primitives are grouped into chunks whose indices lie within 64k
+//of the chunk's smallest index, which becomes its base vertex. Vertices are
+//not touched, a restart index between two chunks is simply not drawn.
+//Returns false, leaving 32 bit indices, if one primitive spans more.
+bool RenderableObject::BuildRestartChunks(const std::vector<GLuint>& indices, std::vector<GLushort>& shortIndices) {
+	//0xFFFF is the restart index, chunks reach one vertex less
+	const GLuint MAX_RANGE = SHORT_RESTART_INDEX - 1;
+	shortIndices.assign(totalIndices, GLushort(SHORT_RESTART_INDEX));
+
+	int chunkStart = 0;
+	GLuint chunkMin = RESTART_INDEX, chunkMax = 0;
+	int primitiveStart = 0;
+	GLuint primitiveMin = RESTART_INDEX, primitiveMax = 0;
+	for (int i = 0; i <= totalIndices; i++) {
+		if (i < totalIndices && indices[i] != RESTART_INDEX) {
+			primitiveMin = glm::min(primitiveMin, indices[i]);
+			primitiveMax = glm::max(primitiveMax, indices[i]);
+			continue;
+		}
+		if (primitiveStart < i) {
+			if (primitiveMax - primitiveMin > MAX_RANGE) {
+				shortIndices.clear();
+				indexChunks.clear();
+				return false;
+			}
+			GLuint low = glm::min(chunkMin, primitiveMin);
+			GLuint high = glm::max(chunkMax, primitiveMax);
+			if (chunkStart < primitiveStart && high - low > MAX_RANGE) {
+				//close the chunk before this primitive, without the restart index
+				//that ends it
+				IndexChunk chunk = {primitiveStart - 1 - chunkStart, GLintptr(chunkStart * sizeof(GLushort)), GLint(chunkMin)};
+				indexChunks.push_back(chunk);
+				chunkStart = primitiveStart;
+				low = primitiveMin;
+				high = primitiveMax;
+			}
+			chunkMin = low;
+			chunkMax = high;
+		}
+		primitiveStart = i + 1;
+		primitiveMin = RESTART_INDEX;
+		primitiveMax = 0;
+	}
+	if (chunkStart < totalIndices) {
+		IndexChunk chunk = {totalIndices - chunkStart, GLintptr(chunkStart * sizeof(GLushort)), GLint(chunkMin)};
+		indexChunks.push_back(chunk);
+	}
+
+	//rebase every chunk on its smallest index
+	for (size_t c = 0; c < indexChunks.size(); c++) {
+		int first = static_cast<int>(indexChunks[c].offset / sizeof(GLushort));
+		int last = first + indexChunks[c].count;
+		for (int i = first; i < last; i++) {
+			if (indices[i] != RESTART_INDEX) {
+				shortIndices[i] = static_cast<GLushort>(indices[i] - indexChunks[c].baseVertex);
+			}
+		}
+	}
+	return true;
+}
+
+void RenderableObject::DrawElements(int instanceCount) {
+	if (primitiveRestart) {
+		EnablePrimitiveRestart(true);
+	}
+	for (size_t i = 0; i < indexChunks.size(); i++) {
+		const IndexChunk& chunk = indexChunks[i];
+		const GLvoid* offset = reinterpret_cast<const GLvoid*>(chunk.offset);
+		if (instanceCount > 0) {
+			glDrawElementsInstancedBaseVertex(primType, chunk.count, indexType, offset, instanceCount, chunk.baseVertex);
+		} else if (chunk.baseVertex != 0) {
+			glDrawElementsBaseVertex(primType, chunk.count, indexType, offset, chunk.baseVertex);
+		} else {
+			glDrawElements(primType, chunk.count, indexType, offset);
+		}
+	}
+	if (primitiveRestart) {
+		EnablePrimitiveRestart(false);
+	}
+}
+
+//GL 4.3 and ES3 compatible drivers fix the restart index at the largest value
+//of the index type, GL 3.3 sets it explicitly
+void RenderableObject::EnablePrimitiveRestart(bool enable) {
+#ifdef GL_ARB_ES3_compatibility
+	if (GLEW_ARB_ES3_compatibility) {
+		if (enable) {
+			glEnable(GL_PRIMITIVE_RESTART_FIXED_INDEX);
+		} else {
+			glDisable(GL_PRIMITIVE_RESTART_FIXED_INDEX);
+		}
+		return;
+	}
+#endif
+	if (enable) {
+		glEnable(GL_PRIMITIVE_RESTART);
+		glPrimitiveRestartIndex(indexType == GL_UNSIGNED_SHORT ? SHORT_RESTART_INDEX : RESTART_INDEX);
+	} else {
+		glDisable(GL_PRIMITIVE_RESTART);
+	}
 }
 
 void RenderableObject::Destroy() {
@@ -59,10 +290,16 @@ void RenderableObject::Destroy() {
 
 void RenderableObject::Render(const GLfloat* MVP) {
 	shader.Use();				
-		glUniformMatrix4fv(shader("MVP"), 1, GL_FALSE, MVP);
+		shader.SetUniform(mvpUniform, glm::make_mat4(MVP));
+		if (IsInstanced()) {
+			//a single object, feed instanceMVP as a constant attribute
+			for (int i = 0; i < 4; i++) {
+				glVertexAttrib4fv(instanceAttribute + i, MVP + i * 4);
+			}
+		}
 		SetCustomUniforms();
 		glBindVertexArray(vaoID);
-			glDrawElements(primType, totalIndices, GL_UNSIGNED_INT, 0);
+			DrawElements();
 		glBindVertexArray(0);
 	shader.UnUse();
 }
\ No newline at end of file
@@ -1,5 +1,7 @@
 #pragma once
 #include "GLSLShader.h"
+#include <glm.hpp>
+#include <vector>
 
 class RenderableObject
 {
@@ -17,17 +19,75 @@ public:
 	
 	virtual void SetCustomUniforms(){}
 
+	//objects whose index buffer separates primitives with RESTART_INDEX
+	virtual bool UsesPrimitiveRestart() { return false; }
+	//triangle lists already ordered for the vertex cache skip the
+	//optimization in Init
+	virtual bool IsCacheOptimized() { return false; }
+
+	//restart index of FillIndexBuffer, drawn as the largest value of the
+	//uploaded index type
+	static const GLuint RESTART_INDEX = 0xFFFFFFFF;
+
+	//Generate then Upload
 	void Init();
+	//fills and chunks the mesh into staging memory, makes no GL calls so it
+	//can run off the GL thread. FillVertexBuffer and FillIndexBuffer must
+	//not make GL calls either.
+	void Generate();
+	//creates the buffers from the staging memory on the GL thread and frees
+	//it, generates first if that did not happen yet
+	void Upload();
 	void Destroy();
 
+	//objects whose shader has a mat4 "instanceMVP" attribute can be drawn
+	//instanced by RenderQueue
+	bool IsInstanced() const { return instanceAttribute >= 0; }
+
+	//GL_UNSIGNED_SHORT except for other primitives than triangles with more
+	//than 64k vertices, or a single restarted primitive spanning that many
+	GLenum GetIndexType() const { return indexType; }
+	int GetIndexChunkCount() const { return static_cast<int>(indexChunks.size()); }
+
 protected:
+	friend class RenderQueue;
+
+	//a range of the index buffer drawn with its own base vertex, triangle
+	//meshes with more than 64k vertices are split so 16 bit indices still
+	//reach them all
+	struct IndexChunk {
+		GLsizei count;
+		GLintptr offset;	//in bytes
+		GLint baseVertex;
+	};
+
+	//draw the whole index buffer of the bound vao, instanceCount 0 draws
+	//without instancing
+	void DrawElements(int instanceCount = 0);
+
 	GLuint vaoID;
 	GLuint vboVerticesID;
 	GLuint vboIndicesID;
 	
 	GLSLShader shader;
+	GLSLShader::UniformHandle mvpUniform;
+	GLint instanceAttribute;	//first column of instanceMVP, -1 without one
 
 	GLenum primType;
+	bool primitiveRestart;
 	int totalVertices, totalIndices;
+	GLenum indexType;
+	std::vector<IndexChunk> indexChunks;
+
+	//between Generate and Upload
+	bool generated;
+	std::vector<glm::vec3> stagingVertices;
+	std::vector<GLuint> stagingIndices;
+	std::vector<GLushort> stagingShortIndices;
+
+private:
+	void BuildTriangleChunks(std::vector<glm::vec3>& vertices, std::vector<GLuint>& indices, std::vector<GLushort>& shortIndices, bool optimize);
+	bool BuildRestartChunks(const std::vector<GLuint>& indices, std::vector<GLushort>& shortIndices);
+	void EnablePrimitiveRestart(bool enable);
 };
 
@@ -15,7 +15,7 @@ CSkybox::CSkybox(void)
 		shader.AddUniform("MVP");
 		shader.AddUniform("cubeMap");
 		//set constant shader uniforms at initialization
-		glUniform1i(shader("cubeMap"),0);
+		shader.SetSampler(shader.GetUniform("cubeMap"), 0);
 	shader.UnUse();
 	 
 	//setup the parent's fields
@@ -0,0 +1,156 @@
+#include "StreamBuffer.h"
+#include <chrono>
+#include <iostream>
+#include <string.h>
+
+using namespace std;
+
+StreamBuffer::StreamBuffer(void)
+{
+	bufferID = 0;
+	frameSize = 0;
+	persistent = false;
+	mapped = 0;
+	region = 0;
+	used = 0;
+	memset(fences, 0, sizeof(fences));
+	memset(&stats, 0, sizeof(stats));
+}
+
+StreamBuffer::~StreamBuffer(void)
+{
+	Destroy();
+}
+
+bool StreamBuffer::PersistentMappingSupported() {
+#ifdef GL_ARB_buffer_storage
+	return GLEW_ARB_buffer_storage != 0;
+#else
+	return false;
+#endif
+}
+
+void StreamBuffer::Create(GLsizeiptr bytesPerFrame) {
+	Destroy();
+
+	frameSize = bytesPerFrame;
+	persistent = PersistentMappingSupported();
+	region = FRAMES - 1;
+	used = 0;
+
+	//the copy target leaves the vertex and index bindings alone
+	glGenBuffers(1, &bufferID);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, bufferID);
+#ifdef GL_ARB_buffer_storage
+	if (persistent) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_COPY_WRITE_BUFFER, FRAMES * frameSize, 0, flags);
+		mapped = static_cast<GLubyte*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, FRAMES * frameSize, flags));
+		if (mapped == 0) {
+			cerr<<"Cannot map stream buffer persistently, orphaning instead"<<endl;
+			glDeleteBuffers(1, &bufferID);
+			glGenBuffers(1, &bufferID);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, bufferID);
+			persistent = false;
+		}
+	}
+#endif
+	if (!persistent) {
+		glBufferData(GL_COPY_WRITE_BUFFER, frameSize, 0, GL_STREAM_DRAW);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void StreamBuffer::Destroy() {
+	if (bufferID == 0) {
+		return;
+	}
+	for (int i = 0; i < FRAMES; i++) {
+		if (fences[i]) {
+			glDeleteSync(fences[i]);
+			fences[i] = 0;
+		}
+	}
+	//deleting a buffer unmaps it
+	glDeleteBuffers(1, &bufferID);
+	bufferID = 0;
+	mapped = 0;
+	frameSize = 0;
+}
+
+//block until the GPU is done with the draws that read region
+void StreamBuffer::WaitForRegion(int index) {
+	GLsync fence = fences[index];
+	if (fence == 0) {
+		return;
+	}
+	fences[index] = 0;
+
+	//the common case, the GPU finished two frames ago
+	if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+		chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+		GLenum result;
+		do {
+			result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+		} while (result == GL_TIMEOUT_EXPIRED);
+		stats.stalls++;
+		stats.stallMs += chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+	}
+	glDeleteSync(fence);
+}
+
+void StreamBuffer::BeginFrame() {
+	if (bufferID == 0) {
+		return;
+	}
+	stats.frames++;
+	region = (region + 1) % FRAMES;
+	used = 0;
+
+	if (persistent) {
+		WaitForRegion(region);
+		return;
+	}
+
+	//orphan, the driver hands out fresh storage while the GPU reads the old one
+	glBindBuffer(GL_COPY_WRITE_BUFFER, bufferID);
+	glBufferData(GL_COPY_WRITE_BUFFER, frameSize, 0, GL_STREAM_DRAW);
+	mapped = static_cast<GLubyte*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, frameSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+StreamBuffer::Allocation StreamBuffer::Allocate(GLsizeiptr bytes, GLsizeiptr alignment) {
+	Allocation allocation;
+	allocation.buffer = bufferID;
+	allocation.offset = 0;
+	allocation.ptr = 0;
+
+	GLsizeiptr start = (used + alignment - 1) & ~(alignment - 1);
+	if (mapped == 0 || start + bytes > frameSize) {
+		stats.overflows++;
+		return allocation;
+	}
+	used = start + bytes;
+
+	GLintptr base = persistent ? region * frameSize : 0;
+	allocation.offset = base + start;
+	allocation.ptr = mapped + allocation.offset;
+	return allocation;
+}
+
+void StreamBuffer::Unmap() {
+	if (persistent || mapped == 0) {
+		return;
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, bufferID);
+	glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	mapped = 0;
+}
+
+void StreamBuffer::EndFrame() {
+	Unmap();
+	if (persistent) {
+		fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+}
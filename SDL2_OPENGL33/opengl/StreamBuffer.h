@@ -0,0 +1,68 @@
+#pragma once
+#include <GL/glew.h>
+
+//Ring of three per-frame regions for data written by the CPU every frame.
+//With ARB_buffer_storage the buffer is mapped once, persistent and coherent,
+//and a fence per region keeps the CPU from overwriting data the GPU has not
+//read yet. Without it the buffer is orphaned every frame instead.
+//
+//	BeginFrame();
+//	Allocation a = Allocate(bytes);	//write through a.ptr
+//	Unmap();			//before drawing from a.buffer at a.offset
+//	...draw...
+//	EndFrame();
+class StreamBuffer
+{
+public:
+	static const int FRAMES = 3;
+
+	struct Allocation {
+		GLuint buffer;
+		GLintptr offset;
+		void* ptr;		//0 when the frame's region is full
+	};
+
+	struct Stats {
+		int frames;
+		int stalls;		//BeginFrame had to wait for the GPU
+		double stallMs;		//time spent waiting in BeginFrame
+		int overflows;		//allocations that did not fit the region
+	};
+
+	StreamBuffer(void);
+	~StreamBuffer(void);
+
+	//bytes available to the allocations of one frame, calling it again
+	//replaces the buffer, GL keeps the old storage alive for pending draws
+	void Create(GLsizeiptr bytesPerFrame);
+	void Destroy();
+
+	void BeginFrame();
+	//alignment must be a power of two
+	Allocation Allocate(GLsizeiptr bytes, GLsizeiptr alignment = 16);
+	//make this frame's data visible to draws, a no-op while persistently mapped
+	void Unmap();
+	//fence the region once the draws using it are submitted
+	void EndFrame();
+
+	GLuint GetBuffer() const { return bufferID; }
+	GLsizeiptr GetFrameSize() const { return frameSize; }
+	bool IsPersistent() const { return persistent; }
+	const Stats& GetStats() const { return stats; }
+
+	static bool PersistentMappingSupported();
+
+private:
+	void WaitForRegion(int index);
+
+	GLuint bufferID;
+	GLsizeiptr frameSize;
+	bool persistent;
+
+	GLubyte* mapped;		//start of the whole buffer when persistent, the frame's data otherwise
+	int region;			//region of the current frame
+	GLsizeiptr used;		//bytes allocated in the current frame
+	GLsync fences[FRAMES];
+
+	Stats stats;
+};
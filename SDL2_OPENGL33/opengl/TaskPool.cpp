@@ -0,0 +1,388 @@
+#include "TaskPool.h"
+#include <assert.h>
+#include <string.h>
+
+TaskPool* TaskPool::s_pInstance = 0;
+
+const int TaskPool::JOB_DATA_SIZE;
+const int TaskPool::JOB_ARENA_SIZE;
+const int TaskPool::MAX_CONTINUATIONS;
+
+//times an idle worker looks for jobs before it sleeps
+const int SPIN_TRIES = 64;
+
+struct TaskPool::Job {
+	char data[JOB_DATA_SIZE];	//first, aligned like the struct
+	JobFunction function;
+	Job* parent;
+	atomic<int> unfinished;		//itself and its unfinished children
+	atomic<int> waitingFor;		//unfinished dependencies, and one until Run
+	atomic<int> continuationCount;
+	Job* continuations[MAX_CONTINUATIONS];
+	bool background;
+};
+
+//the deque of a pool thread, -1 on threads outside the pool
+static thread_local int workerIndex = -1;
+//the ring jobs are created in, blocks of JOB_ARENA_SIZE slots never freed
+//since a finished job may still be looked at by whoever waits for it. A slot
+//is reused once its job finished, a block is added when none has.
+static thread_local TaskPool::Job** arenas = 0;
+static thread_local unsigned int arenaCount = 0;
+static thread_local unsigned int arenaNext = 0;
+//where a thief starts looking
+static thread_local unsigned int stealSeed = 0;
+
+TaskPool::WorkDeque::WorkDeque()
+{
+	top = 0;
+	bottom = 0;
+}
+
+void TaskPool::WorkDeque::Push(Job* job) {
+	long long b = bottom.load(memory_order_relaxed);
+	jobs[b & (JOB_ARENA_SIZE - 1)].store(job, memory_order_relaxed);
+	//a thief that sees the new bottom sees the job
+	bottom.store(b + 1, memory_order_release);
+}
+
+bool TaskPool::WorkDeque::IsFull() const {
+	return bottom.load(memory_order_relaxed) - top.load(memory_order_acquire) >= JOB_ARENA_SIZE;
+}
+
+TaskPool::Job* TaskPool::WorkDeque::Pop() {
+	long long b = bottom.load(memory_order_relaxed) - 1;
+	bottom.store(b, memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst);
+	long long t = top.load(memory_order_relaxed);
+	if (t > b) {
+		//empty
+		bottom.store(b + 1, memory_order_relaxed);
+		return 0;
+	}
+	Job* job = jobs[b & (JOB_ARENA_SIZE - 1)].load(memory_order_relaxed);
+	if (t == b) {
+		//the last one, a thief may be taking it as well
+		if (!top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed)) {
+			job = 0;
+		}
+		bottom.store(b + 1, memory_order_relaxed);
+	}
+	return job;
+}
+
+TaskPool::Job* TaskPool::WorkDeque::Steal() {
+	long long t = top.load(memory_order_acquire);
+	atomic_thread_fence(memory_order_seq_cst);
+	long long b = bottom.load(memory_order_acquire);
+	if (t >= b) {
+		return 0;
+	}
+	Job* job = jobs[t & (JOB_ARENA_SIZE - 1)].load(memory_order_relaxed);
+	if (!top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed)) {
+		//the owner or another thief got it
+		return 0;
+	}
+	return job;
+}
+
+TaskPool::TaskPool()
+{
+	quit = false;
+	threadLimit = 0;
+	queuedJobs = 0;
+	queuedInjected = 0;
+	queuedBackground = 0;
+	sleepers = 0;
+	//the calling thread is one of them, but background jobs need a worker
+	//even on a single core
+	int threads = static_cast<int>(thread::hardware_concurrency());
+	int count = (threads > 1) ? threads - 1 : 1;
+	for (int i = 0; i < count; i++) {
+		deques.push_back(new WorkDeque());
+	}
+	for (int i = 0; i < count; i++) {
+		workers.push_back(thread(&TaskPool::WorkerMain, this, i));
+	}
+}
+
+TaskPool::~TaskPool()
+{
+	{
+		lock_guard<mutex> guard(lock);
+		quit = true;
+	}
+	wake.notify_all();
+	for (size_t i = 0; i < workers.size(); i++) {
+		workers[i].join();
+	}
+	for (size_t i = 0; i < deques.size(); i++) {
+		delete deques[i];
+	}
+}
+
+TaskPool::Job* TaskPool::CreateJob(JobFunction function, const void* data, size_t size) {
+	return CreateChildJob(0, function, data, size);
+}
+
+TaskPool::Job* TaskPool::CreateChildJob(Job* parent, JobFunction function, const void* data, size_t size) {
+	assert(size <= JOB_DATA_SIZE);
+	//skips slots still in use, a nested ParallelFor can create many jobs
+	//while the one it runs in is unfinished
+	Job* job = 0;
+	unsigned int slots = arenaCount * JOB_ARENA_SIZE;
+	for (unsigned int tries = 0; tries < slots && job == 0; tries++) {
+		unsigned int index = arenaNext++ % slots;
+		Job* slot = &arenas[index / JOB_ARENA_SIZE][index & (JOB_ARENA_SIZE - 1)];
+		if (slot->unfinished.load(memory_order_acquire) == 0) {
+			job = slot;
+		}
+	}
+	if (job == 0) {
+		//every slot holds an unfinished job, which may only finish after
+		//this one is created: waiting for one could hang
+		Job** grown = new Job*[arenaCount + 1];
+		for (unsigned int i = 0; i < arenaCount; i++) {
+			grown[i] = arenas[i];
+		}
+		grown[arenaCount] = new Job[JOB_ARENA_SIZE];
+		for (int i = 0; i < JOB_ARENA_SIZE; i++) {
+			grown[arenaCount][i].unfinished = 0;
+		}
+		delete[] arenas;
+		arenas = grown;
+		job = &arenas[arenaCount][0];
+		arenaNext = arenaCount * JOB_ARENA_SIZE + 1;
+		arenaCount++;
+	}
+	if (size > 0) {
+		memcpy(job->data, data, size);
+	}
+	job->function = function;
+	job->parent = parent;
+	job->unfinished = 1;
+	job->waitingFor = 1;
+	job->continuationCount = 0;
+	job->background = false;
+	if (parent) {
+		parent->unfinished++;
+	}
+	return job;
+}
+
+void TaskPool::AddDependency(Job* job, Job* dependency) {
+	job->waitingFor++;
+	int slot = dependency->continuationCount++;
+	assert(slot < MAX_CONTINUATIONS);
+	dependency->continuations[slot] = job;
+}
+
+void TaskPool::Run(Job* job) {
+	if (--job->waitingFor == 0) {
+		Push(job);
+	}
+}
+
+void TaskPool::RunBackground(Job* job) {
+	job->background = true;
+	Run(job);
+}
+
+bool TaskPool::IsFinished(const Job* job) const {
+	return job->unfinished.load(memory_order_acquire) == 0;
+}
+
+void TaskPool::Wait(const Job* job) {
+	int worker = workerIndex;
+	while (!IsFinished(job)) {
+		Job* next = FindJob(worker, false);
+		if (next) {
+			Execute(next);
+		} else {
+			this_thread::yield();
+		}
+	}
+}
+
+void TaskPool::Push(Job* job) {
+	if (job->background) {
+		lock_guard<mutex> guard(queueLock);
+		background.push_back(job);
+		queuedBackground++;
+	} else {
+		int worker = workerIndex;
+		if (worker >= 0 && !deques[worker]->IsFull()) {
+			deques[worker]->Push(job);
+		} else {
+			lock_guard<mutex> guard(queueLock);
+			injected.push_back(job);
+			queuedInjected++;
+		}
+		queuedJobs++;
+	}
+	//a worker going to sleep either sees the job counted or is seen here
+	if (sleepers > 0) {
+		lock_guard<mutex> guard(lock);
+		//with a limit the one woken might not be allowed to take it
+		if (threadLimit > 0 || job->background) {
+			wake.notify_all();
+		} else {
+			wake.notify_one();
+		}
+	}
+}
+
+int TaskPool::GetThreadCount() const {
+	int limit = threadLimit;
+	return (limit > 0 && limit < GetMaxThreadCount()) ? limit : GetMaxThreadCount();
+}
+
+bool TaskPool::MayRunJobs(int worker) const {
+	int limit = threadLimit;
+	return worker < 0 || limit <= 0 || worker < limit - 1;
+}
+
+TaskPool::Job* TaskPool::FindJob(int worker, bool takeBackground) {
+	Job* job = 0;
+	//its own jobs first, a worker past the limit still finishes what it
+	//started
+	if (worker >= 0) {
+		job = deques[worker]->Pop();
+	}
+	if (job == 0 && MayRunJobs(worker)) {
+		if (queuedInjected > 0) {
+			lock_guard<mutex> guard(queueLock);
+			if (!injected.empty()) {
+				job = injected.front();
+				injected.pop_front();
+				queuedInjected--;
+			}
+		}
+		if (job == 0 && queuedJobs > 0) {
+			int count = static_cast<int>(deques.size());
+			stealSeed = stealSeed * 1664525 + 1013904223;
+			int first = static_cast<int>((stealSeed >> 16) % count);
+			for (int i = 0; i < count && job == 0; i++) {
+				int victim = (first + i) % count;
+				if (victim != worker) {
+					job = deques[victim]->Steal();
+				}
+			}
+		}
+	}
+	if (job) {
+		queuedJobs--;
+		return job;
+	}
+	if (takeBackground && queuedBackground > 0) {
+		lock_guard<mutex> guard(queueLock);
+		if (!background.empty()) {
+			job = background.front();
+			background.pop_front();
+			queuedBackground--;
+		}
+	}
+	return job;
+}
+
+void TaskPool::Execute(Job* job) {
+	job->function(job, job->data);
+	Finish(job);
+}
+
+void TaskPool::Finish(Job* job) {
+	//read before the job counts as finished, after that its slot may be
+	//reused
+	Job* parent = job->parent;
+	int count = job->continuationCount;
+	Job* continuations[MAX_CONTINUATIONS];
+	for (int i = 0; i < count; i++) {
+		continuations[i] = job->continuations[i];
+	}
+	if (job->unfinished.fetch_sub(1, memory_order_acq_rel) != 1) {
+		return;
+	}
+	for (int i = 0; i < count; i++) {
+		Run(continuations[i]);
+	}
+	if (parent) {
+		Finish(parent);
+	}
+}
+
+void TaskPool::WorkerMain(int index) {
+	workerIndex = index;
+	stealSeed = static_cast<unsigned int>(index) * 2654435761u;
+	int idle = 0;
+	for (;;) {
+		Job* job = FindJob(index, true);
+		if (job) {
+			Execute(job);
+			idle = 0;
+			continue;
+		}
+		if (++idle < SPIN_TRIES) {
+			this_thread::yield();
+			continue;
+		}
+		unique_lock<mutex> guard(lock);
+		sleepers++;
+		while (!quit && queuedBackground == 0 && !(queuedJobs > 0 && MayRunJobs(index))) {
+			wake.wait(guard);
+		}
+		sleepers--;
+		if (quit) {
+			return;
+		}
+		idle = 0;
+	}
+}
+
+namespace {
+	struct Range {
+		int begin, end, grain;
+		const function<void(int, int)>* task;
+	};
+}
+
+//halves the range until it is grain items, leaving the upper halves for
+//others to steal, and runs what is left
+static void RunRange(TaskPool::Job* job, const void* data) {
+	Range range = *static_cast<const Range*>(data);
+	TaskPool* pool = TaskPool::Instance();
+	while (range.end - range.begin > range.grain) {
+		Range upper = range;
+		upper.begin = range.begin + (range.end - range.begin) / 2;
+		pool->Run(pool->CreateChildJob(job, RunRange, upper));
+		range.end = upper.begin;
+	}
+	(*range.task)(range.begin, range.end);
+}
+
+void TaskPool::ParallelFor(int count, int grain, const function<void(int, int)>& task) {
+	if (count <= 0) {
+		return;
+	}
+	//at most a few hundred jobs, so no thread's ring wraps under a call
+	int minGrain = count / (JOB_ARENA_SIZE / 8) + 1;
+	if (grain < minGrain) {
+		grain = minGrain;
+	}
+	if (count <= grain || GetThreadCount() == 1) {
+		task(0, count);
+		return;
+	}
+	Range range = { 0, count, grain, &task };
+	Job* root = CreateJob(RunRange, range);
+	Execute(root);
+	Wait(root);
+}
+
+void TaskPool::ParallelFor(int count, const function<void(int)>& task) {
+	int grain = count / (GetThreadCount() * 4);
+	ParallelFor(count, grain, [&task](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			task(i);
+		}
+	});
+}
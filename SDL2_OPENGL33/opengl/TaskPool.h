@@ -0,0 +1,143 @@
+#ifndef TASK_POOL_H
+#define TASK_POOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+using namespace std;
+
+//A work-stealing job system with a worker thread for every hardware thread
+//but the caller's, and at least one. Every worker owns a Chase-Lev deque: it
+//pushes and pops its jobs at the bottom without locks, idle workers steal
+//from the top of the others'. Threads outside the pool hand their jobs in
+//through a shared queue.
+//
+//Jobs come from a ring of slots per creating thread, so creating one does
+//not allocate; a slot is reused once its job finished and the ring only grows
+//by JOB_ARENA_SIZE slots when all of them hold unfinished jobs. A
+//job counts itself and its unfinished children, it is finished once they
+//all are, and may wait for other jobs to finish before it runs. Wait runs
+//other jobs until the one waited for is finished, so jobs can wait for
+//their own children and ParallelFor nests.
+//
+//Background jobs, like decoding a file, are only taken by idle workers and
+//never by a thread that is waiting, so they do not end up in the middle of
+//someone's ParallelFor. No job may make GL calls.
+class TaskPool
+{
+public:
+	struct Job;
+	typedef void (*JobFunction)(Job* job, const void* data);
+
+	//bytes of data a job carries, copied in when it is created
+	static const int JOB_DATA_SIZE = 64;
+	//slots a thread's job ring starts with and grows by, also the capacity
+	//of a worker's deque
+	static const int JOB_ARENA_SIZE = 4096;
+	//jobs that can wait for one job
+	static const int MAX_CONTINUATIONS = 4;
+
+	static TaskPool* Instance()
+	{
+		if (s_pInstance == 0) {
+			s_pInstance = new TaskPool();
+		}
+
+		return s_pInstance;
+	}
+
+	//a job calling function(job, data), data is copied and size at most
+	//JOB_DATA_SIZE. A child's parent is not finished before the child is,
+	//children are created before the parent is finished, usually by it.
+	Job* CreateJob(JobFunction function, const void* data = 0, size_t size = 0);
+	Job* CreateChildJob(Job* parent, JobFunction function, const void* data = 0, size_t size = 0);
+	template <typename T>
+	Job* CreateJob(JobFunction function, const T& data) { return CreateJob(function, &data, sizeof(T)); }
+	template <typename T>
+	Job* CreateChildJob(Job* parent, JobFunction function, const T& data) { return CreateChildJob(parent, function, &data, sizeof(T)); }
+
+	//job only starts once dependency is finished. Both must not have been
+	//Run yet.
+	void AddDependency(Job* job, Job* dependency);
+
+	//queues job, it starts when its dependencies are finished
+	void Run(Job* job);
+	void RunBackground(Job* job);
+	//runs other jobs until job is finished
+	void Wait(const Job* job);
+	bool IsFinished(const Job* job) const;
+
+	//calls task(item) for every item in [0, count) and returns when all
+	//are done. The items are split into ranges, about four per thread.
+	void ParallelFor(int count, const function<void(int)>& task);
+	//calls task(begin, end) on ranges of at least grain items covering
+	//[0, count). Ranges are halved until they are that small, the halves
+	//going to the deque for others to steal.
+	void ParallelFor(int count, int grain, const function<void(int, int)>& task);
+
+	//threads taking part in ParallelFor, the caller included
+	int GetThreadCount() const;
+	int GetMaxThreadCount() const { return static_cast<int>(workers.size()) + 1; }
+	//use at most limit threads for jobs that are not background jobs, 1
+	//runs ParallelFor on the caller and 0 lifts the limit. For measuring
+	//how the work scales.
+	void SetThreadLimit(int limit) { threadLimit = limit; }
+
+private:
+	//lock-free for its owner at the bottom, thieves take from the top
+	class WorkDeque
+	{
+	public:
+		WorkDeque();
+		void Push(Job* job);
+		bool IsFull() const;
+		Job* Pop();
+		Job* Steal();
+
+	private:
+		atomic<Job*> jobs[JOB_ARENA_SIZE];
+		char padding0[64];
+		atomic<long long> top;
+		char padding1[64];
+		atomic<long long> bottom;
+		char padding2[64];
+	};
+
+	TaskPool();
+	~TaskPool();
+
+	void Push(Job* job);
+	//the next job the thread may run, 0 if there is none
+	Job* FindJob(int worker, bool background);
+	void Execute(Job* job);
+	void Finish(Job* job);
+	void WorkerMain(int index);
+	bool MayRunJobs(int worker) const;
+
+	static TaskPool* s_pInstance;
+
+	vector<thread> workers;
+	vector<WorkDeque*> deques;
+	atomic<int> threadLimit;
+
+	//jobs of threads outside the pool, and background jobs
+	mutex queueLock;
+	deque<Job*> injected;
+	deque<Job*> background;
+
+	//jobs queued but not taken yet, for sleeping and waking workers
+	atomic<int> queuedJobs;
+	atomic<int> queuedInjected;
+	atomic<int> queuedBackground;
+	atomic<int> sleepers;
+	mutex lock;
+	condition_variable wake;
+	bool quit;
+};
+
+#endif
@@ -0,0 +1,173 @@
+#include "TextureCache.h"
+#include <iostream>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+//read only view of a whole file
+class MappedFile
+{
+public:
+	MappedFile(const string& file) : data(0), size(0) {
+#ifdef _WIN32
+		handle = CreateFileA(file.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+		mapping = 0;
+		if (handle == INVALID_HANDLE_VALUE) {
+			return;
+		}
+		LARGE_INTEGER length;
+		if (!GetFileSizeEx(handle, &length) || length.QuadPart == 0) {
+			return;
+		}
+		mapping = CreateFileMappingA(handle, 0, PAGE_READONLY, 0, 0, 0);
+		if (mapping == 0) {
+			return;
+		}
+		data = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+		size = (data != 0) ? static_cast<size_t>(length.QuadPart) : 0;
+#else
+		descriptor = open(file.c_str(), O_RDONLY);
+		if (descriptor < 0) {
+			return;
+		}
+		struct stat info;
+		if (fstat(descriptor, &info) != 0 || info.st_size == 0) {
+			return;
+		}
+		void* view = mmap(0, info.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+		if (view == MAP_FAILED) {
+			return;
+		}
+		data = static_cast<const unsigned char*>(view);
+		size = info.st_size;
+#endif
+	}
+
+	~MappedFile() {
+#ifdef _WIN32
+		if (data != 0) {
+			UnmapViewOfFile(data);
+		}
+		if (mapping != 0) {
+			CloseHandle(mapping);
+		}
+		if (handle != INVALID_HANDLE_VALUE) {
+			CloseHandle(handle);
+		}
+#else
+		if (data != 0) {
+			munmap(const_cast<unsigned char*>(data), size);
+		}
+		if (descriptor >= 0) {
+			close(descriptor);
+		}
+#endif
+	}
+
+	const unsigned char* data;	//0 if the file could not be mapped
+	size_t size;
+
+private:
+#ifdef _WIN32
+	HANDLE handle;
+	HANDLE mapping;
+#else
+	int descriptor;
+#endif
+
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+};
+
+//modification time, 0 if the file does not exist
+static time_t GetModificationTime(const string& file) {
+	struct stat info;
+	return (stat(file.c_str(), &info) == 0) ? info.st_mtime : 0;
+}
+
+bool TextureCache::SupportsBlockCompression() {
+	static int supported = -1;
+	if (supported < 0) {
+		supported = glewIsSupported("GL_EXT_texture_compression_s3tc") ? 1 : 0;
+	}
+	return supported == 1;
+}
+
+GLuint TextureCache::Load(const string& cached) {
+	MappedFile file(cached);
+	if (file.data == 0 || file.size < sizeof(TextureCooker::CookedHeader)) {
+		return 0;
+	}
+	const TextureCooker::CookedHeader* header = reinterpret_cast<const TextureCooker::CookedHeader*>(file.data);
+	if (header->magic != TextureCooker::MAGIC || header->version != TextureCooker::VERSION ||
+		header->format > TextureCooker::FORMAT_BC3 || header->levels == 0 || header->levels > 32 ||
+		file.size < sizeof(TextureCooker::CookedHeader) + header->levels * sizeof(TextureCooker::CookedLevel)) {
+		cerr<<"Invalid texture cache: "<<cached<<endl;
+		return 0;
+	}
+	const TextureCooker::CookedLevel* levels = reinterpret_cast<const TextureCooker::CookedLevel*>(header + 1);
+	for (unsigned int i = 0; i < header->levels; i++) {
+		if (levels[i].offset > file.size || levels[i].size > file.size - levels[i].offset ||
+			levels[i].size != static_cast<unsigned int>(TextureCooker::GetCompressedSize(TextureCooker::Format(header->format), levels[i].width, levels[i].height))) {
+			cerr<<"Invalid texture cache: "<<cached<<endl;
+			return 0;
+		}
+	}
+
+	GLenum internalFormat = GL_RGBA8;
+	if (header->format == TextureCooker::FORMAT_BC1) {
+		internalFormat = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	} else if (header->format == TextureCooker::FORMAT_BC3) {
+		internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	}
+	if (internalFormat != GL_RGBA8 && !SupportsBlockCompression()) {
+		cerr<<"No S3TC support for texture cache: "<<cached<<endl;
+		return 0;
+	}
+
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	//RGBA8 rows are 4 byte multiples at any width and compressed uploads
+	//ignore the unpack alignment, the default of 4 fits both
+	for (unsigned int i = 0; i < header->levels; i++) {
+		const unsigned char* pixels = file.data + levels[i].offset;
+		if (internalFormat == GL_RGBA8) {
+			glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA8, levels[i].width, levels[i].height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+		} else {
+			glCompressedTexImage2D(GL_TEXTURE_2D, i, internalFormat, levels[i].width, levels[i].height, 0, levels[i].size, pixels);
+		}
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, header->levels - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, (header->levels > 1) ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	return texture;
+}
+
+GLuint TextureCache::LoadOrCook(const string& image, const string& cached, TextureCooker::Format format) {
+	//without S3TC the blocks could not be uploaded, keep the texels
+	if (format != TextureCooker::FORMAT_RGBA8 && !SupportsBlockCompression()) {
+		format = TextureCooker::FORMAT_RGBA8;
+	}
+	time_t cookedTime = GetModificationTime(cached);
+	if (cookedTime != 0 && cookedTime >= GetModificationTime(image)) {
+		GLuint texture = Load(cached);
+		if (texture != 0) {
+			return texture;
+		}
+		//damaged, or blocks cooked on a machine with S3TC, cook it again
+		//in a format this driver takes
+	}
+	if (!TextureCooker::Cook(image, cached, format)) {
+		return 0;
+	}
+	return Load(cached);
+}
@@ -0,0 +1,30 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <GL/glew.h>
+#include <string>
+
+#include "TextureCooker.h"
+
+using namespace std;
+
+//Loads the texture cache files TextureCooker writes. The file is mapped into
+//memory and every mip level goes to GL straight from the mapping, with
+//glCompressedTexImage2D for BC1/BC3 and glTexImage2D for RGBA8, so there is
+//no decode, flip or mip generation at load time.
+class TextureCache
+{
+public:
+	//a mip mapped GL_TEXTURE_2D, left bound to the active unit, or 0 if the
+	//file is missing, damaged or its format is not supported by the driver
+	static GLuint Load(const string& cached);
+
+	//cooks image to cached first when the cache file is missing, older than
+	//the image or cannot be loaded, as RGBA8 if the driver has no S3TC
+	static GLuint LoadOrCook(const string& image, const string& cached, TextureCooker::Format format = TextureCooker::FORMAT_AUTO);
+
+	//driver support for the BC1/BC3 formats
+	static bool SupportsBlockCompression();
+};
+
+#endif
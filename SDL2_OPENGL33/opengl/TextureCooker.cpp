@@ -0,0 +1,349 @@
+#include "TextureCooker.h"
+#include "TaskPool.h"
+#include "ImageOps.h"
+#include "SOIL.h"
+#include <iostream>
+#include <fstream>
+#include <string.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+const unsigned int TextureCooker::MAGIC;
+const unsigned int TextureCooker::VERSION;
+
+//level data alignment in the file
+const int LEVEL_ALIGNMENT = 16;
+
+//the 16 texels of the block at (bx, by), edges clamped
+static void LoadBlock(const unsigned char* rgba, int width, int height, int bx, int by, unsigned char block[16][4]) {
+	for (int y = 0; y < 4; y++) {
+		int row = (by * 4 + y < height) ? by * 4 + y : height - 1;
+		for (int x = 0; x < 4; x++) {
+			int column = (bx * 4 + x < width) ? bx * 4 + x : width - 1;
+			memcpy(block[y * 4 + x], rgba + (row * width + column) * 4, 4);
+		}
+	}
+}
+
+static unsigned short To565(const int color[3]) {
+	return static_cast<unsigned short>(((color[0] >> 3) << 11) | ((color[1] >> 2) << 5) | (color[2] >> 3));
+}
+
+static void From565(unsigned short c, int color[3]) {
+	int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+	color[0] = (r << 3) | (r >> 2);
+	color[1] = (g << 2) | (g >> 4);
+	color[2] = (b << 3) | (b >> 2);
+}
+
+//Colour part of BC1 and BC3 after J.M.P. van Waveren's real-time DXT
+//compression: the end points are the corners of the block's colour bounding
+//box, moved inwards by a sixteenth of its size, and every texel takes the
+//closest of the four palette colours.
+static void CompressColorBlock(const unsigned char block[16][4], unsigned char* out) {
+	int minColor[3] = {255, 255, 255}, maxColor[3] = {0, 0, 0};
+	for (int i = 0; i < 16; i++) {
+		for (int c = 0; c < 3; c++) {
+			minColor[c] = (block[i][c] < minColor[c]) ? block[i][c] : minColor[c];
+			maxColor[c] = (block[i][c] > maxColor[c]) ? block[i][c] : maxColor[c];
+		}
+	}
+	for (int c = 0; c < 3; c++) {
+		int inset = (maxColor[c] - minColor[c]) >> 4;
+		minColor[c] += inset;
+		maxColor[c] -= inset;
+	}
+
+	unsigned short color0 = To565(maxColor);
+	unsigned short color1 = To565(minColor);
+	unsigned int indices = 0;
+	if (color0 != color1) {
+		//color0 > color1 selects the four colour mode
+		if (color0 < color1) {
+			unsigned short swap = color0;
+			color0 = color1;
+			color1 = swap;
+		}
+		int palette[4][3];
+		From565(color0, palette[0]);
+		From565(color1, palette[1]);
+		for (int c = 0; c < 3; c++) {
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+		for (int i = 0; i < 16; i++) {
+			int best = 0, bestDistance = 0x7fffffff;
+			for (int p = 0; p < 4; p++) {
+				int dr = block[i][0] - palette[p][0];
+				int dg = block[i][1] - palette[p][1];
+				int db = block[i][2] - palette[p][2];
+				int distance = dr * dr + dg * dg + db * db;
+				if (distance < bestDistance) {
+					bestDistance = distance;
+					best = p;
+				}
+			}
+			indices |= best << (i * 2);
+		}
+	}
+
+	out[0] = color0 & 0xff; out[1] = color0 >> 8;
+	out[2] = color1 & 0xff; out[3] = color1 >> 8;
+	for (int i = 0; i < 4; i++) {
+		out[4 + i] = (indices >> (i * 8)) & 0xff;
+	}
+}
+
+//alpha part of BC3, end points from the alpha range moved inwards by a
+//thirty-second, eight interpolated values
+static void CompressAlphaBlock(const unsigned char block[16][4], unsigned char* out) {
+	int minAlpha = 255, maxAlpha = 0;
+	for (int i = 0; i < 16; i++) {
+		minAlpha = (block[i][3] < minAlpha) ? block[i][3] : minAlpha;
+		maxAlpha = (block[i][3] > maxAlpha) ? block[i][3] : maxAlpha;
+	}
+	int inset = (maxAlpha - minAlpha) >> 5;
+	minAlpha += inset;
+	maxAlpha -= inset;
+
+	unsigned long long indices = 0;
+	if (maxAlpha > minAlpha) {
+		int palette[8];
+		palette[0] = maxAlpha;
+		palette[1] = minAlpha;
+		for (int p = 1; p < 7; p++) {
+			palette[p + 1] = ((7 - p) * maxAlpha + p * minAlpha) / 7;
+		}
+		for (int i = 0; i < 16; i++) {
+			int best = 0, bestDistance = 256;
+			for (int p = 0; p < 8; p++) {
+				int distance = abs(block[i][3] - palette[p]);
+				if (distance < bestDistance) {
+					bestDistance = distance;
+					best = p;
+				}
+			}
+			indices |= (unsigned long long)best << (i * 3);
+		}
+	} else {
+		//a flat block, every texel takes the first end point
+		maxAlpha = minAlpha = block[0][3];
+	}
+
+	out[0] = static_cast<unsigned char>(maxAlpha);
+	out[1] = static_cast<unsigned char>(minAlpha);
+	for (int i = 0; i < 6; i++) {
+		out[2 + i] = (indices >> (i * 8)) & 0xff;
+	}
+}
+
+int TextureCooker::GetCompressedSize(Format format, int width, int height) {
+	int blocks = ((width + 3) / 4) * ((height + 3) / 4);
+	switch (format) {
+	case FORMAT_BC1: return blocks * 8;
+	case FORMAT_BC3: return blocks * 16;
+	default:         return width * height * 4;
+	}
+}
+
+const char* TextureCooker::GetFormatName(Format format) {
+	switch (format) {
+	case FORMAT_RGBA8: return "RGBA8";
+	case FORMAT_BC1:   return "BC1";
+	case FORMAT_BC3:   return "BC3";
+	default:           return "auto";
+	}
+}
+
+void TextureCooker::CompressBC1(const unsigned char* rgba, int width, int height, unsigned char* blocks) {
+	int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+	TaskPool::Instance()->ParallelFor(blocksY, [=](int by) {
+		unsigned char block[16][4];
+		unsigned char* out = blocks + by * blocksX * 8;
+		for (int bx = 0; bx < blocksX; bx++) {
+			LoadBlock(rgba, width, height, bx, by, block);
+			CompressColorBlock(block, out + bx * 8);
+		}
+	});
+}
+
+void TextureCooker::CompressBC3(const unsigned char* rgba, int width, int height, unsigned char* blocks) {
+	int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+	TaskPool::Instance()->ParallelFor(blocksY, [=](int by) {
+		unsigned char block[16][4];
+		unsigned char* out = blocks + by * blocksX * 16;
+		for (int bx = 0; bx < blocksX; bx++) {
+			LoadBlock(rgba, width, height, bx, by, block);
+			CompressAlphaBlock(block, out + bx * 16);
+			CompressColorBlock(block, out + bx * 16 + 8);
+		}
+	});
+}
+
+//2x2 box filter with sizes rounded down like GL's mip chain, so an odd last
+//row or column is left out. A side of one texel is averaged with itself.
+static void Downsample(const unsigned char* source, int width, int height, unsigned char* target) {
+	int targetWidth = (width > 1) ? width / 2 : 1;
+	int targetHeight = (height > 1) ? height / 2 : 1;
+	for (int y = 0; y < targetHeight; y++) {
+		const unsigned char* row0 = source + (y * 2) * width * 4;
+		const unsigned char* row1 = (y * 2 + 1 < height) ? row0 + width * 4 : row0;
+		for (int x = 0; x < targetWidth; x++) {
+			int x0 = x * 2 * 4;
+			int x1 = (x * 2 + 1 < width) ? x0 + 4 : x0;
+			for (int c = 0; c < 4; c++) {
+				target[(y * targetWidth + x) * 4 + c] = static_cast<unsigned char>((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >> 2);
+			}
+		}
+	}
+}
+
+namespace {
+	//one level of the mip chain, for the jobs in Cook
+	struct LevelJob {
+		const unsigned char* source;
+		unsigned char* target;
+		int width, height;
+		TextureCooker::Format format;
+		unsigned int size;
+	};
+}
+
+static void NoWork(TaskPool::Job*, const void*) {
+}
+
+//the next level down from source
+static void FilterLevel(TaskPool::Job*, const void* data) {
+	const LevelJob* level = static_cast<const LevelJob*>(data);
+	Downsample(level->source, level->width, level->height, level->target);
+}
+
+static void CompressLevel(TaskPool::Job*, const void* data) {
+	const LevelJob* level = static_cast<const LevelJob*>(data);
+	switch (level->format) {
+	case TextureCooker::FORMAT_BC1: TextureCooker::CompressBC1(level->source, level->width, level->height, level->target); break;
+	case TextureCooker::FORMAT_BC3: TextureCooker::CompressBC3(level->source, level->width, level->height, level->target); break;
+	default:                        memcpy(level->target, level->source, level->size); break;
+	}
+}
+
+bool TextureCooker::Cook(const string& image, const string& cached, Format format, bool mipmaps) {
+	int width, height, channels;
+	unsigned char* rgba = SOIL_load_image(image.c_str(), &width, &height, &channels, SOIL_LOAD_RGBA);
+	if (rgba == 0) {
+		cerr<<"Cannot load image: "<<image<<endl;
+		return false;
+	}
+	bool cooked = Cook(rgba, width, height, cached, format, mipmaps);
+	SOIL_free_image_data(rgba);
+	return cooked;
+}
+
+bool TextureCooker::Cook(const unsigned char* rgba, int width, int height, const string& cached, Format format, bool mipmaps) {
+	//GL wants the bottom row first
+	vector<unsigned char> level(width * height * 4);
+	ImageOps::CopyRowsToRGBA(rgba, 4, width, height, &level[0], true);
+
+	if (format == FORMAT_AUTO) {
+		format = FORMAT_BC1;
+		for (size_t i = 3; i < level.size(); i += 4) {
+			if (level[i] != 255) {
+				format = FORMAT_BC3;
+				break;
+			}
+		}
+	}
+
+	CookedHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = MAGIC;
+	header.version = VERSION;
+	header.format = format;
+	header.width = width;
+	header.height = height;
+	header.levels = 1;
+	if (mipmaps) {
+		for (int w = width, h = height; w > 1 || h > 1; header.levels++) {
+			w = (w > 1) ? w / 2 : 1;
+			h = (h > 1) ? h / 2 : 1;
+		}
+	}
+
+	vector<CookedLevel> levels(header.levels);
+	unsigned int offset = sizeof(CookedHeader) + header.levels * sizeof(CookedLevel);
+	offset = (offset + LEVEL_ALIGNMENT - 1) & ~(LEVEL_ALIGNMENT - 1);
+	size_t dataSize = 0;
+	vector<vector<unsigned char> > images(header.levels);
+	images[0].swap(level);
+	int w = width, h = height;
+	for (unsigned int i = 0; i < header.levels; i++) {
+		levels[i].width = w;
+		levels[i].height = h;
+		levels[i].offset = offset + static_cast<unsigned int>(dataSize);
+		levels[i].size = GetCompressedSize(format, w, h);
+		dataSize += (levels[i].size + LEVEL_ALIGNMENT - 1) & ~(LEVEL_ALIGNMENT - 1);
+		if (i > 0) {
+			images[i].resize(w * h * 4);
+		}
+		w = (w > 1) ? w / 2 : 1;
+		h = (h > 1) ? h / 2 : 1;
+	}
+	vector<unsigned char> data(dataSize, 0);
+
+	//a job filters each level from the one before it and another compresses
+	//it, so a level compresses while the next ones are filtered
+	TaskPool* pool = TaskPool::Instance();
+	TaskPool::Job* root = pool->CreateJob(NoWork);
+	TaskPool::Job* previousFilter = 0;
+	vector<TaskPool::Job*> jobs;
+	for (unsigned int i = 0; i < header.levels; i++) {
+		TaskPool::Job* filter = 0;
+		if (i > 0) {
+			LevelJob filterJob = {&images[i - 1][0], &images[i][0], static_cast<int>(levels[i - 1].width), static_cast<int>(levels[i - 1].height), format, 0};
+			filter = pool->CreateChildJob(root, FilterLevel, filterJob);
+			if (previousFilter) {
+				pool->AddDependency(filter, previousFilter);
+			}
+			jobs.push_back(filter);
+			previousFilter = filter;
+		}
+		LevelJob compressJob = {&images[i][0], &data[levels[i].offset - offset], static_cast<int>(levels[i].width), static_cast<int>(levels[i].height), format, levels[i].size};
+		TaskPool::Job* compress = pool->CreateChildJob(root, CompressLevel, compressJob);
+		if (filter) {
+			pool->AddDependency(compress, filter);
+		}
+		jobs.push_back(compress);
+	}
+	for (size_t i = 0; i < jobs.size(); i++) {
+		pool->Run(jobs[i]);
+	}
+	pool->Run(root);
+	pool->Wait(root);
+
+	size_t slash = cached.find_last_of("/\\");
+	if (slash != string::npos) {
+#ifdef _WIN32
+		_mkdir(cached.substr(0, slash).c_str());
+#else
+		mkdir(cached.substr(0, slash).c_str(), 0755);
+#endif
+	}
+	ofstream fp(cached.c_str(), ios_base::out | ios_base::binary | ios_base::trunc);
+	if (!fp) {
+		cerr<<"Cannot write texture cache: "<<cached<<endl;
+		return false;
+	}
+	fp.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	fp.write(reinterpret_cast<const char*>(&levels[0]), levels.size() * sizeof(CookedLevel));
+	vector<char> padding(offset - sizeof(header) - levels.size() * sizeof(CookedLevel), 0);
+	if (!padding.empty()) {
+		fp.write(&padding[0], padding.size());
+	}
+	fp.write(reinterpret_cast<const char*>(&data[0]), data.size());
+	return fp.good();
+}
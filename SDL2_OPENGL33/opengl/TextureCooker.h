@@ -0,0 +1,61 @@
+#ifndef TEXTURE_COOKER_H
+#define TEXTURE_COOKER_H
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+//Turns images into texture cache files that TextureCache uploads without
+//decoding anything. A file holds the rows already flipped to GL's bottom up
+//order and the full mip chain, either as RGBA8 or as BC1/BC3 (DXT1/DXT5)
+//blocks. Makes no GL calls, tools/texture_cooker runs it offline and
+//TextureCache::LoadOrCook on the first run.
+//
+//	CookedHeader
+//	CookedLevel[levels]	largest first
+//	level data		each starting on a 16 byte boundary
+class TextureCooker
+{
+public:
+	enum Format {
+		FORMAT_RGBA8,
+		FORMAT_BC1,	//4 bits per texel, no alpha
+		FORMAT_BC3,	//8 bits per texel with alpha
+		FORMAT_AUTO	//BC3 if any texel is not opaque, BC1 otherwise
+	};
+
+	static const unsigned int MAGIC = 0x31435854;	//"TXC1"
+	static const unsigned int VERSION = 1;
+
+	struct CookedHeader {
+		unsigned int magic;
+		unsigned int version;
+		unsigned int format;	//FORMAT_RGBA8, FORMAT_BC1 or FORMAT_BC3
+		unsigned int width, height;
+		unsigned int levels;
+		unsigned int reserved[2];
+	};
+
+	struct CookedLevel {
+		unsigned int width, height;
+		unsigned int offset;	//from the start of the file
+		unsigned int size;	//bytes
+	};
+
+	//decodes image with SOIL and writes the cache file to cached, creating
+	//its directory if needed
+	static bool Cook(const string& image, const string& cached, Format format = FORMAT_AUTO, bool mipmaps = true);
+	//rgba is width x height RGBA8 texels, top row first as images store them
+	static bool Cook(const unsigned char* rgba, int width, int height, const string& cached, Format format = FORMAT_AUTO, bool mipmaps = true);
+
+	//4x4 texel blocks of one RGBA8 level, in the order of its rows. Partial
+	//blocks at the edges repeat the last row or column.
+	static void CompressBC1(const unsigned char* rgba, int width, int height, unsigned char* blocks);
+	static void CompressBC3(const unsigned char* rgba, int width, int height, unsigned char* blocks);
+	static int GetCompressedSize(Format format, int width, int height);
+
+	static const char* GetFormatName(Format format);
+};
+
+#endif
@@ -0,0 +1,296 @@
+#include "TextureLoader.h"
+#include "ImageOps.h"
+#include "SOIL.h"
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+
+//decoded images waiting for the GL thread, decode jobs wait when it is full
+const int DECODED_QUEUE_SIZE = 16;
+
+static double ElapsedMs(const chrono::high_resolution_clock::time_point& start) {
+	return chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+}
+
+TextureLoader::TextureLoader(GLsizeiptr budget, const glm::vec3& placeholderColor):
+	decoded(DECODED_QUEUE_SIZE)
+{
+	quit = false;
+	decoding = 0;
+	pendingImages = 0;
+	uploadBudget = budget;
+	current.pixels = 0;
+	currentRow = 0;
+
+	GLubyte texel[3] = {GLubyte(placeholderColor.r * 255), GLubyte(placeholderColor.g * 255), GLubyte(placeholderColor.b * 255)};
+	glGenTextures(1, &placeholder);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, placeholder);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (int i = 0; i < 6; i++) {
+		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB8, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, texel);
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+	stream.Create(uploadBudget);
+}
+
+TextureLoader::~TextureLoader(void)
+{
+	//requests not taken yet are dropped, so queued jobs return at once and
+	//running ones free their image instead of waiting for room in the queue
+	{
+		unique_lock<mutex> guard(lock);
+		quit = true;
+		requests.clear();
+		while (decoding != 0) {
+			decodingDone.wait(guard);
+		}
+	}
+	//images decoded but never uploaded
+	DecodedImage image;
+	while (decoded.TryPop(image)) {
+		if (image.pixels) {
+			SOIL_free_image_data(image.pixels);
+		}
+	}
+	if (current.pixels) {
+		SOIL_free_image_data(current.pixels);
+	}
+
+	for (size_t i = 0; i < cubemaps.size(); i++) {
+		if (cubemaps[i].texture) {
+			glDeleteTextures(1, &cubemaps[i].texture);
+		}
+	}
+	glDeleteTextures(1, &placeholder);
+}
+
+int TextureLoader::LoadCubemap(const char* const faces[6]) {
+	Cubemap cubemap;
+	cubemap.texture = 0;
+	cubemap.size = 0;
+	cubemap.facesDone = 0;
+	cubemap.failed = false;
+	cubemap.timings.resize(6);
+	int id = static_cast<int>(cubemaps.size());
+
+	{
+		lock_guard<mutex> guard(lock);
+		for (int i = 0; i < 6; i++) {
+			ImageTiming& timing = cubemap.timings[i];
+			timing.file = faces[i];
+			timing.width = timing.height = timing.channels = 0;
+			timing.decodeMs = timing.uploadMs = 0;
+			timing.uploadFrames = 0;
+			timing.failed = false;
+
+			Request request = {id, i, faces[i]};
+			requests.push_back(request);
+		}
+	}
+	//a job per face, each takes whichever request is oldest
+	TaskPool* pool = TaskPool::Instance();
+	TextureLoader* loader = this;
+	{
+		lock_guard<mutex> guard(lock);
+		decoding += 6;
+	}
+	for (int i = 0; i < 6; i++) {
+		pool->RunBackground(pool->CreateJob(DecodeNext, loader));
+	}
+
+	cubemaps.push_back(cubemap);
+	pendingImages += 6;
+	return id;
+}
+
+GLuint TextureLoader::GetTexture(int cubemap) const {
+	return IsComplete(cubemap) ? cubemaps[cubemap].texture : placeholder;
+}
+
+bool TextureLoader::IsComplete(int cubemap) const {
+	return !cubemaps[cubemap].failed && cubemaps[cubemap].facesDone == 6;
+}
+
+void TextureLoader::DecodeNext(TaskPool::Job* job, const void* data) {
+	TextureLoader* loader = *static_cast<TextureLoader* const*>(data);
+	Request request;
+	{
+		lock_guard<mutex> guard(loader->lock);
+		if (loader->quit || loader->requests.empty()) {
+			request.cubemap = -1;
+		} else {
+			request = loader->requests.front();
+			loader->requests.pop_front();
+		}
+	}
+	if (request.cubemap < 0) {
+		loader->FinishDecode();
+		return;
+	}
+
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+	DecodedImage image;
+	image.cubemap = request.cubemap;
+	image.face = request.face;
+	image.pixels = SOIL_load_image(request.file.c_str(), &image.width, &image.height, &image.channels, SOIL_LOAD_AUTO);
+	image.decodeMs = ElapsedMs(start);
+
+	//the GL thread drains the queue every frame, stop waiting on shutdown
+	bool queued = false;
+	while (!loader->quit && !(queued = loader->decoded.TryPush(image))) {
+		this_thread::yield();
+	}
+	if (!queued && image.pixels) {
+		SOIL_free_image_data(image.pixels);
+	}
+	loader->FinishDecode();
+}
+
+void TextureLoader::FinishDecode() {
+	lock_guard<mutex> guard(lock);
+	decoding--;
+	if (decoding == 0) {
+		decodingDone.notify_all();
+	}
+}
+
+void TextureLoader::Update() {
+	//nothing decoded, leave the stream buffer alone
+	while (!current.pixels) {
+		if (!decoded.TryPop(current)) {
+			return;
+		}
+		StartImage();
+	}
+
+	//a row that does not fit a frame gets a bigger stream buffer
+	GLsizeiptr rowBytes = GLsizeiptr(current.width) * 4;
+	if (rowBytes > stream.GetFrameSize()) {
+		stream.Create(rowBytes);
+	}
+
+	stream.BeginFrame();
+	GLsizeiptr budget = stream.GetFrameSize();
+	uploads.clear();
+	for (;;) {
+		if (!current.pixels) {
+			if (!decoded.TryPop(current)) {
+				break;
+			}
+			if (!StartImage()) {
+				continue;
+			}
+		}
+
+		ImageTiming& timing = cubemaps[current.cubemap].timings[current.face];
+		chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+		rowBytes = GLsizeiptr(current.width) * 4;
+		int rows = static_cast<int>(budget / rowBytes);
+		if (rows > current.height - currentRow) {
+			rows = current.height - currentRow;
+		}
+		if (rows == 0) {
+			break;
+		}
+		StreamBuffer::Allocation allocation = stream.Allocate(rows * rowBytes, 4);
+		if (allocation.ptr == 0) {
+			break;
+		}
+		//expanded to RGBA on the way into the stream buffer
+		ImageOps::CopyRowsToRGBA(current.pixels + currentRow * current.width * current.channels, current.channels,
+			current.width, rows, static_cast<unsigned char*>(allocation.ptr), false);
+		PendingUpload upload = {current.cubemap, current.face, currentRow, rows, allocation.offset};
+		uploads.push_back(upload);
+		budget -= rows * rowBytes;
+		currentRow += rows;
+		timing.uploadMs += ElapsedMs(start);
+		timing.uploadFrames++;
+
+		if (currentRow == current.height) {
+			//the pixels are in the stream buffer now
+			SOIL_free_image_data(current.pixels);
+			current.pixels = 0;
+		}
+	}
+	stream.Unmap();
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stream.GetBuffer());
+	for (size_t i = 0; i < uploads.size(); i++) {
+		const PendingUpload& upload = uploads[i];
+		Cubemap& cubemap = cubemaps[upload.cubemap];
+		ImageTiming& timing = cubemap.timings[upload.face];
+		chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+		glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap.texture);
+		glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + upload.face, 0, 0, upload.firstRow, cubemap.size, upload.rows,
+			GL_RGBA, GL_UNSIGNED_BYTE, reinterpret_cast<const GLvoid*>(upload.offset));
+		timing.uploadMs += ElapsedMs(start);
+		if (upload.firstRow + upload.rows == cubemap.size) {
+			cubemap.facesDone++;
+			pendingImages--;
+		}
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+	stream.EndFrame();
+}
+
+bool TextureLoader::StartImage() {
+	currentRow = 0;
+	Cubemap& cubemap = cubemaps[current.cubemap];
+	ImageTiming& timing = cubemap.timings[current.face];
+	timing.width = current.width;
+	timing.height = current.height;
+	timing.channels = current.channels;
+	timing.decodeMs = current.decodeMs;
+
+	if (current.pixels == 0) {
+		//SOIL's last result is shared by the decode jobs, not worth printing
+		cerr<<"Cannot load "<<timing.file<<endl;
+	} else if (current.width != current.height || (cubemap.texture && current.width != cubemap.size)) {
+		cerr<<"Cube map face "<<timing.file<<" does not match the other faces"<<endl;
+		SOIL_free_image_data(current.pixels);
+		current.pixels = 0;
+	} else {
+		if (cubemap.texture == 0) {
+			cubemap.size = current.width;
+			glGenTextures(1, &cubemap.texture);
+			glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap.texture);
+			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+			for (int i = 0; i < 6; i++) {
+				glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGBA8, cubemap.size, cubemap.size, 0,
+					GL_RGBA, GL_UNSIGNED_BYTE, 0);
+			}
+			glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+		}
+		return true;
+	}
+
+	timing.failed = true;
+	cubemap.failed = true;
+	pendingImages--;
+	return false;
+}
+
+void TextureLoader::PrintTimings(int cubemap, ostream& out) const {
+	const vector<ImageTiming>& timings = cubemaps[cubemap].timings;
+	for (size_t i = 0; i < timings.size(); i++) {
+		const ImageTiming& timing = timings[i];
+		out<<"\t"<<timing.file;
+		if (timing.failed) {
+			out<<": failed"<<endl;
+			continue;
+		}
+		out<<": "<<timing.width<<"x"<<timing.height<<"x"<<timing.channels<<fixed<<setprecision(1)
+			<<", decode "<<timing.decodeMs<<" ms, upload "<<timing.uploadMs<<" ms over "<<timing.uploadFrames
+			<<(timing.uploadFrames == 1 ? " frame" : " frames")<<endl;
+		out.unsetf(ios::floatfield);
+	}
+}
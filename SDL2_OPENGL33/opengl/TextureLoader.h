@@ -0,0 +1,121 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include <GL/glew.h>
+#include <glm.hpp>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <ostream>
+
+#include "LockFreeQueue.h"
+#include "StreamBuffer.h"
+#include "TaskPool.h"
+
+using namespace std;
+
+//Loads cube maps without stalling the GL thread. Images are decoded by
+//background jobs on the TaskPool and handed back through a lock-free queue.
+//Update(), called once per frame on the GL thread, copies at most the upload
+//budget of decoded rows into a StreamBuffer used as pixel unpack buffer and
+//uploads them from there, so a large cube map arrives over several frames. The copy
+//expands every face to RGBA, so faces may mix grey, RGB and RGBA images and
+//the driver always gets its fastest layout. Until all six faces are in,
+//GetTexture returns a 1x1 placeholder cube map.
+class TextureLoader
+{
+public:
+	//what one image cost, filled in as it goes through the pipeline
+	struct ImageTiming {
+		string file;
+		int width, height, channels;
+		double decodeMs;	//on a TaskPool worker
+		double uploadMs;	//copies and GL calls on the GL thread
+		int uploadFrames;	//Updates the upload was spread over
+		bool failed;
+	};
+
+	//uploadBudget is in bytes per Update
+	TextureLoader(GLsizeiptr uploadBudget = 4 * 1024 * 1024, const glm::vec3& placeholderColor = glm::vec3(0.5f, 0.6f, 0.7f));
+	~TextureLoader(void);
+
+	//starts decoding the faces, ordered +x -x +y -y +z -z like the cube map
+	//targets, and returns the id of the cube map
+	int LoadCubemap(const char* const faces[6]);
+
+	//the placeholder until the cube map is complete, also when loading failed
+	GLuint GetTexture(int cubemap) const;
+	bool IsComplete(int cubemap) const;
+	//images still being decoded or uploaded
+	bool IsBusy() const { return pendingImages > 0; }
+
+	//GL thread, once per frame. Leaves no cube map bound to the active unit.
+	void Update();
+
+	const vector<ImageTiming>& GetTimings(int cubemap) const { return cubemaps[cubemap].timings; }
+	void PrintTimings(int cubemap, ostream& out) const;
+
+private:
+	struct Request {
+		int cubemap;
+		int face;
+		string file;
+	};
+
+	//a decoded image on its way from a worker to the GL thread
+	struct DecodedImage {
+		int cubemap;
+		int face;
+		unsigned char* pixels;	//0 if decoding failed
+		int width, height, channels;
+		double decodeMs;
+	};
+
+	struct Cubemap {
+		GLuint texture;		//0 until the first face arrives
+		int size;
+		int facesDone;
+		bool failed;
+		vector<ImageTiming> timings;
+	};
+
+	//rows of an image copied into the stream buffer, uploaded after Unmap
+	struct PendingUpload {
+		int cubemap;
+		int face;
+		int firstRow, rows;
+		GLintptr offset;
+	};
+
+	//a background job, decodes the oldest request
+	static void DecodeNext(TaskPool::Job* job, const void* data);
+	//checks a popped image against its cube map, allocating the texture with
+	//the first face, false drops the image
+	bool StartImage();
+	//called by every decode job on its way out, wakes the destructor
+	void FinishDecode();
+
+	mutex lock;
+	deque<Request> requests;
+	int decoding;	//decode jobs not done yet, guarded by lock
+	condition_variable decodingDone;
+	atomic<bool> quit;	//set by the destructor, jobs drop their work
+
+	LockFreeQueue<DecodedImage> decoded;
+
+	//GL thread only from here
+	vector<Cubemap> cubemaps;
+	int pendingImages;
+	GLuint placeholder;
+	StreamBuffer stream;
+	GLsizeiptr uploadBudget;
+
+	DecodedImage current;	//image being uploaded, pixels 0 if none
+	int currentRow;
+	vector<PendingUpload> uploads;
+};
+
+#endif
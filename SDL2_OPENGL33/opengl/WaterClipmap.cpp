@@ -0,0 +1,242 @@
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <stdlib.h>
+
+#include "WaterClipmap.h"
+#include "AbstractCamera.h"
+#include "GridMesh.h"
+#include "OceanSimulation.h"
+#include <gtc/type_ptr.hpp>
+
+//four waves of amplitude 0.1 in water.vert
+const float MAX_WAVE_HEIGHT = 0.4f;
+//where the morph towards the coarser grid starts, in blocks from the ring centre
+const float MORPH_START = 1.5f;
+
+static float RandomRange(float min, float max) {
+	return min + (max - min) * (rand() / (float)RAND_MAX);
+}
+
+CWaterClipmap::CWaterClipmap(int rings, int patchResolution, float spacing)
+{
+	ringCount = rings;
+	//the morph pairs odd vertices with even ones, blocks must start on even ones
+	resolution = patchResolution + (patchResolution & 1);
+	baseSpacing = spacing;
+	time = 0;
+	blocksDrawn = 0;
+	ocean = 0;
+	oceanFrame = 0;
+	oceanTileSize = 0;
+	oceanUploaded = 0;
+	oceanTextures[0] = oceanTextures[1] = 0;
+
+	glm::vec2 directions[4];
+	for(int i=0;i<4;i++) {
+		float angle = RandomRange(-M_PI/3.0f, M_PI/3.0f);
+		directions[i]=glm::vec2(cos(angle),sin(angle));
+	}
+
+	shader.LoadFromFile(GL_VERTEX_SHADER, "shaders/water.vert");
+	shader.LoadFromFile(GL_FRAGMENT_SHADER, "shaders/water.frag");
+	shader.CreateAndLinkProgram();
+	shader.Use();
+		shader.AddAttribute("vVertex");
+		shader.AddUniform("MVP");
+		shader.AddUniform("time");
+		shader.AddUniform("directions");
+		shader.AddUniform("patchTransform");
+		shader.AddUniform("clipmapMorph");
+		shader.AddUniform("patchResolution");
+		shader.AddUniform("clipmapHole");
+		shader.AddUniform("ocean");
+		shader.AddUniform("oceanDisplacement");
+		shader.AddUniform("oceanSlope");
+		shader.SetUniform(shader.GetUniform("directions"), directions, 4);
+		shader.SetUniform(shader.GetUniform("patchResolution"), float(resolution));
+		timeUniform = shader.GetUniform("time");
+		patchUniform = shader.GetUniform("patchTransform");
+		morphUniform = shader.GetUniform("clipmapMorph");
+		holeUniform = shader.GetUniform("clipmapHole");
+		oceanUniform = shader.GetUniform("ocean");
+		//unit 0 is the sky cube map of water.frag
+		shader.SetSampler(shader.GetUniform("oceanDisplacement"), 1);
+		shader.SetSampler(shader.GetUniform("oceanSlope"), 2);
+	shader.UnUse();
+	Init();
+}
+
+CWaterClipmap::~CWaterClipmap(void)
+{
+	if (oceanTextures[0]) {
+		glDeleteTextures(2, oceanTextures);
+	}
+}
+
+void CWaterClipmap::SetTime(const float t) {
+	time = t;
+}
+
+void CWaterClipmap::SetEyePos(const glm::vec3& ePos) {
+	eyePos = ePos;
+}
+
+void CWaterClipmap::SetCustomUniforms() {
+	shader.SetUniform(timeUniform, time);
+}
+
+int CWaterClipmap::GetTotalVertices() {
+	return (resolution+1)*(resolution+1);
+}
+
+int CWaterClipmap::GetTotalIndices() {
+	return resolution*resolution*2*3;
+}
+
+GLenum CWaterClipmap::GetPrimitiveType() {
+	return GL_TRIANGLES;
+}
+
+//a unit block in xz, water.vert places it with patchTransform
+void CWaterClipmap::FillVertexBuffer(GLfloat* pBuffer) {
+	glm::vec3* vertices = (glm::vec3*)(pBuffer);
+	int count = 0;
+	for (int j = 0; j <= resolution; j++) {
+		for (int i = 0; i <= resolution; i++) {
+			vertices[count++] = glm::vec3(float(i)/resolution, 0, float(j)/resolution);
+		}
+	}
+}
+
+void CWaterClipmap::FillIndexBuffer(GLuint* pBuffer) {
+	GridMesh::FillIndices(pBuffer, resolution, resolution, GridMesh::TRIANGLES);
+}
+
+//margin covers the waves in y and the ocean's horizontal displacement in xz
+bool CWaterClipmap::IsBlockVisible(float x, float z, float size, float margin) const {
+	glm::vec3 min(x - margin, -margin, z - margin);
+	glm::vec3 max(x + size + margin, margin, z + size + margin);
+	for (int i = 0; i < 6; i++) {
+		const glm::vec3& N = frustum[i].N;
+		//corner furthest along the normal
+		glm::vec3 p(N.x >= 0 ? max.x : min.x, N.y >= 0 ? max.y : min.y, N.z >= 0 ? max.z : min.z);
+		if (glm::dot(N, p) + frustum[i].d < 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void CWaterClipmap::SetOcean(COceanSimulation* sim, float worldTileSize) {
+	ocean = sim;
+	oceanTileSize = worldTileSize;
+	oceanUploaded = 0;
+	if (!ocean) {
+		return;
+	}
+
+	int n = ocean->GetResolution();
+	if (!oceanTextures[0]) {
+		glGenTextures(2, oceanTextures);
+	}
+	GLenum internalFormats[2] = {GL_RGBA32F, GL_RG32F};
+	GLenum formats[2] = {GL_RGBA, GL_RG};
+	for (int i = 0; i < 2; i++) {
+		glActiveTexture(GL_TEXTURE1 + i);
+		glBindTexture(GL_TEXTURE_2D, oceanTextures[i]);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormats[i], n, n, 0, formats[i], GL_FLOAT, 0);
+	}
+	glActiveTexture(GL_TEXTURE0);
+}
+
+void CWaterClipmap::UploadOcean() {
+	int n = ocean->GetResolution();
+	const float* data[2] = {ocean->GetDisplacement(), ocean->GetSlope()};
+	if (oceanFrame) {
+		data[0] = &oceanFrame->displacement[0];
+		data[1] = &oceanFrame->slope[0];
+	}
+	GLenum formats[2] = {GL_RGBA, GL_RG};
+	for (int i = 0; i < 2; i++) {
+		glActiveTexture(GL_TEXTURE1 + i);
+		glBindTexture(GL_TEXTURE_2D, oceanTextures[i]);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, n, n, formats[i], GL_FLOAT, data[i]);
+		glGenerateMipmap(GL_TEXTURE_2D);
+	}
+	glActiveTexture(GL_TEXTURE0);
+	oceanUploaded = oceanFrame ? oceanFrame->updateCount : ocean->GetUpdateCount();
+}
+
+void CWaterClipmap::Render(const GLfloat* MVP) {
+	glm::mat4 clip = glm::make_mat4(MVP);
+	//without a model part these are world space planes
+	CAbstractCamera::ExtractFrustumPlanes(clip, frustum);
+	blocksDrawn = 0;
+
+	float margin = MAX_WAVE_HEIGHT;
+	glm::vec2 oceanParams(0);
+	if (ocean) {
+		unsigned int updateCount = oceanFrame ? oceanFrame->updateCount : ocean->GetUpdateCount();
+		if (updateCount != oceanUploaded) {
+			UploadOcean();
+		}
+		float scale = oceanTileSize / ocean->GetTileSize();
+		oceanParams = glm::vec2(1.0f / oceanTileSize, scale);
+		margin = (oceanFrame ? oceanFrame->maxDisplacement : ocean->GetMaxDisplacement()) * scale;
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, oceanTextures[0]);
+		glActiveTexture(GL_TEXTURE2);
+		glBindTexture(GL_TEXTURE_2D, oceanTextures[1]);
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+	shader.Use();
+		shader.SetUniform(mvpUniform, clip);
+		shader.SetUniform(oceanUniform, &oceanParams, 1);
+		SetCustomUniforms();
+		glBindVertexArray(vaoID);
+
+		glm::vec2 eye(eyePos.x, eyePos.z);
+		glm::vec2 holeCenter(0);
+		float holeHalf = 0;
+		for (int level = 0; level < ringCount; level++) {
+			float spacing = baseSpacing * float(1 << level);
+			float blockSize = resolution * spacing;
+			//snapped to the coarser grid, so the ring border lies on the next ring's vertices
+			float step = 2.0f * spacing;
+			glm::vec2 center = glm::floor(eye / step + 0.5f) * step;
+			glm::vec2 origin = center - glm::vec2(2.0f * blockSize);
+
+			shader.SetUniform(morphUniform, glm::vec4(center.x, center.y, MORPH_START * blockSize, 2.0f * blockSize));
+			shader.SetUniform(holeUniform, glm::vec3(holeCenter.x, holeCenter.y, holeHalf));
+
+			for (int bz = 0; bz < 4; bz++) {
+				for (int bx = 0; bx < 4; bx++) {
+					float x = origin.x + bx * blockSize;
+					float z = origin.y + bz * blockSize;
+					//blocks entirely under the finer ring, partly covered ones
+					//lose the covered fragments in water.frag
+					if (x >= holeCenter.x - holeHalf && x + blockSize <= holeCenter.x + holeHalf &&
+						z >= holeCenter.y - holeHalf && z + blockSize <= holeCenter.y + holeHalf) {
+						continue;
+					}
+					if (!IsBlockVisible(x, z, blockSize, margin)) {
+						continue;
+					}
+					shader.SetUniform(patchUniform, glm::vec4(x, z, blockSize, 0));
+					DrawElements();
+					blocksDrawn++;
+				}
+			}
+
+			holeCenter = center;
+			holeHalf = 2.0f * blockSize;
+		}
+
+		glBindVertexArray(0);
+	shader.UnUse();
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include "RenderableObject.h"
+#include "Plane.h"
+#include <glm.hpp>
+
+class COceanSimulation;
+struct OceanFrame;
+
+//Geometry clipmap water: nested square rings centred on the eye, every ring
+//twice the grid spacing of the one inside it. A ring is a 4x4 arrangement of
+//one shared block mesh, so the vertex buffer holds a single block of
+//patchResolution quads no matter how large the plane is, and nothing is
+//rebuilt when the eye moves. Each ring snaps to twice its own spacing. Its
+//centre part is covered by the next finer ring, the fragments there are
+//discarded in water.frag, and water.vert morphs the outer band of every
+//ring onto the coarser grid so neighbouring rings meet without cracks.
+class CWaterClipmap:
+	public RenderableObject
+{
+public:
+	//patchResolution quads along a block side (even), baseSpacing is the
+	//grid spacing of the innermost ring
+	CWaterClipmap(int ringCount=6, int patchResolution=16, float baseSpacing=1.0f);
+	virtual ~CWaterClipmap(void);
+
+	int GetTotalVertices();
+	int GetTotalIndices();
+	GLenum GetPrimitiveType();
+
+	void FillVertexBuffer( GLfloat* pBuffer);
+	void FillIndexBuffer( GLuint* pBuffer);
+
+	void SetCustomUniforms();
+
+	void SetTime(const float t);
+	void SetEyePos(const glm::vec3& eyePos);
+
+	//draw every ring around the eye, hides RenderableObject::Render. The
+	//rings are in world space, so MVP is projection times view.
+	void Render(const float* MVP);
+
+	//displace the rings with an FFT ocean instead of the sine waves, one tile
+	//of the simulation covers worldTileSize units and heights are scaled by
+	//the same factor. The textures are uploaded whenever the simulation has
+	//been updated, 0 switches back to the sine waves.
+	void SetOcean(COceanSimulation* ocean, float worldTileSize);
+	//upload from a copy of one update instead of from the simulation, which
+	//then only gives its size and may be updated on another thread. 0 reads
+	//the simulation again.
+	void SetOceanFrame(const OceanFrame* frame) { oceanFrame = frame; }
+
+	int GetRingCount() const { return ringCount; }
+	int GetPatchResolution() const { return resolution; }
+	int GetBlocksDrawn() const { return blocksDrawn; }
+	int GetVerticesDrawn() const { return blocksDrawn * (resolution+1)*(resolution+1); }
+
+private:
+	bool IsBlockVisible(float x, float z, float size, float margin) const;
+	void UploadOcean();
+
+	int ringCount;
+	int resolution;
+	float baseSpacing;
+	float time;
+	glm::vec3 eyePos;
+	CPlane frustum[6];
+	int blocksDrawn;
+
+	COceanSimulation* ocean;
+	const OceanFrame* oceanFrame;
+	float oceanTileSize;
+	unsigned int oceanUploaded;
+	GLuint oceanTextures[2];	//displacement, slope
+
+	GLSLShader::UniformHandle timeUniform;
+	GLSLShader::UniformHandle patchUniform;
+	GLSLShader::UniformHandle morphUniform;
+	GLSLShader::UniformHandle holeUniform;
+	GLSLShader::UniformHandle oceanUniform;
+};
@@ -0,0 +1,178 @@
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <stdlib.h>
+
+#include "WaterQuadtree.h"
+#include "AbstractCamera.h"
+#include "GridMesh.h"
+#include <gtc/type_ptr.hpp>
+
+//four waves of amplitude 0.1 in water.vert
+const float MAX_WAVE_HEIGHT = 0.4f;
+//deeper than any height difference two neighbouring chunks can have
+const float SKIRT_DEPTH = 2.0f * MAX_WAVE_HEIGHT + 0.2f;
+
+static float RandomRange(float min, float max) {
+	return min + (max - min) * (rand() / (float)RAND_MAX);
+}
+
+CWaterQuadtree::CWaterQuadtree(float size, int patchResolution, float minSize, float factor)
+{
+	worldSize = size;
+	resolution = patchResolution;
+	minChunkSize = minSize;
+	lodFactor = factor;
+	time = 0;
+	chunksDrawn = 0;
+
+	glm::vec2 directions[4];
+	for(int i=0;i<4;i++) {
+		float angle = RandomRange(-M_PI/3.0f, M_PI/3.0f);
+		directions[i]=glm::vec2(cos(angle),sin(angle));
+	}
+
+	shader.LoadFromFile(GL_VERTEX_SHADER, "shaders/water.vert");
+	shader.LoadFromFile(GL_FRAGMENT_SHADER, "shaders/water.frag");
+	shader.CreateAndLinkProgram();
+	shader.Use();
+		shader.AddAttribute("vVertex");
+		shader.AddUniform("MVP");
+		shader.AddUniform("time");
+		shader.AddUniform("directions");
+		shader.AddUniform("patchTransform");
+		shader.SetUniform(shader.GetUniform("directions"), directions, 4);
+		timeUniform = shader.GetUniform("time");
+		patchUniform = shader.GetUniform("patchTransform");
+	shader.UnUse();
+	Init();
+}
+
+CWaterQuadtree::~CWaterQuadtree(void)
+{
+}
+
+void CWaterQuadtree::SetTime(const float t) {
+	time = t;
+}
+
+void CWaterQuadtree::SetEyePos(const glm::vec3& ePos) {
+	eyePos = ePos;
+}
+
+void CWaterQuadtree::SetCustomUniforms() {
+	shader.SetUniform(timeUniform, time);
+}
+
+//the patch grid plus one row of skirt vertices per side
+int CWaterQuadtree::GetPatchVertices() const {
+	return (resolution+1)*(resolution+1) + 4*(resolution+1);
+}
+
+int CWaterQuadtree::GetTotalVertices() {
+	return GetPatchVertices();
+}
+
+int CWaterQuadtree::GetTotalIndices() {
+	return resolution*resolution*2*3 + 4*resolution*2*3;
+}
+
+GLenum CWaterQuadtree::GetPrimitiveType() {
+	return GL_TRIANGLES;
+}
+
+//a unit patch in xz, water.vert places it with patchTransform. Skirt vertices
+//have y=-1 and are pulled down by the skirt depth.
+void CWaterQuadtree::FillVertexBuffer(GLfloat* pBuffer) {
+	glm::vec3* vertices = (glm::vec3*)(pBuffer);
+	int count = 0;
+	for (int j = 0; j <= resolution; j++) {
+		for (int i = 0; i <= resolution; i++) {
+			vertices[count++] = glm::vec3(float(i)/resolution, 0, float(j)/resolution);
+		}
+	}
+	//sides in the order z=0, x=1, z=1, x=0
+	for (int side = 0; side < 4; side++) {
+		for (int k = 0; k <= resolution; k++) {
+			float t = float(k)/resolution;
+			glm::vec2 p = (side == 0) ? glm::vec2(t, 0) : (side == 1) ? glm::vec2(1, t) : (side == 2) ? glm::vec2(t, 1) : glm::vec2(0, t);
+			vertices[count++] = glm::vec3(p.x, -1, p.y);
+		}
+	}
+}
+
+void CWaterQuadtree::FillIndexBuffer(GLuint* pBuffer) {
+	GridMesh::FillIndices(pBuffer, resolution, resolution, GridMesh::TRIANGLES);
+	GLuint* id = pBuffer + GridMesh::GetIndexCount(resolution, resolution, GridMesh::TRIANGLES);
+	int row = resolution+1;
+
+	int skirtStart = row*row;
+	for (int side = 0; side < 4; side++) {
+		for (int k = 0; k < resolution; k++) {
+			//grid vertices along this side, matching FillVertexBuffer
+			int a, b;
+			switch (side) {
+			case 0:  a = k;                       b = k+1;                      break;
+			case 1:  a = k*row + resolution;      b = (k+1)*row + resolution;   break;
+			case 2:  a = resolution*row + k;      b = resolution*row + k+1;     break;
+			default: a = k*row;                   b = (k+1)*row;                break;
+			}
+			int c = skirtStart + side*row + k;
+			int d = c + 1;
+			*id++ = a; *id++ = c; *id++ = b;
+			*id++ = b; *id++ = c; *id++ = d;
+		}
+	}
+}
+
+bool CWaterQuadtree::IsChunkVisible(float x, float z, float size) const {
+	glm::vec3 min(x, -MAX_WAVE_HEIGHT - SKIRT_DEPTH, z);
+	glm::vec3 max(x + size, MAX_WAVE_HEIGHT, z + size);
+	for (int i = 0; i < 6; i++) {
+		const glm::vec3& N = frustum[i].N;
+		//corner furthest along the normal
+		glm::vec3 p(N.x >= 0 ? max.x : min.x, N.y >= 0 ? max.y : min.y, N.z >= 0 ? max.z : min.z);
+		if (glm::dot(N, p) + frustum[i].d < 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void CWaterQuadtree::DrawChunk(float x, float z, float size) {
+	shader.SetUniform(patchUniform, glm::vec4(x, z, size, SKIRT_DEPTH));
+	DrawElements();
+	chunksDrawn++;
+}
+
+//split while the eye is close compared to the chunk size
+void CWaterQuadtree::Select(float x, float z, float size) {
+	if (!IsChunkVisible(x, z, size)) {
+		return;
+	}
+	glm::vec3 nearest(glm::clamp(eyePos.x, x, x + size), 0, glm::clamp(eyePos.z, z, z + size));
+	float distance = glm::length(eyePos - nearest);
+	if (size * 0.5f < minChunkSize || distance > lodFactor * size) {
+		DrawChunk(x, z, size);
+		return;
+	}
+	float half = size * 0.5f;
+	Select(x, z, half);
+	Select(x + half, z, half);
+	Select(x, z + half, half);
+	Select(x + half, z + half, half);
+}
+
+void CWaterQuadtree::Render(const GLfloat* MVP) {
+	glm::mat4 clip = glm::make_mat4(MVP);
+	//without a model part these are world space planes
+	CAbstractCamera::ExtractFrustumPlanes(clip, frustum);
+	chunksDrawn = 0;
+
+	shader.Use();
+		shader.SetUniform(mvpUniform, clip);
+		SetCustomUniforms();
+		glBindVertexArray(vaoID);
+			Select(-worldSize * 0.5f, -worldSize * 0.5f, worldSize);
+		glBindVertexArray(0);
+	shader.UnUse();
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include "RenderableObject.h"
+#include "Plane.h"
+#include <glm.hpp>
+
+//Water surface drawn as a quadtree of chunks that all share one patch mesh.
+//Chunks near the eye are split until they are small, distant ones stay
+//coarse, so the drawn vertex count depends on the patch resolution and the
+//depth of the tree and not on the world size. Every patch has a skirt
+//hanging below its border that hides the cracks between chunks of
+//different levels. Chunks outside the frustum are skipped.
+class CWaterQuadtree:
+	public RenderableObject
+{
+public:
+	//worldSize square centred on the origin, patchResolution quads along a
+	//chunk side, no chunk smaller than minChunkSize. A chunk is split while
+	//the eye is closer than lodFactor times its size.
+	CWaterQuadtree(float worldSize=1000, int patchResolution=32, float minChunkSize=8, float lodFactor=2.0f);
+	virtual ~CWaterQuadtree(void);
+
+	int GetTotalVertices();
+	int GetTotalIndices();
+	GLenum GetPrimitiveType();
+
+	void FillVertexBuffer( GLfloat* pBuffer);
+	void FillIndexBuffer( GLuint* pBuffer);
+
+	void SetCustomUniforms();
+
+	void SetTime(const float t);
+	void SetEyePos(const glm::vec3& eyePos);
+
+	//select, cull and draw the chunks, hides RenderableObject::Render. The
+	//chunks are in world space, so MVP is projection times view.
+	void Render(const float* MVP);
+
+	int GetChunksDrawn() const { return chunksDrawn; }
+	int GetVerticesDrawn() const { return chunksDrawn * GetPatchVertices(); }
+
+private:
+	int GetPatchVertices() const;
+	void DrawChunk(float x, float z, float size);
+	void Select(float x, float z, float size);
+	bool IsChunkVisible(float x, float z, float size) const;
+
+	float worldSize;
+	int resolution;
+	float minChunkSize;
+	float lodFactor;
+	float time;
+	glm::vec3 eyePos;
+	CPlane frustum[6];
+	int chunksDrawn;
+
+	GLSLShader::UniformHandle timeUniform;
+	GLSLShader::UniformHandle patchUniform;
+};
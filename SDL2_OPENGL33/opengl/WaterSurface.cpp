@@ -14,12 +14,13 @@ float random(float min, float max) {
     return v;
 }
 
-CWaterSurface::CWaterSurface(int w, int d, float x, float z)
+CWaterSurface::CWaterSurface(int w, int d, float x, float z, GridMesh::Layout l)
 {
 	srand(::time(NULL));
 
 	width = w;
 	depth = d;
+	layout = l;
 
 	wsSizeX = x;
 	wsSizeZ = z;
@@ -40,7 +41,11 @@ CWaterSurface::CWaterSurface(int w, int d, float x, float z)
 		shader.AddUniform("time");
 		shader.AddUniform("eyePos");
 		shader.AddUniform("directions");
-		glUniform2fv(shader("directions"),4,glm::value_ptr(directions[0]));
+		shader.AddUniform("patchTransform");
+		shader.SetUniform(shader.GetUniform("directions"), directions, 4);
+		//one mesh in world space, no offset or scale and no skirt
+		shader.SetUniform(shader.GetUniform("patchTransform"), glm::vec4(0, 0, 1, 0));
+		timeUniform = shader.GetUniform("time");
 	shader.UnUse();  
 	Init();
 }
@@ -55,7 +60,7 @@ void CWaterSurface::SetEyePos(const glm::vec3& ePos) {
 }
 
 void CWaterSurface::SetCustomUniforms() {
-	glUniform1f(shader("time"), time);   
+	shader.SetUniform(timeUniform, time);
 }
 
 CWaterSurface::~CWaterSurface(void)
@@ -67,44 +72,30 @@ int CWaterSurface::GetTotalVertices() {
 }
 
 int CWaterSurface::GetTotalIndices() {
-	return width*depth*2*3;
+	return GridMesh::GetIndexCount(width, depth, layout);
 }
 
 GLenum CWaterSurface::GetPrimitiveType() {
-	return GL_TRIANGLES;
+	return GridMesh::GetPrimitiveType(layout);
 }
 
+bool CWaterSurface::UsesPrimitiveRestart() {
+	return GridMesh::UsesPrimitiveRestart(layout);
+}
+
+//the banded order needs no optimization pass in Init
+bool CWaterSurface::IsCacheOptimized() {
+	return layout == GridMesh::OPTIMIZED_TRIANGLES;
+}
+
+//x runs from -wsSizeX/2 in steps of wsSizeX/(width-1), likewise z
 void CWaterSurface::FillVertexBuffer(GLfloat* pBuffer) {
-	glm::vec3* vertices = (glm::vec3*)(pBuffer);
-	int count = 0;
 	float width_2 = wsSizeX/2.0f;
 	float depth_2 = wsSizeZ/2.0f;
-	int i=0, j=0;
-	for( j=0;j<=depth;j++) {		 
-		for( i=0;i<=width;i++) {	 
-			vertices[count++] = glm::vec3( ((float(i)/(width-1)) *2-1)* width_2, 0, ((float(j)/(depth-1))*2-1)*depth_2);
-		}
-	}
+	glm::vec2 spacing(2*width_2/(width-1), 2*depth_2/(depth-1));
+	GridMesh::FillVertices((glm::vec3*)(pBuffer), width, depth, glm::vec2(-width_2, -depth_2), spacing);
 }
 
 void CWaterSurface::FillIndexBuffer(GLuint* pBuffer) { 
-	int i=0, j=0;
-	//fill indices array
-	GLuint* id=pBuffer; 
-	for (i = 0; i < depth; i++) {        
-		for (j = 0; j < width; j++) {            
-			int i0 = i * (width+1) + j;            
-			int i1 = i0 + 1;            
-			int i2 = i0 + (width+1);            
-			int i3 = i2 + 1;            
-			if ((j+i)%2) {                
-				*id++ = i0; *id++ = i2; *id++ = i1;                
-				*id++ = i1; *id++ = i2; *id++ = i3;            
-			} else {                
-				*id++ = i0; *id++ = i2; *id++ = i3;                
-				*id++ = i0; *id++ = i3; *id++ = i1;            
-			}        
-		}    
-	}
-}
- 
\ No newline at end of file
+	GridMesh::FillIndices(pBuffer, width, depth, layout);
+}
\ No newline at end of file
@@ -1,12 +1,13 @@
 #pragma once
 #include "renderableobject.h"
+#include "GridMesh.h"
 #include <glm.hpp>
 
 class CWaterSurface:
 	public RenderableObject
 {
 public:
-	CWaterSurface(int width=100, int depth=100, float wsW=4, float wsH=4);
+	CWaterSurface(int width=100, int depth=100, float wsW=4, float wsH=4, GridMesh::Layout layout=GridMesh::OPTIMIZED_TRIANGLES);
 	virtual ~CWaterSurface(void);
 
 	int GetTotalVertices();
@@ -16,6 +17,9 @@ public:
 	void FillVertexBuffer( GLfloat* pBuffer);
 	void FillIndexBuffer( GLuint* pBuffer); 
 
+	bool UsesPrimitiveRestart();
+	bool IsCacheOptimized();
+
 	void SetCustomUniforms();
 
 	void SetTime(const float t);  
@@ -23,8 +27,10 @@ public:
 
 private:
 	int width, depth;
+	GridMesh::Layout layout;
 	float wsSizeX, wsSizeZ;
 	float time; 
 	glm::vec3 eyePos;
+	GLSLShader::UniformHandle timeUniform;
 };
 
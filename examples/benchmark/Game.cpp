@@ -0,0 +1,1306 @@
+#include <iostream>
+#include <sstream>
+#include <string.h>
+#include <stdlib.h>
+
+// Include GLEW
+#include <GL/glew.h>
+
+#include <assert.h>
+
+#include "Game.h"
+#include "InputHandler.h"
+#include "opengl/GLSLPreprocessor.h"
+#include "opengl/RenderQueue.h"
+#include "opengl/FreeCamera.h"
+#include "opengl/AABBTree.h"
+#include "opengl/OceanSimulation.h"
+#include "opengl/MeshOptimizer.h"
+#include "opengl/GridMesh.h"
+#include "opengl/TaskPool.h"
+#include "opengl/TextureLoader.h"
+#include "opengl/TextureCooker.h"
+#include "opengl/TextureCache.h"
+#include "opengl/ImageOps.h"
+#include <thread>
+#include <atomic>
+
+using namespace std;
+
+#define GL_CHECK_ERRORS assert(glGetError()==GL_NO_ERROR);
+
+//simulated frames per benchmark
+const int BENCH_FRAMES = 100;
+
+Game* Game::s_pInstance = 0;
+
+//milliseconds elapsed since start, using the high resolution counter
+double elapsedMs(Uint64 start)
+{
+    return (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+void printResult(const char* name, double totalMs, int frames)
+{
+    if (frames > 1) {
+        cout << "\t" << name << ": " << totalMs / frames << " ms/frame" << endl;
+    } else {
+        cout << "\t" << name << ": " << totalMs << " ms" << endl;
+    }
+}
+
+//10k uniform sets per frame through the string lookup and through handles
+void benchUniforms()
+{
+    const int SETS_PER_FRAME = 10000;
+
+    GLSLShader shader;
+    shader.LoadFromFile(GL_VERTEX_SHADER, "shaders/uniform.vert");
+    shader.LoadFromFile(GL_FRAGMENT_SHADER, "shaders/uniform.frag");
+    shader.CreateAndLinkProgram();
+    shader.Use();
+    shader.AddUniform("MVP");
+    shader.AddUniform("time");
+    GLSLShader::UniformHandle mvpUniform = shader.GetUniform("MVP");
+    GLSLShader::UniformHandle timeUniform = shader.GetUniform("time");
+
+    cout << "Uniform updates, " << SETS_PER_FRAME << " sets per frame:" << endl;
+
+    glm::mat4 MVP = glm::mat4(1);
+    Uint64 start = SDL_GetPerformanceCounter();
+    for (int f = 0; f < BENCH_FRAMES; f++) {
+        for (int i = 0; i < SETS_PER_FRAME / 2; i++) {
+            MVP[3][0] = float(i);
+            glUniformMatrix4fv(shader("MVP"), 1, GL_FALSE, glm::value_ptr(MVP));
+            glUniform1f(shader("time"), float(i));
+        }
+    }
+    glFinish();
+    printResult("string lookup", elapsedMs(start), BENCH_FRAMES);
+
+    start = SDL_GetPerformanceCounter();
+    for (int f = 0; f < BENCH_FRAMES; f++) {
+        for (int i = 0; i < SETS_PER_FRAME / 2; i++) {
+            MVP[3][0] = float(i);
+            shader.SetUniform(mvpUniform, MVP);
+            shader.SetUniform(timeUniform, float(i));
+        }
+    }
+    glFinish();
+    printResult("handles, changing values", elapsedMs(start), BENCH_FRAMES);
+
+    //same values every set, the cache skips all but the first upload
+    start = SDL_GetPerformanceCounter();
+    for (int f = 0; f < BENCH_FRAMES; f++) {
+        for (int i = 0; i < SETS_PER_FRAME / 2; i++) {
+            shader.SetUniform(mvpUniform, MVP);
+            shader.SetUniform(timeUniform, 1.0f);
+        }
+    }
+    glFinish();
+    printResult("handles, repeated values", elapsedMs(start), BENCH_FRAMES);
+
+    shader.UnUse();
+    shader.DeleteShaderProgram();
+}
+
+//give every program a distinct source so no driver side cache can answer
+string seededSource(const string& source, int seed)
+{
+    size_t version = source.find('\n');
+    ostringstream define;
+    define << "#define SEED " << seed << "\n";
+    return source.substr(0, version + 1) + define.str() + source.substr(version + 1);
+}
+
+//startup cost of N programs compiled one by one and submitted as one batch
+void benchShaderCompile()
+{
+    const int PROGRAMS = 32;
+
+    string vertexSource, fragmentSource;
+    GLSLPreprocessor::ReadFile("shaders/uniform.vert", vertexSource);
+    GLSLPreprocessor::ReadFile("shaders/uniform.frag", fragmentSource);
+
+    //a fresh seed range per run keeps the two modes apart as well
+    int seed = static_cast<int>(SDL_GetTicks());
+
+    cout << "Compile and link " << PROGRAMS << " programs:" << endl;
+
+    GLSLShader serial[PROGRAMS];
+    Uint64 start = SDL_GetPerformanceCounter();
+    for (int i = 0; i < PROGRAMS; i++) {
+        serial[i].LoadFromString(GL_VERTEX_SHADER, seededSource(vertexSource, seed++));
+        serial[i].LoadFromString(GL_FRAGMENT_SHADER, seededSource(fragmentSource, seed++));
+        serial[i].CreateAndLinkProgram();
+    }
+    printResult("serial", elapsedMs(start), 1);
+
+    GLSLShader batched[PROGRAMS];
+    GLSLShader* batch[PROGRAMS];
+    start = SDL_GetPerformanceCounter();
+    for (int i = 0; i < PROGRAMS; i++) {
+        batched[i].LoadFromString(GL_VERTEX_SHADER, seededSource(vertexSource, seed++));
+        batched[i].LoadFromString(GL_FRAGMENT_SHADER, seededSource(fragmentSource, seed++));
+        batch[i] = &batched[i];
+    }
+    GLSLShader::CreateAndLinkPrograms(batch, PROGRAMS);
+    printResult("batched", elapsedMs(start), 1);
+
+    for (int i = 0; i < PROGRAMS; i++) {
+        serial[i].DeleteShaderProgram();
+        batched[i].DeleteShaderProgram();
+    }
+}
+
+//skybox sized cube with the benchmark shaders, instanced when the vertex
+//shader takes instanceMVP
+class CBenchCube:public RenderableObject
+{
+public:
+    CBenchCube(const string& vertexShader)
+    {
+        shader.LoadFromFile(GL_VERTEX_SHADER, vertexShader);
+        shader.LoadFromFile(GL_FRAGMENT_SHADER, "shaders/cube.frag");
+        shader.CreateAndLinkProgram();
+        Init();
+    }
+
+    int GetTotalVertices() { return 8; }
+    int GetTotalIndices() { return 6*2*3; }
+    GLenum GetPrimitiveType() { return GL_TRIANGLES; }
+
+    //corner i has x, y and z from bits 0, 1 and 2
+    void FillVertexBuffer(GLfloat* pBuffer)
+    {
+        for (int i = 0; i < 8; i++) {
+            *pBuffer++ = (i & 1) ? 0.5f : -0.5f;
+            *pBuffer++ = (i & 2) ? 0.5f : -0.5f;
+            *pBuffer++ = (i & 4) ? 0.5f : -0.5f;
+        }
+    }
+
+    void FillIndexBuffer(GLuint* pBuffer)
+    {
+        static const GLuint indices[6*2*3] = {
+            0,4,5, 5,1,0,   2,3,7, 7,6,2,   4,6,7, 7,5,4,
+            0,1,3, 3,2,0,   0,2,6, 6,4,0,   1,5,7, 7,3,1};
+        memcpy(pBuffer, indices, sizeof(indices));
+    }
+};
+
+//size x size quads in one of the GridMesh layouts
+class CBenchGrid:public RenderableObject
+{
+public:
+    //without init the caller runs Generate and Upload
+    CBenchGrid(int gridSize, GridMesh::Layout gridLayout = GridMesh::TRIANGLES, bool init = true):size(gridSize), layout(gridLayout)
+    {
+        shader.LoadFromFile(GL_VERTEX_SHADER, "shaders/cube.vert");
+        shader.LoadFromFile(GL_FRAGMENT_SHADER, "shaders/cube.frag");
+        shader.CreateAndLinkProgram();
+        if (init) {
+            Init();
+        }
+    }
+
+    int GetTotalVertices() { return GridMesh::GetVertexCount(size, size); }
+    int GetTotalIndices() { return GridMesh::GetIndexCount(size, size, layout); }
+    GLenum GetPrimitiveType() { return GridMesh::GetPrimitiveType(layout); }
+    bool UsesPrimitiveRestart() { return GridMesh::UsesPrimitiveRestart(layout); }
+    bool IsCacheOptimized() { return layout == GridMesh::OPTIMIZED_TRIANGLES; }
+
+    void FillVertexBuffer(GLfloat* pBuffer)
+    {
+        GridMesh::FillVertices((glm::vec3*)pBuffer, size, size, glm::vec2(-0.5f), glm::vec2(1.0f / size));
+    }
+
+    void FillIndexBuffer(GLuint* pBuffer)
+    {
+        GridMesh::FillIndices(pBuffer, size, size, layout);
+    }
+
+private:
+    int size;
+    GridMesh::Layout layout;
+};
+
+//10k cubes drawn one Render each and through the render queue
+void benchRenderQueue()
+{
+    const int GRID = 100;
+
+    glm::mat4 P = glm::perspective(45.0f, 4.0f / 3.0f, 0.1f, 1000.0f);
+    glm::mat4 V = glm::lookAt(glm::vec3(0, 40, 120), glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
+    vector<glm::mat4> MVPs;
+    for (int z = 0; z < GRID; z++) {
+        for (int x = 0; x < GRID; x++) {
+            glm::mat4 M = glm::translate(glm::mat4(1), glm::vec3(x - GRID / 2, 0, z - GRID / 2));
+            MVPs.push_back(P * V * M);
+        }
+    }
+
+    CBenchCube cube("shaders/cube.vert");
+    CBenchCube instancedCube("shaders/cube_instanced.vert");
+    RenderQueue queue;
+
+    cout << "Draw " << MVPs.size() << " cubes, CPU time:" << endl;
+
+    double cpuMs = 0;
+    for (int f = 0; f < BENCH_FRAMES; f++) {
+        Uint64 start = SDL_GetPerformanceCounter();
+        for (size_t i = 0; i < MVPs.size(); i++) {
+            cube.Render(glm::value_ptr(MVPs[i]));
+        }
+        cpuMs += elapsedMs(start);
+        glFinish();
+    }
+    printResult("Render per object", cpuMs, BENCH_FRAMES);
+    cout << "\t\t" << MVPs.size() << " draw calls, " << MVPs.size() << " program and vao binds" << endl;
+
+    //same program for every cube, sorting saves the binds but not the draws
+    CBenchCube* objects[2] = {&cube, &instancedCube};
+    const char* names[2] = {"queue, uniform MVP", "queue, instanced"};
+    for (int n = 0; n < 2; n++) {
+        cpuMs = 0;
+        for (int f = 0; f < BENCH_FRAMES; f++) {
+            Uint64 start = SDL_GetPerformanceCounter();
+            for (size_t i = 0; i < MVPs.size(); i++) {
+                queue.Submit(objects[n], MVPs[i]);
+            }
+            queue.Flush();
+            cpuMs += elapsedMs(start);
+            glFinish();
+        }
+        printResult(names[n], cpuMs, BENCH_FRAMES);
+        const RenderQueue::Stats& stats = queue.GetStats();
+        cout << "\t\t" << stats.drawCalls << " draw calls, " << stats.programBinds << " program binds, " << stats.vaoBinds << " vao binds" << endl;
+    }
+
+    const StreamBuffer::Stats& stream = queue.GetInstanceStream().GetStats();
+    cout << "\tinstance stream " << (queue.GetInstanceStream().IsPersistent() ? "persistent" : "orphaned")
+         << ": " << stream.stalls << " stalls in " << stream.frames << " frames, " << stream.stallMs << " ms waiting, "
+         << stream.overflows << " overflows" << endl;
+}
+
+//uniform random float in [min, max)
+float randomRange(float min, float max)
+{
+    return min + (max - min) * (rand() / (RAND_MAX + 1.0f));
+}
+
+//1M spheres and boxes culled per object, in batches and in batches with
+//plane hints, then the batch results are checked against the scalar tests
+void benchFrustumCulling()
+{
+    const int OBJECTS = 1000000;
+    const int WORDS = (OBJECTS + 31) / 32;
+
+    srand(1);
+    vector<float> x(OBJECTS), y(OBJECTS), z(OBJECTS), radius(OBJECTS);
+    vector<float> minX(OBJECTS), minY(OBJECTS), minZ(OBJECTS), maxX(OBJECTS), maxY(OBJECTS), maxZ(OBJECTS);
+    //filled cell by cell on a 32x32 grid, so neighbours in the arrays are
+    //neighbours in space like objects gathered from a spatial structure
+    const float CELL = 1000.0f / 32;
+    for (int i = 0; i < OBJECTS; i++) {
+        int cell = i / 1000;
+        x[i] = (cell % 32) * CELL - 500 + randomRange(0, CELL);
+        y[i] = randomRange(-50, 50);
+        z[i] = (cell / 32) * CELL - 500 + randomRange(0, CELL);
+        radius[i] = randomRange(0.5f, 5.0f);
+        minX[i] = x[i] - radius[i]; maxX[i] = x[i] + radius[i];
+        minY[i] = y[i] - radius[i]; maxY[i] = y[i] + radius[i];
+        minZ[i] = z[i] - radius[i]; maxZ[i] = z[i] + radius[i];
+    }
+    vector<unsigned int> visible(WORDS), reference(WORDS);
+    vector<unsigned char> hints((OBJECTS + 3) / 4, 0);
+
+    CFreeCamera camera;
+    camera.SetupProjection(45, 4.0f / 3.0f, 0.1f, 1000.0f);
+    camera.SetPosition(glm::vec3(0, 0, 0));
+
+    cout << "Cull " << OBJECTS << " spheres:" << endl;
+
+    //the camera turns a little every frame so hints go stale at the edges
+    double ms = 0;
+    for (int f = 0; f < BENCH_FRAMES; f++) {
+        camera.Rotate(f * 0.5f, 0, 0);
+        camera.CalcFrustumPlanes();
+        Uint64 start = SDL_GetPerformanceCounter();
+        memset(&reference[0], 0, WORDS * sizeof(unsigned int));
+        for (int i = 0; i < OBJECTS; i++) {
+            if (camera.IsSphereInFrustum(glm::vec3(x[i], y[i], z[i]), radius[i])) {
+                reference[i >> 5] |= 1u << (i & 31);
+            }
+        }
+        ms += elapsedMs(start);
+    }
+    printResult("IsSphereInFrustum per object", ms, BENCH_FRAMES);
+
+    ms = 0;
+    for (int f = 0; f < BENCH_FRAMES; f++) {
+        camera.Rotate(f * 0.5f, 0, 0);
+        camera.CalcFrustumPlanes();
+        Uint64 start = SDL_GetPerformanceCounter();
+        camera.CullSpheresScalar(&x[0], &y[0], &z[0], &radius[0], OBJECTS, &visible[0]);
+        ms += elapsedMs(start);
+    }
+    printResult("batch, scalar", ms, BENCH_FRAMES);
+
+    for (int pass = 0; pass < 2; pass++) {
+        unsigned char* planeHints = pass ? &hints[0] : 0;
+        ms = 0;
+        for (int f = 0; f < BENCH_FRAMES; f++) {
+            camera.Rotate(f * 0.5f, 0, 0);
+            camera.CalcFrustumPlanes();
+            Uint64 start = SDL_GetPerformanceCounter();
+            camera.CullSpheres(&x[0], &y[0], &z[0], &radius[0], OBJECTS, &visible[0], planeHints);
+            ms += elapsedMs(start);
+        }
+        printResult(pass ? "batch, SSE with plane hints" : "batch, SSE", ms, BENCH_FRAMES);
+    }
+
+    cout << "Cull " << OBJECTS << " boxes:" << endl;
+    fill(hints.begin(), hints.end(), 0);
+    for (int pass = 0; pass < 2; pass++) {
+        unsigned char* planeHints = pass ? &hints[0] : 0;
+        ms = 0;
+        for (int f = 0; f < BENCH_FRAMES; f++) {
+            camera.Rotate(f * 0.5f, 0, 0);
+            camera.CalcFrustumPlanes();
+            Uint64 start = SDL_GetPerformanceCounter();
+            camera.CullBoxes(&minX[0], &minY[0], &minZ[0], &maxX[0], &maxY[0], &maxZ[0], OBJECTS, &visible[0], planeHints);
+            ms += elapsedMs(start);
+        }
+        printResult(pass ? "batch, SSE with plane hints" : "batch, SSE", ms, BENCH_FRAMES);
+    }
+
+    //the last frame's box mask, with hints, against IsBoxInFrustum
+    int boxErrors = 0;
+    for (int i = 0; i < OBJECTS; i++) {
+        bool expected = camera.IsBoxInFrustum(glm::vec3(minX[i], minY[i], minZ[i]), glm::vec3(maxX[i], maxY[i], maxZ[i]));
+        if (expected != ((visible[i >> 5] >> (i & 31)) & 1)) {
+            boxErrors++;
+        }
+    }
+
+    //odd counts exercise the scalar tail of the SSE path
+    int sphereErrors = 0;
+    const int counts[3] = {OBJECTS, OBJECTS - 1, 7};
+    for (int c = 0; c < 3; c++) {
+        camera.CullSpheres(&x[0], &y[0], &z[0], &radius[0], counts[c], &visible[0], &hints[0]);
+        for (int i = 0; i < counts[c]; i++) {
+            bool expected = camera.IsSphereInFrustum(glm::vec3(x[i], y[i], z[i]), radius[i]);
+            if (expected != ((visible[i >> 5] >> (i & 31)) & 1)) {
+                sphereErrors++;
+            }
+        }
+    }
+    cout << "\tmismatches against the scalar tests: " << sphereErrors << " spheres, " << boxErrors << " boxes" << endl;
+
+    //hints carried from frame to frame have to mean the same on both paths
+    vector<unsigned char> scalarHints(hints.size());
+    vector<unsigned int> scalarVisible(WORDS);
+    int hintErrors[2] = {0, 0};
+    for (int volume = 0; volume < 2; volume++) {
+        fill(hints.begin(), hints.end(), 0);
+        fill(scalarHints.begin(), scalarHints.end(), 0);
+        for (int f = 0; f < BENCH_FRAMES; f++) {
+            camera.Rotate(f * 0.5f, 0, 0);
+            camera.CalcFrustumPlanes();
+            if (volume == 0) {
+                camera.CullSpheresScalar(&x[0], &y[0], &z[0], &radius[0], OBJECTS - 1, &scalarVisible[0], &scalarHints[0]);
+                camera.CullSpheres(&x[0], &y[0], &z[0], &radius[0], OBJECTS - 1, &visible[0], &hints[0]);
+            } else {
+                camera.CullBoxesScalar(&minX[0], &minY[0], &minZ[0], &maxX[0], &maxY[0], &maxZ[0], OBJECTS - 1, &scalarVisible[0], &scalarHints[0]);
+                camera.CullBoxes(&minX[0], &minY[0], &minZ[0], &maxX[0], &maxY[0], &maxZ[0], OBJECTS - 1, &visible[0], &hints[0]);
+            }
+            for (size_t i = 0; i < hints.size(); i++) {
+                hintErrors[volume] += (hints[i] != scalarHints[i]) ? 1 : 0;
+            }
+            for (int i = 0; i < WORDS; i++) {
+                hintErrors[volume] += (visible[i] != scalarVisible[i]) ? 1 : 0;
+            }
+        }
+    }
+    cout << "\thint or mask differences between the scalar and SSE paths: " << hintErrors[0] << " spheres, " << hintErrors[1] << " boxes" << endl;
+}
+
+//objects scattered over a 4km square, most of them off screen, culled by
+//the tree and by the linear SSE batch, then moved a little every frame
+void benchAABBTree()
+{
+    const int TREE_FRAMES = 10;
+    const int sizes[3] = {10000, 100000, 1000000};
+
+    CFreeCamera camera;
+    camera.SetupProjection(45, 4.0f / 3.0f, 0.1f, 1000.0f);
+    camera.SetPosition(glm::vec3(0, 0, 0));
+
+    for (int s = 0; s < 3; s++) {
+        const int OBJECTS = sizes[s];
+        srand(1);
+        vector<float> minX(OBJECTS), minY(OBJECTS), minZ(OBJECTS), maxX(OBJECTS), maxY(OBJECTS), maxZ(OBJECTS);
+        vector<glm::vec3> velocity(OBJECTS);
+        for (int i = 0; i < OBJECTS; i++) {
+            glm::vec3 center(randomRange(-2000, 2000), randomRange(-50, 50), randomRange(-2000, 2000));
+            float size = randomRange(0.5f, 5.0f);
+            minX[i] = center.x - size; maxX[i] = center.x + size;
+            minY[i] = center.y - size; maxY[i] = center.y + size;
+            minZ[i] = center.z - size; maxZ[i] = center.z + size;
+            velocity[i] = glm::vec3(randomRange(-0.1f, 0.1f), 0, randomRange(-0.1f, 0.1f));
+        }
+        vector<unsigned int> mask((OBJECTS + 31) / 32);
+        vector<int> visible;
+        visible.reserve(OBJECTS);
+
+        cout << "AABB tree, " << OBJECTS << " objects:" << endl;
+
+        CAABBTree tree(0.5f);
+        vector<int> proxies(OBJECTS);
+        Uint64 start = SDL_GetPerformanceCounter();
+        for (int i = 0; i < OBJECTS; i++) {
+            proxies[i] = tree.CreateProxy(glm::vec3(minX[i], minY[i], minZ[i]), glm::vec3(maxX[i], maxY[i], maxZ[i]), i);
+        }
+        printResult("build", elapsedMs(start), 1);
+        start = SDL_GetPerformanceCounter();
+        tree.Optimize();
+        printResult("optimize", elapsedMs(start), 1);
+
+        double linearMs = 0, cullMs = 0;
+        for (int f = 0; f < TREE_FRAMES; f++) {
+            camera.Rotate(f * 10.0f, 0, 0);
+            glm::vec4 planes[6];
+            camera.GetFrustumPlanes(planes);
+
+            start = SDL_GetPerformanceCounter();
+            camera.CullBoxes(&minX[0], &minY[0], &minZ[0], &maxX[0], &maxY[0], &maxZ[0], OBJECTS, &mask[0]);
+            linearMs += elapsedMs(start);
+
+            visible.clear();
+            start = SDL_GetPerformanceCounter();
+            tree.CullFrustum(planes, visible);
+            cullMs += elapsedMs(start);
+        }
+        printResult("static, linear SSE cull", linearMs, TREE_FRAMES);
+        printResult("static, tree cull", cullMs, TREE_FRAMES);
+        cout << "\t\t" << visible.size() << " visible, " << tree.GetNodesTested() << " nodes tested, height " << tree.GetHeight() << endl;
+
+        double moveMs = 0;
+        int reinserted = 0;
+        cullMs = 0;
+        for (int f = 0; f < TREE_FRAMES; f++) {
+            start = SDL_GetPerformanceCounter();
+            for (int i = 0; i < OBJECTS; i++) {
+                minX[i] += velocity[i].x; maxX[i] += velocity[i].x;
+                minZ[i] += velocity[i].z; maxZ[i] += velocity[i].z;
+                if (tree.MoveProxy(proxies[i], glm::vec3(minX[i], minY[i], minZ[i]), glm::vec3(maxX[i], maxY[i], maxZ[i]))) {
+                    reinserted++;
+                }
+            }
+            moveMs += elapsedMs(start);
+
+            camera.Rotate(f * 10.0f, 0, 0);
+            glm::vec4 planes[6];
+            camera.GetFrustumPlanes(planes);
+            visible.clear();
+            start = SDL_GetPerformanceCounter();
+            tree.CullFrustum(planes, visible);
+            cullMs += elapsedMs(start);
+        }
+        printResult("moving, update", moveMs, TREE_FRAMES);
+        printResult("moving, tree cull", cullMs, TREE_FRAMES);
+        cout << "\t\t" << reinserted / TREE_FRAMES << " reinserts per frame, height " << tree.GetHeight() << endl;
+
+        //reinserts scatter the pool, optimizing puts it back in traversal order
+        tree.Optimize();
+        glm::vec4 planes[6];
+        camera.GetFrustumPlanes(planes);
+        visible.clear();
+        start = SDL_GetPerformanceCounter();
+        tree.CullFrustum(planes, visible);
+        printResult("moving, tree cull after optimize", elapsedMs(start), 1);
+    }
+}
+
+//FFT ocean updates on 256, 512 and 1024 grids, on one thread and on all of
+//them. The simulation makes no GL calls, this needs no context.
+void benchOcean()
+{
+    const int OCEAN_FRAMES = 20;
+    const int sizes[3] = {256, 512, 1024};
+
+    for (int s = 0; s < 3; s++) {
+        cout << "Ocean " << sizes[s] << "x" << sizes[s] << ":" << endl;
+        for (int pass = 0; pass < 2; pass++) {
+            COceanSimulation ocean(sizes[s], 1000.0f, glm::vec2(20, 0), 0.0005f, 1.0f, pass == 0 ? 1 : 0);
+            //first touch of the output arrays is not part of the timing
+            ocean.Update(0);
+
+            Uint64 start = SDL_GetPerformanceCounter();
+            for (int f = 1; f <= OCEAN_FRAMES; f++) {
+                ocean.Update(f / 60.0f);
+            }
+            ostringstream name;
+            name << ocean.GetThreadCount() << (ocean.GetThreadCount() == 1 ? " thread" : " threads");
+            printResult(name.str().c_str(), elapsedMs(start), OCEAN_FRAMES);
+            if (pass == 1) {
+                cout << "\t\tlargest displacement " << ocean.GetMaxDisplacement() << " m" << endl;
+            }
+        }
+    }
+}
+
+//grid meshes as generated, 32 bit indices in row order, and as
+//RenderableObject uploads them, cache optimized with 16 bit indices
+void benchIndexBuffers()
+{
+    const int DRAW_FRAMES = 20;
+    const int sizes[2] = {100, 1000};
+
+    glm::mat4 MVP = glm::perspective(45.0f, 4.0f / 3.0f, 0.1f, 10.0f) *
+                    glm::lookAt(glm::vec3(0, 0.5f, 0.8f), glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
+
+    GLSLShader shader;
+    shader.LoadFromFile(GL_VERTEX_SHADER, "shaders/cube.vert");
+    shader.LoadFromFile(GL_FRAGMENT_SHADER, "shaders/cube.frag");
+    shader.CreateAndLinkProgram();
+    shader.Use();
+    shader.AddUniform("MVP");
+    shader.SetUniform(shader.GetUniform("MVP"), MVP);
+    shader.UnUse();
+
+    for (int s = 0; s < 2; s++) {
+        int size = sizes[s];
+        cout << "Grid " << size << "x" << size << " index buffer:" << endl;
+
+        Uint64 start = SDL_GetPerformanceCounter();
+        CBenchGrid grid(size);
+        printResult("Init with optimization", elapsedMs(start), 1);
+
+        //the same mesh unoptimized, drawn from its own buffers
+        int vertexCount = grid.GetTotalVertices();
+        int indexCount = grid.GetTotalIndices();
+        vector<GLfloat> vertices(vertexCount * 3);
+        vector<GLuint> indices(indexCount);
+        grid.FillVertexBuffer(&vertices[0]);
+        grid.FillIndexBuffer(&indices[0]);
+
+        float acmrBefore = MeshOptimizer::ComputeACMR(&indices[0], indexCount, vertexCount);
+        vector<GLuint> optimized(indices);
+        MeshOptimizer::OptimizeVertexCache(&optimized[0], indexCount, vertexCount);
+        float acmrAfter = MeshOptimizer::ComputeACMR(&optimized[0], indexCount, vertexCount);
+        cout << "\t\tACMR with a 16 entry FIFO " << acmrBefore << " before, " << acmrAfter << " after" << endl;
+
+        size_t indexSize = (grid.GetIndexType() == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint);
+        cout << "\t\tindices " << indexCount * sizeof(GLuint) / 1024 << " KB before, " << indexCount * indexSize / 1024 << " KB after in "
+             << grid.GetIndexChunkCount() << (grid.GetIndexChunkCount() == 1 ? " draw" : " draws") << endl;
+
+        GLuint vao, buffers[2];
+        glGenVertexArrays(1, &vao);
+        glGenBuffers(2, buffers);
+        glBindVertexArray(vao);
+            glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+            glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), &vertices[0], GL_STATIC_DRAW);
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[1]);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(GLuint), &indices[0], GL_STATIC_DRAW);
+        glBindVertexArray(0);
+
+        //glFinish inside the timing, this measures the GPU
+        double plainMs = 0, optimizedMs = 0;
+        for (int f = 0; f < DRAW_FRAMES; f++) {
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            start = SDL_GetPerformanceCounter();
+            shader.Use();
+            glBindVertexArray(vao);
+            glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
+            glBindVertexArray(0);
+            shader.UnUse();
+            glFinish();
+            plainMs += elapsedMs(start);
+
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            start = SDL_GetPerformanceCounter();
+            grid.Render(glm::value_ptr(MVP));
+            glFinish();
+            optimizedMs += elapsedMs(start);
+        }
+        printResult("draw, 32 bit row order", plainMs, DRAW_FRAMES);
+        printResult("draw, optimized 16 bit", optimizedMs, DRAW_FRAMES);
+
+        glDeleteBuffers(2, buffers);
+        glDeleteVertexArrays(1, &vao);
+    }
+    shader.DeleteShaderProgram();
+}
+
+//triangles of a strip index stream in drawing order, for the cache simulation
+vector<GLuint> stripTriangles(const vector<GLuint>& strip)
+{
+    vector<GLuint> triangles;
+    int first = 0;
+    for (size_t i = 0; i <= strip.size(); i++) {
+        if (i < strip.size() && strip[i] != GridMesh::RESTART_INDEX) {
+            continue;
+        }
+        for (int k = first; k + 2 < (int)i; k++) {
+            triangles.push_back(strip[k]);
+            triangles.push_back(strip[k+1]);
+            triangles.push_back(strip[k+2]);
+        }
+        first = i + 1;
+    }
+    return triangles;
+}
+
+//the same grids in every GridMesh layout: index count and memory as
+//uploaded, ACMR of the generated order and GPU draw time
+void benchGridLayouts()
+{
+    const int DRAW_FRAMES = 20;
+    const int sizes[2] = {100, 1000};
+    const GridMesh::Layout layouts[3] = {GridMesh::TRIANGLES, GridMesh::TRIANGLE_STRIPS, GridMesh::OPTIMIZED_TRIANGLES};
+
+    glm::mat4 MVP = glm::perspective(45.0f, 4.0f / 3.0f, 0.1f, 10.0f) *
+                    glm::lookAt(glm::vec3(0, 0.5f, 0.8f), glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
+
+    for (int s = 0; s < 2; s++) {
+        int size = sizes[s];
+        cout << "Grid " << size << "x" << size << " layouts:" << endl;
+        for (int l = 0; l < 3; l++) {
+            cout << "\t" << GridMesh::GetLayoutName(layouts[l]) << ":" << endl;
+
+            Uint64 start = SDL_GetPerformanceCounter();
+            CBenchGrid grid(size, layouts[l]);
+            printResult("Init", elapsedMs(start), 1);
+
+            int indexCount = grid.GetTotalIndices();
+            vector<GLuint> indices(indexCount);
+            grid.FillIndexBuffer(&indices[0]);
+            if (GridMesh::UsesPrimitiveRestart(layouts[l])) {
+                indices = stripTriangles(indices);
+            } else if (!grid.IsCacheOptimized()) {
+                //what Init uploads
+                MeshOptimizer::OptimizeVertexCache(&indices[0], indexCount, grid.GetTotalVertices());
+            }
+            float acmr = MeshOptimizer::ComputeACMR(&indices[0], (int)indices.size(), grid.GetTotalVertices());
+
+            size_t indexSize = (grid.GetIndexType() == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint);
+            cout << "\t\t" << indexCount << " indices, " << indexCount * indexSize / 1024 << " KB in "
+                 << grid.GetIndexChunkCount() << (grid.GetIndexChunkCount() == 1 ? " draw" : " draws")
+                 << ", ACMR " << acmr << endl;
+
+            //glFinish inside the timing, this measures the GPU
+            double drawMs = 0;
+            for (int f = 0; f < DRAW_FRAMES; f++) {
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                start = SDL_GetPerformanceCounter();
+                grid.Render(glm::value_ptr(MVP));
+                glFinish();
+                drawMs += elapsedMs(start);
+            }
+            printResult("draw", drawMs, DRAW_FRAMES);
+        }
+    }
+}
+
+//the scalar loops CWaterSurface filled its buffers with before GridMesh
+void fillGridScalar(glm::vec3* vertices, GLuint* indices, int size)
+{
+    int count = 0;
+    for (int j = 0; j <= size; j++) {
+        for (int i = 0; i <= size; i++) {
+            vertices[count++] = glm::vec3(((float(i)/(size-1))*2-1)*0.5f, 0, ((float(j)/(size-1))*2-1)*0.5f);
+        }
+    }
+    for (int i = 0; i < size; i++) {
+        for (int j = 0; j < size; j++) {
+            GLuint i0 = i * (size+1) + j;
+            GLuint i1 = i0 + 1;
+            GLuint i2 = i0 + (size+1);
+            GLuint i3 = i2 + 1;
+            if ((j+i)%2) {
+                *indices++ = i0; *indices++ = i2; *indices++ = i1;
+                *indices++ = i1; *indices++ = i2; *indices++ = i3;
+            } else {
+                *indices++ = i0; *indices++ = i2; *indices++ = i3;
+                *indices++ = i0; *indices++ = i3; *indices++ = i1;
+            }
+        }
+    }
+}
+
+//startup cost of 1000x1000 and 4000x4000 water grids in the default
+//optimized layout: the old scalar fill for reference, Generate on one and on
+//all threads, Generate on a loader thread, and the GL upload
+void benchGridStartup()
+{
+    const int sizes[2] = {1000, 4000};
+
+    for (int s = 0; s < 2; s++) {
+        int size = sizes[s];
+        cout << "Grid " << size << "x" << size << " startup:" << endl;
+        {
+            vector<glm::vec3> vertices(GridMesh::GetVertexCount(size, size));
+            vector<GLuint> indices(GridMesh::GetIndexCount(size, size, GridMesh::TRIANGLES));
+            Uint64 start = SDL_GetPerformanceCounter();
+            fillGridScalar(&vertices[0], &indices[0], size);
+            printResult("scalar fill only", elapsedMs(start), 1);
+        }
+
+        CBenchGrid grid(size, GridMesh::OPTIMIZED_TRIANGLES, false);
+        for (int pass = 0; pass < 2; pass++) {
+            TaskPool::Instance()->SetThreadLimit(pass == 0 ? 1 : 0);
+            Uint64 start = SDL_GetPerformanceCounter();
+            grid.Generate();
+            ostringstream name;
+            int threads = TaskPool::Instance()->GetThreadCount();
+            name << "Generate, " << threads << (threads == 1 ? " thread" : " threads");
+            printResult(name.str().c_str(), elapsedMs(start), 1);
+        }
+
+        //the GL thread keeps clearing and finishing frames while a loader
+        //thread generates, the frames it fits in and the longest one show
+        //what the overlap buys
+        atomic<bool> generated(false);
+        Uint64 start = SDL_GetPerformanceCounter();
+        thread loader([&grid, &generated]() {
+            grid.Generate();
+            generated = true;
+        });
+        int frames = 0;
+        double longestMs = 0;
+        while (!generated) {
+            Uint64 frameStart = SDL_GetPerformanceCounter();
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            glFinish();
+            double frameMs = elapsedMs(frameStart);
+            longestMs = (frameMs > longestMs) ? frameMs : longestMs;
+            frames++;
+        }
+        loader.join();
+        printResult("Generate on a loader thread", elapsedMs(start), 1);
+        cout << "\t\t" << frames << " frames on the GL thread meanwhile, longest " << longestMs << " ms" << endl;
+
+        start = SDL_GetPerformanceCounter();
+        grid.Upload();
+        glFinish();
+        printResult("Upload", elapsedMs(start), 1);
+        cout << "\t\t" << grid.GetIndexChunkCount() << " draws of 16 bit indices" << endl;
+    }
+}
+
+//the skybox cube map loaded the old way, decoded and uploaded in turn on this
+//thread, and through TextureLoader with an Update per simulated frame
+void benchTextureLoader()
+{
+    const char* faces[6] = {
+        "media/skybox/ocean/posx.png",
+        "media/skybox/ocean/negx.png",
+        "media/skybox/ocean/posy.png",
+        "media/skybox/ocean/negy.png",
+        "media/skybox/ocean/posz.png",
+        "media/skybox/ocean/negz.png"};
+
+    cout << "Skybox cube map:" << endl;
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+    Uint64 start = SDL_GetPerformanceCounter();
+    for (int i = 0; i < 6; i++) {
+        int width, height, channels;
+        GLubyte* pixels = SOIL_load_image(faces[i], &width, &height, &channels, SOIL_LOAD_AUTO);
+        GLenum format = (channels == 4) ? GL_RGBA : GL_RGB;
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, pixels);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        SOIL_free_image_data(pixels);
+    }
+    glFinish();
+    printResult("serial load before the first frame", elapsedMs(start), 1);
+    glDeleteTextures(1, &texture);
+
+    start = SDL_GetPerformanceCounter();
+    TextureLoader* loader = new TextureLoader();
+    int cubemap = loader->LoadCubemap(faces);
+    printResult("TextureLoader before the first frame", elapsedMs(start), 1);
+
+    //a frame is an Update, the longest one is the worst hitch
+    int frames = 0;
+    double longestMs = 0;
+    while (loader->IsBusy()) {
+        Uint64 frameStart = SDL_GetPerformanceCounter();
+        loader->Update();
+        glFinish();
+        double frameMs = elapsedMs(frameStart);
+        longestMs = (frameMs > longestMs) ? frameMs : longestMs;
+        frames++;
+        SDL_Delay(1);
+    }
+    printResult("TextureLoader until complete", elapsedMs(start), 1);
+    cout << "\t\t" << frames << " frames, longest Update " << longestMs << " ms" << endl;
+    loader->PrintTimings(cubemap, cout);
+    delete loader;
+}
+
+//an image loaded the old way, decoded, flipped and uploaded with the mip chain
+//built by the driver, against cache files cooked in each format
+void benchTextureCache()
+{
+    const char* images[2] = {"media/Lenna.png", "media/skybox/ocean/posx.png"};
+    const char* cached[2] = {"texturecache/bench_lenna", "texturecache/bench_posx"};
+    TextureCooker::Format formats[3] = {TextureCooker::FORMAT_RGBA8, TextureCooker::FORMAT_BC1, TextureCooker::FORMAT_BC3};
+    const int runs = 5;
+
+    for (int i = 0; i < 2; i++) {
+        cout << "Texture " << images[i] << ":" << endl;
+        double totalMs = 0;
+        for (int run = 0; run < runs; run++) {
+            Uint64 start = SDL_GetPerformanceCounter();
+            int width, height, channels;
+            GLubyte* pixels = SOIL_load_image(images[i], &width, &height, &channels, SOIL_LOAD_AUTO);
+            if (pixels == 0) {
+                cout << "\tcannot load the image" << endl;
+                return;
+            }
+            int rowBytes = width * channels;
+            vector<GLubyte> row(rowBytes);
+            for (int y = 0; y * 2 < height - 1; y++) {
+                memcpy(&row[0], pixels + y * rowBytes, rowBytes);
+                memcpy(pixels + y * rowBytes, pixels + (height - 1 - y) * rowBytes, rowBytes);
+                memcpy(pixels + (height - 1 - y) * rowBytes, &row[0], rowBytes);
+            }
+            GLenum format = (channels == 4) ? GL_RGBA : GL_RGB;
+            GLuint texture;
+            glGenTextures(1, &texture);
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, pixels);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+            glGenerateMipmap(GL_TEXTURE_2D);
+            glFinish();
+            totalMs += elapsedMs(start);
+            SOIL_free_image_data(pixels);
+            glDeleteTextures(1, &texture);
+        }
+        printResult("SOIL decode, flip and upload", totalMs / runs, 1);
+
+        for (int f = 0; f < 3; f++) {
+            if (formats[f] != TextureCooker::FORMAT_RGBA8 && !TextureCache::SupportsBlockCompression()) {
+                continue;
+            }
+            const char* name = TextureCooker::GetFormatName(formats[f]);
+            stringstream file;
+            file << cached[i] << "_" << name << ".txc";
+            Uint64 start = SDL_GetPerformanceCounter();
+            TextureCooker::Cook(images[i], file.str(), formats[f]);
+            double cookMs = elapsedMs(start);
+
+            totalMs = 0;
+            for (int run = 0; run < runs; run++) {
+                start = SDL_GetPerformanceCounter();
+                GLuint texture = TextureCache::Load(file.str());
+                glFinish();
+                totalMs += elapsedMs(start);
+                glDeleteTextures(1, &texture);
+            }
+            stringstream label;
+            label << "cooked " << name << " load";
+            printResult(label.str().c_str(), totalMs / runs, 1);
+
+            FILE* fp = fopen(file.str().c_str(), "rb");
+            long size = 0;
+            if (fp != 0) {
+                fseek(fp, 0, SEEK_END);
+                size = ftell(fp);
+                fclose(fp);
+            }
+            cout << "\t\tcooked once in " << cookMs << " ms, " << size / 1024 << " KB with mips" << endl;
+        }
+    }
+}
+
+//the byte at a time flip load_image used to do
+void flipRowsBytewise(GLubyte* pixels, int width, int height, int channels)
+{
+    for (int j = 0; j * 2 < height; ++j) {
+        int index1 = j * width * channels;
+        int index2 = (height - 1 - j) * width * channels;
+        for (int i = width * channels; i > 0; --i) {
+            GLubyte temp = pixels[index1];
+            pixels[index1] = pixels[index2];
+            pixels[index2] = temp;
+            ++index1;
+            ++index2;
+        }
+    }
+}
+
+//image kernels on Lenna and on the six ocean faces together, and a 2D upload
+//with a separate flip pass against the flip fused into the copy into a pixel
+//unpack buffer
+void benchImageOps()
+{
+    const char* sets[2][7] = {
+        {"media/Lenna.png", 0},
+        {"media/skybox/ocean/posx.png", "media/skybox/ocean/negx.png", "media/skybox/ocean/posy.png",
+         "media/skybox/ocean/negy.png", "media/skybox/ocean/posz.png", "media/skybox/ocean/negz.png", 0}};
+    const char* names[2] = {"Lenna", "ocean cube map faces"};
+    const int runs = 5;
+
+    for (int set = 0; set < 2; set++) {
+        cout << "Image kernels, " << names[set] << ":" << endl;
+        double flipBytewiseMs = 0, flipMs = 0, expandScalarMs = 0, expandMs = 0, srgbMs = 0, premultiplyMs = 0;
+        double uploadMs = 0, fusedUploadMs = 0;
+        for (int i = 0; sets[set][i] != 0; i++) {
+            int width, height, channels;
+            GLubyte* pixels = SOIL_load_image(sets[set][i], &width, &height, &channels, SOIL_LOAD_AUTO);
+            if (pixels == 0) {
+                cout << "\tcannot load " << sets[set][i] << endl;
+                return;
+            }
+            int texels = width * height;
+            vector<GLubyte> rgba(texels * 4);
+
+            for (int run = 0; run < runs; run++) {
+                Uint64 start = SDL_GetPerformanceCounter();
+                flipRowsBytewise(pixels, width, height, channels);
+                flipBytewiseMs += elapsedMs(start);
+
+                start = SDL_GetPerformanceCounter();
+                ImageOps::FlipRows(pixels, width * channels, height);
+                flipMs += elapsedMs(start);
+
+                start = SDL_GetPerformanceCounter();
+                for (int t = 0; t < texels; t++) {
+                    for (int c = 0; c < 4; c++) {
+                        rgba[t * 4 + c] = (c < channels) ? pixels[t * channels + c] : 255;
+                    }
+                }
+                expandScalarMs += elapsedMs(start);
+
+                start = SDL_GetPerformanceCounter();
+                ImageOps::ExpandToRGBA(pixels, channels, &rgba[0], texels);
+                expandMs += elapsedMs(start);
+
+                start = SDL_GetPerformanceCounter();
+                ImageOps::SRGBToLinear(&rgba[0], texels);
+                srgbMs += elapsedMs(start);
+
+                start = SDL_GetPerformanceCounter();
+                ImageOps::PremultiplyAlpha(&rgba[0], texels);
+                premultiplyMs += elapsedMs(start);
+            }
+
+            GLuint texture;
+            glGenTextures(1, &texture);
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+            StreamBuffer stream;
+            stream.Create(GLsizeiptr(texels) * 4);
+            GLenum format = (channels == 4) ? GL_RGBA : GL_RGB;
+            for (int run = 0; run < runs; run++) {
+                Uint64 start = SDL_GetPerformanceCounter();
+                ImageOps::FlipRows(pixels, width * channels, height);
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format, GL_UNSIGNED_BYTE, pixels);
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+                glFinish();
+                uploadMs += elapsedMs(start);
+
+                start = SDL_GetPerformanceCounter();
+                stream.BeginFrame();
+                StreamBuffer::Allocation allocation = stream.Allocate(GLsizeiptr(texels) * 4, 4);
+                ImageOps::CopyRowsToRGBA(pixels, channels, width, height, static_cast<unsigned char*>(allocation.ptr), true);
+                stream.Unmap();
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stream.GetBuffer());
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, reinterpret_cast<const GLvoid*>(allocation.offset));
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                stream.EndFrame();
+                glFinish();
+                fusedUploadMs += elapsedMs(start);
+            }
+            stream.Destroy();
+            glDeleteTextures(1, &texture);
+            SOIL_free_image_data(pixels);
+        }
+        printResult("byte at a time flip", flipBytewiseMs / runs, 1);
+        printResult("FlipRows", flipMs / runs, 1);
+        printResult("scalar channel expansion", expandScalarMs / runs, 1);
+        printResult("ExpandToRGBA", expandMs / runs, 1);
+        printResult("SRGBToLinear", srgbMs / runs, 1);
+        printResult("PremultiplyAlpha", premultiplyMs / runs, 1);
+        printResult("flip pass and upload", uploadMs / runs, 1);
+        printResult("flip fused into the unpack buffer copy and upload", fusedUploadMs / runs, 1);
+    }
+}
+
+//TaskPool work from one thread up to all of them: a 2000x2000 grid, 1M
+//spheres culled, a 2048x2048 image compressed to BC1, and 64 small grids
+//generated at once, each splitting its own rows again
+void benchJobScaling()
+{
+    const int GRID = 2000;
+    const int OBJECTS = 1000000;
+    const int IMAGE = 2048;
+    const int SMALL_GRIDS = 64;
+    const int SMALL_GRID = 250;
+    const int runs = 3;
+
+    vector<glm::vec3> vertices(GridMesh::GetVertexCount(GRID, GRID));
+    vector<GLuint> indices(GridMesh::GetIndexCount(GRID, GRID, GridMesh::OPTIMIZED_TRIANGLES));
+
+    srand(1);
+    vector<float> x(OBJECTS), y(OBJECTS), z(OBJECTS), radius(OBJECTS);
+    for (int i = 0; i < OBJECTS; i++) {
+        x[i] = randomRange(-500, 500);
+        y[i] = randomRange(-50, 50);
+        z[i] = randomRange(-500, 500);
+        radius[i] = randomRange(0.5f, 5.0f);
+    }
+    vector<unsigned int> visible((OBJECTS + 31) / 32);
+    CFreeCamera camera;
+    camera.SetupProjection(45, 4.0f / 3.0f, 0.1f, 1000.0f);
+    camera.SetPosition(glm::vec3(0, 0, 0));
+    camera.CalcFrustumPlanes();
+
+    vector<GLubyte> image(IMAGE * IMAGE * 4);
+    for (int t = 0; t < IMAGE * IMAGE; t++) {
+        int i = t % IMAGE, j = t / IMAGE;
+        image[t * 4] = GLubyte(i * 255 / IMAGE);
+        image[t * 4 + 1] = GLubyte(j * 255 / IMAGE);
+        image[t * 4 + 2] = GLubyte((i ^ j) & 255);
+        image[t * 4 + 3] = 255;
+    }
+    vector<GLubyte> blocks(TextureCooker::GetCompressedSize(TextureCooker::FORMAT_BC1, IMAGE, IMAGE));
+
+    vector<vector<glm::vec3> > smallVertices(SMALL_GRIDS, vector<glm::vec3>(GridMesh::GetVertexCount(SMALL_GRID, SMALL_GRID)));
+    vector<vector<GLuint> > smallIndices(SMALL_GRIDS, vector<GLuint>(GridMesh::GetIndexCount(SMALL_GRID, SMALL_GRID, GridMesh::OPTIMIZED_TRIANGLES)));
+
+    TaskPool* pool = TaskPool::Instance();
+    int maxThreads = pool->GetMaxThreadCount();
+    cout << "Job system scaling, up to " << maxThreads << " threads:" << endl;
+    double oneThreadMs[4] = {0, 0, 0, 0};
+    for (int threads = 1; threads <= maxThreads; threads++) {
+        pool->SetThreadLimit(threads);
+        double ms[4] = {0, 0, 0, 0};
+        for (int run = 0; run < runs; run++) {
+            Uint64 start = SDL_GetPerformanceCounter();
+            GridMesh::FillVertices(&vertices[0], GRID, GRID, glm::vec2(0), glm::vec2(1));
+            GridMesh::FillIndices(&indices[0], GRID, GRID, GridMesh::OPTIMIZED_TRIANGLES);
+            ms[0] += elapsedMs(start);
+
+            start = SDL_GetPerformanceCounter();
+            camera.CullSpheres(&x[0], &y[0], &z[0], &radius[0], OBJECTS, &visible[0]);
+            ms[1] += elapsedMs(start);
+
+            start = SDL_GetPerformanceCounter();
+            TextureCooker::CompressBC1(&image[0], IMAGE, IMAGE, &blocks[0]);
+            ms[2] += elapsedMs(start);
+
+            start = SDL_GetPerformanceCounter();
+            pool->ParallelFor(SMALL_GRIDS, [&](int g) {
+                GridMesh::FillVertices(&smallVertices[g][0], SMALL_GRID, SMALL_GRID, glm::vec2(0), glm::vec2(1));
+                GridMesh::FillIndices(&smallIndices[g][0], SMALL_GRID, SMALL_GRID, GridMesh::OPTIMIZED_TRIANGLES);
+            });
+            ms[3] += elapsedMs(start);
+        }
+
+        cout << "	" << threads << (threads == 1 ? " thread:" : " threads:") << endl;
+        const char* names[4] = {"grid 2000x2000", "cull 1M spheres", "BC1 2048x2048", "64 grids 250x250, nested"};
+        for (int w = 0; w < 4; w++) {
+            ms[w] /= runs;
+            if (threads == 1) {
+                oneThreadMs[w] = ms[w];
+            }
+            cout << "		" << names[w] << ": " << ms[w] << " ms, " << oneThreadMs[w] / ms[w] << "x" << endl;
+        }
+    }
+    pool->SetThreadLimit(0);
+}
+
+//events on the SDL queue, nine in ten mouse motion and the rest W pressed
+//and released
+void pushInputFlood(int events)
+{
+    SDL_Event event;
+    for (int e = 0; e < events; e++) {
+        memset(&event, 0, sizeof(event));
+        if (e % 10 == 0) {
+            event.type = (e % 20 == 0) ? SDL_KEYDOWN : SDL_KEYUP;
+            event.key.keysym.scancode = SDL_SCANCODE_W;
+        } else {
+            event.type = SDL_MOUSEMOTION;
+            event.motion.xrel = 1;
+            event.motion.yrel = -1;
+        }
+        SDL_PushEvent(&event);
+    }
+}
+
+//more input per frame than a high rate mouse and a few joysticks send,
+//drained by one poll per frame as update used to and by
+//InputHandler::update. Needs no window, SDL_VIDEODRIVER=dummy runs only
+//this benchmark.
+void benchInputFlood()
+{
+    const int EVENTS_PER_FRAME = 500;
+
+    cout << "Input flood, " << EVENTS_PER_FRAME << " events per frame:" << endl;
+    SDL_FlushEvents(SDL_FIRSTEVENT, SDL_LASTEVENT);
+
+    //every frame leaves all but one event for later
+    for (int f = 0; f < BENCH_FRAMES; f++) {
+        pushInputFlood(EVENTS_PER_FRAME);
+        SDL_Event event;
+        SDL_PollEvent(&event);
+    }
+    int backlog = SDL_PeepEvents(0, 0, SDL_PEEKEVENT, SDL_FIRSTEVENT, SDL_LASTEVENT);
+    cout << "	one event per frame: " << backlog << " events behind after " << BENCH_FRAMES << " frames" << endl;
+    SDL_FlushEvents(SDL_FIRSTEVENT, SDL_LASTEVENT);
+
+    double ms = 0;
+    float moved = 0;
+    int kept = 0;
+    for (int f = 0; f < BENCH_FRAMES; f++) {
+        pushInputFlood(EVENTS_PER_FRAME);
+        Uint64 start = SDL_GetPerformanceCounter();
+        TheInputHandler::Instance()->update();
+        ms += elapsedMs(start);
+        moved += TheInputHandler::Instance()->getMouseDelta().getX();
+        kept += TheInputHandler::Instance()->getEventCount();
+    }
+    backlog = SDL_PeepEvents(0, 0, SDL_PEEKEVENT, SDL_FIRSTEVENT, SDL_LASTEVENT);
+    printResult("InputHandler::update", ms, BENCH_FRAMES);
+    cout << "		" << backlog << " events behind, " << kept << " kept, mouse moved " << moved << " of "
+         << BENCH_FRAMES * (EVENTS_PER_FRAME - EVENTS_PER_FRAME / 10) << endl;
+}
+
+Game::Game():
+m_pWindow(0),
+m_bRunning(false),
+m_pGameStateMachine(0),
+m_playerLives(3),
+m_scrollSpeed(0.8f),
+m_bLevelComplete(false),
+m_bChangingState(false)
+{
+    m_pShader = new GLSLShader();
+    // start at this level
+    m_currentLevel = 1;
+}
+
+Game::~Game()
+{
+    clean();
+}
+
+GAME_STATUS_TAG Game::init(const char* title, int xpos, int ypos, int width, int height, int flags)
+{
+    // store the game width and height
+    m_gameWidth = width;
+    m_gameHeight = height;
+
+    //Initialize SDL
+    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_HAPTIC | SDL_INIT_TIMER) >= 0) {
+        //a headless run has no GL, only the input benchmark works there
+        const char* driver = SDL_GetCurrentVideoDriver();
+        if (driver != 0 && strcmp(driver, "dummy") == 0) {
+            benchInputFlood();
+            m_openglContext = 0;
+            m_pGameStateMachine = new GameStateMachine();
+            m_bRunning = false;
+            return GAME_INIT_SUCCESS;
+        }
+
+        // we must wish our OpenGL Version!!
+        SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+        SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
+        SDL_GL_SetAttribute(SDL_GL_ACCELERATED_VISUAL, 1);
+        SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+
+        //if succeeded create our window
+        m_pWindow = SDL_CreateWindow(title, xpos, ypos, width, height, SDL_WINDOW_OPENGL | SDL_WINDOW_SHOWN);
+
+        //If the window creation succeeded create our render
+        if (m_pWindow != 0) {
+            m_openglContext = SDL_GL_CreateContext(m_pWindow);
+            if (m_openglContext == 0) {
+                std::cout << "Error while creating OpenGL context: " << SDL_GetError() << endl;
+            }
+        } else {
+            return GAME_ERROR_WINDOW_INIT_FAIL;
+        }
+
+        // Initialize GLEW
+        glewExperimental = true; // Needed for core profile, or glew func may crash
+        if (glewInit() != GLEW_OK) {
+            fprintf(stderr, "Failed to initialize GLEW\n");
+            return GAME_ERROR_GLEW_INIT_FAIL;
+        }
+    } else {
+        return GAME_ERROR_SDL_INIT_FAIL; //SDL could not initialize
+    }
+
+    m_pGameStateMachine = new GameStateMachine();
+
+    cout << "Renderer: " << glGetString(GL_RENDERER) << endl;
+
+    //run every benchmark once, the main loop is never entered
+    benchUniforms();
+    benchShaderCompile();
+    benchRenderQueue();
+    benchFrustumCulling();
+    benchAABBTree();
+    benchOcean();
+    benchIndexBuffers();
+    benchGridLayouts();
+    benchGridStartup();
+    benchTextureLoader();
+    benchTextureCache();
+    benchImageOps();
+    benchJobScaling();
+    benchInputFlood();
+
+    m_bRunning = false;
+
+    return GAME_INIT_SUCCESS;
+}
+
+void Game::render(float alpha)
+{
+    SDL_GL_SwapWindow(m_pWindow);
+}
+
+void Game::clean()
+{
+    cout << "cleaning game\n";
+
+    TheInputHandler::Instance()->clean();
+
+    m_pGameStateMachine->clean();
+    m_pGameStateMachine = 0;
+
+    delete m_pGameStateMachine;
+    delete m_pShader;
+
+    SDL_GL_DeleteContext(m_openglContext);
+    SDL_DestroyWindow(m_pWindow);
+    SDL_Quit();
+}
+
+void Game::quit()
+{
+    m_bRunning = false;
+}
+
+void Game::handleEvents()
+{
+    TheInputHandler::Instance()->update();
+}
+
+void Game::update(float dt)
+{
+}
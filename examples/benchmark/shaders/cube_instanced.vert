@@ -0,0 +1,9 @@
+#version 330 core
+  
+layout(location=0) in vec3 vVertex;	//object space vertex position
+in mat4 instanceMVP;			//per instance modelview projection matrix
+
+void main()
+{
+	gl_Position = instanceMVP*vec4(vVertex,1);
+}
@@ -0,0 +1,13 @@
+#version 330 core
+  
+layout(location=0) in vec3 vVertex;	//object space vertex position
+
+//uniforms
+uniform mat4 MVP;		//combined modelview projection matrix
+uniform float time;		//elapsed time
+
+void main()
+{
+	//offset the vertex by time so both uniforms stay active
+	gl_Position = MVP*vec4(vVertex.x, vVertex.y + time, vVertex.z, 1);
+}
@@ -7,6 +7,7 @@
 
 #include "Game.h"
 #include "InputHandler.h"
+#include "opengl/TextureCache.h"
 
 using namespace std;
 
@@ -100,6 +101,9 @@ GAME_STATUS_TAG Game::init(const char* title, int xpos, int ypos, int width, int
     // Accept fragment if it closer to the camera than the former one
     glDepthFunc(GL_LESS);
 
+    //reuse programs linked by a previous run
+    GLSLShader::SetProgramCacheDirectory("shadercache");
+
     //GL_CHECK_ERRORS
     //load shader
     m_pShader->LoadFromFile(GL_VERTEX_SHADER, "shaders/shader.vert");
@@ -111,9 +115,10 @@ GAME_STATUS_TAG Game::init(const char* title, int xpos, int ypos, int width, int
         m_pShader->AddAttribute("vVertex");
         m_pShader->AddUniform("textureMap");
         //pass values of constant uniforms at initialization
-        glUniform1i((*m_pShader)("textureMap"), 0);
+        m_pShader->SetSampler(m_pShader->GetUniform("textureMap"), 0);
         
     m_pShader->UnUse();
+    GLSLShader::PrintProgramCacheStats(cout);
     //GL_CHECK_ERRORS
 
     //setup quad geometry
@@ -154,46 +159,25 @@ GAME_STATUS_TAG Game::init(const char* title, int xpos, int ypos, int width, int
         glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), &indices[0], GL_STATIC_DRAW);
         //GL_CHECK_ERRORS
 
-        	//load the image using SOIL
-	int texture_width = 0, texture_height = 0, channels=0;
-	GLubyte* pData = SOIL_load_image(filename.c_str(), &texture_width, &texture_height, &channels, SOIL_LOAD_AUTO);
-	if(pData == NULL) {
+	//load the image from the texture cache, cooked from the png on the first
+	//run: flipped, mip mapped and block compressed ahead of time
+	textureID = TextureCache::LoadOrCook(filename, "texturecache/Lenna.txc");
+	if(textureID == 0) {
 		cerr<<"Cannot load image: "<<filename.c_str()<<endl;
 		exit(EXIT_FAILURE);
 	}
-	//vertically flip the image on Y axis since it is inverted
-	int i,j;
-	for( j = 0; j*2 < texture_height; ++j )
-	{
-		int index1 = j * texture_width * channels;
-		int index2 = (texture_height - 1 - j) * texture_width * channels;
-		for( i = texture_width * channels; i > 0; --i )
-		{
-			GLubyte temp = pData[index1];
-			pData[index1] = pData[index2];
-			pData[index2] = temp;
-			++index1;
-			++index2;
-		}
-	}
-	//setup OpenGL texture and bind to texture unit 0
-	glGenTextures(1, &textureID);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		//set texture parameters
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	//bind to texture unit 0
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, textureID);
+		//set texture parameters, the cache set the filters
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
 
-		//allocate texture 
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, texture_width, texture_height, 0, GL_RGB, GL_UNSIGNED_BYTE, pData);
-
 
     return GAME_INIT_SUCCESS;
 }
 
-void Game::render()
+void Game::render(float alpha)
 {
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -239,7 +223,7 @@ void Game::handleEvents()
     TheInputHandler::Instance()->update();
 }
 
-void Game::update()
+void Game::update(float dt)
 {
     //m_pGameStateMachine->update();
 }
\ No newline at end of file
@@ -8,6 +8,12 @@
 #include "Game.h"
 #include "InputHandler.h"
 #include "opengl/FreeCamera.h"
+#include "opengl/GLSLShaderWatcher.h"
+#include "opengl/GridMesh.h"
+#include "FrameMailbox.h"
+#include "GameLoop.h"
+#include <mutex>
+#include <gtx/euler_angles.hpp>
 
 using namespace std;
 
@@ -16,6 +22,10 @@ using namespace std;
 //shader reference
 GLSLShader shader;
 
+//resolved shader uniforms
+GLSLShader::UniformHandle mvpUniform;
+GLSLShader::UniformHandle timeUniform;
+
 //vertex array and vertex buffer object IDs
 GLuint vaoID;
 GLuint vboVerticesID;
@@ -36,9 +46,11 @@ const float SPEED = 2;
 const float EPSILON = 0.001f;
 const float EPSILON2 = EPSILON*EPSILON;
 
-//ripple mesh vertices and indices
+//ripple mesh vertices and indices, one triangle strip per row of quads
+//separated by restart indices, 2 indices per quad instead of 6
 glm::vec3 vertices[(NUM_X+1)*(NUM_Z+1)];
-const int TOTAL_INDICES = NUM_X*NUM_Z*2*3;
+const int TOTAL_INDICES = NUM_Z*2*(NUM_X+1) + (NUM_Z-1);
+const GLushort RESTART_INDEX = 0xFFFF;
 GLushort indices[TOTAL_INDICES];
 
 //projection and modelview matrices
@@ -46,16 +58,11 @@ glm::mat4  P = glm::mat4(1);
 glm::mat4 MV = glm::mat4(1);
 
 //camera tranformation variables
-int state = 1, oldX=0, oldY=0;
+int state = 1;
 float rX=0, rY=0, fov = 45;
 
-//current time
-float time = 0;
-
-//delta time
-float dt = 0;
-
-//timing related variables
+//simulation time of the previous and of the last update, rendering blends
+//between them
 float last_time=0, current_time =0;
 
 //free camera instance
@@ -75,6 +82,38 @@ float mouseX=0, mouseY=0; //filtered mouse values
 //flag to enable filtering
 bool useFiltering = true;
 
+//camera controls sampled by handleInput on the render thread and applied by
+//update, which may run on the simulation thread
+struct CameraControls {
+    float walk, strafe, lift;   //-1, 0 or 1
+    float yaw, pitch, fov;
+};
+CameraControls controls = {0, 0, 0, 0, 0, 45};
+mutex controlsLock;
+//the controls update applied last, simulation side only
+CameraControls appliedControls = controls;
+
+//where the camera is after an update, yaw, pitch and fov in degrees as the
+//controls give them
+struct CameraPose {
+    glm::vec3 position;
+    float yaw, pitch, fov;
+};
+//the pose of the previous and of the last update, simulation side only.
+//Rendering blends between them like between last_time and current_time.
+CameraPose previousPose, currentPose;
+
+//what render needs of one update, handed over from the simulation thread.
+//It carries the camera state of both steps rather than the matrices of the
+//last one, so render can blend them by the snapshot's own stepEnd.
+struct FrameSnapshot {
+    CameraPose previousPose, currentPose;
+    float aspectRatio;
+    float last_time, current_time;
+    double stepEnd;
+};
+FrameMailbox<FrameSnapshot> frames;
+
 Game* Game::s_pInstance = 0;
 
 //mouse move filtering function
@@ -105,64 +144,137 @@ void filterMouseMoves(float dx, float dy) {
     mouseY = averageY / averageTotal;
 }
 
+//keyboard camera movement, a simulation step of dt seconds
+void moveCamera(float dt)
+{
+    CameraControls input;
+    {
+        lock_guard<mutex> guard(controlsLock);
+        input = controls;
+    }
+    if (input.fov != appliedControls.fov) {
+        cam.SetupProjection(input.fov, cam.GetAspectRatio());
+    }
+    if (input.yaw != appliedControls.yaw || input.pitch != appliedControls.pitch) {
+        cam.Rotate(input.yaw, input.pitch, 0);
+    }
+    appliedControls = input;
+
+    if (input.walk != 0) {
+        cam.Walk(input.walk * dt);
+    }
+
+    if (input.strafe != 0) {
+        cam.Strafe(input.strafe * dt);
+    }
+
+    if (input.lift != 0) {
+        cam.Lift(input.lift * dt);
+    }
+
+    glm::vec3 t = cam.GetTranslation(); 
+    if(glm::dot(t,t)>EPSILON2) {
+        cam.SetTranslation(t*0.95f);
+    }
+}
+
+CameraPose getCameraPose()
+{
+    CameraPose pose;
+    pose.position = cam.GetPosition();
+    pose.yaw = appliedControls.yaw;
+    pose.pitch = appliedControls.pitch;
+    pose.fov = appliedControls.fov;
+    return pose;
+}
+
+//the view matrix alpha of the way from pose a to pose b, built the way
+//CFreeCamera::Update builds it
+glm::mat4 blendView(const CameraPose& a, const CameraPose& b, float alpha)
+{
+    glm::vec3 position = a.position + (b.position - a.position) * alpha;
+    float yaw = glm::radians(a.yaw + (b.yaw - a.yaw) * alpha);
+    float pitch = glm::radians(a.pitch + (b.pitch - a.pitch) * alpha);
+    glm::mat4 R = glm::yawPitchRoll(yaw, pitch, 0.0f);
+    glm::vec3 look = glm::vec3(R*glm::vec4(0,0,1,0));
+    glm::vec3 up = glm::vec3(R*glm::vec4(0,1,0,0));
+    return glm::lookAt(position, position + look, up);
+}
+
+//the projection alpha of the way from pose a to pose b, as
+//CAbstractCamera::SetupProjection sets it up
+glm::mat4 blendProjection(const CameraPose& a, const CameraPose& b, float alpha, float aspectRatio)
+{
+    return glm::perspective(a.fov + (b.fov - a.fov) * alpha, aspectRatio, 0.1f, 1000.0f);
+}
+
+void publishFrame()
+{
+    FrameSnapshot& frame = frames.beginWrite();
+    frame.previousPose = previousPose;
+    frame.currentPose = currentPose;
+    frame.aspectRatio = cam.GetAspectRatio();
+    frame.last_time = last_time;
+    frame.current_time = current_time;
+    frame.stepEnd = TheGameLoop::Instance()->getStepEnd();
+    frames.publish();
+}
+
 void handleInput()
 {
+    CameraControls input;
+
     //handle keyboard input
+    input.walk = input.strafe = input.lift = 0;
     if (TheInputHandler::Instance()->isKeyDown(SDL_SCANCODE_W)) {
-        cam.Walk(dt);
+        input.walk += 1;
     }
 
     if (TheInputHandler::Instance()->isKeyDown(SDL_SCANCODE_S)) {
-        cam.Walk(-dt);
+        input.walk -= 1;
     }
 
     if (TheInputHandler::Instance()->isKeyDown(SDL_SCANCODE_A)) {
-        cam.Strafe(-dt);
+        input.strafe -= 1;
     }
 
     if (TheInputHandler::Instance()->isKeyDown(SDL_SCANCODE_D)) {
-        cam.Strafe(dt);
+        input.strafe += 1;
     }
 
     if (TheInputHandler::Instance()->isKeyDown(SDL_SCANCODE_Q)) {
-        cam.Lift(dt);
+        input.lift += 1;
     }
 
     if (TheInputHandler::Instance()->isKeyDown(SDL_SCANCODE_V)) {
-        cam.Lift(-dt);
-    }
-
-    glm::vec3 t = cam.GetTranslation(); 
-    if(glm::dot(t,t)>EPSILON2) {
-        cam.SetTranslation(t*0.95f);
+        input.lift -= 1;
     }
 
-    //handle mouse position change
-    Vector2D *mouseVector = TheInputHandler::Instance()->getMousePosition();
-    int x = mouseVector->getX();
-    int y = mouseVector->getY();
+    //handle mouse motion since the last frame
+    Vector2D delta = TheInputHandler::Instance()->getMouseDelta();
+    float dx = delta.getX();
+    float dy = delta.getY();
 
-    if (x == 0 && y == 0) {
-        return;
-    }
-    
-    if (state == 0) {
-        fov += (y - oldY)/5.0f;
-        cam.SetupProjection(fov, cam.GetAspectRatio());
-    } else {
-        rY += (y - oldY)/10.0f;
-        rX += (oldX - x)/10.0f;
-        if(useFiltering)
-            filterMouseMoves(rX, rY);
-        else { 
-            mouseX = rX;
-            mouseY = rY;
+    if (dx != 0 || dy != 0) {
+        if (state == 0) {
+            fov += dy/5.0f;
+        } else {
+            rY += dy/10.0f;
+            rX -= dx/10.0f;
+            if(useFiltering)
+                filterMouseMoves(rX, rY);
+            else { 
+                mouseX = rX;
+                mouseY = rY;
+            }
         }
-        cam.Rotate(mouseX, mouseY, 0);
     }
 
-    oldX = x;
-    oldY = y;
+    input.yaw = mouseX;
+    input.pitch = mouseY;
+    input.fov = fov;
+    lock_guard<mutex> guard(controlsLock);
+    controls = input;
 }
 
 Game::Game():
@@ -221,10 +333,6 @@ GAME_STATUS_TAG Game::init(const char* title, int xpos, int ypos, int width, int
         return GAME_ERROR_SDL_INIT_FAIL; //SDL could not initialize
     }
 
-    SDL_WarpMouseInWindow(m_pWindow, width / 2, height / 2);
-    oldX = width / 2;
-    oldY = height / 2;
-
     m_bRunning = true;
 
     m_pGameStateMachine = new GameStateMachine();
@@ -238,6 +346,11 @@ GAME_STATUS_TAG Game::init(const char* title, int xpos, int ypos, int width, int
     //set the polygon mode to render lines
     glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
+    //reuse programs linked by a previous run
+    GLSLShader::SetProgramCacheDirectory("shadercache");
+    //rebuild programs when their shader files are saved
+    GLSLShader::EnableHotReload(true);
+
     //GL_CHECK_ERRORS
     //load shader
     shader.LoadFromFile(GL_VERTEX_SHADER, "shaders/shader.vert");
@@ -249,7 +362,10 @@ GAME_STATUS_TAG Game::init(const char* title, int xpos, int ypos, int width, int
     shader.AddAttribute("vVertex");
     shader.AddUniform("MVP");
     shader.AddUniform("time");
+    mvpUniform = shader.GetUniform("MVP");
+    timeUniform = shader.GetUniform("time");
     shader.UnUse();
+    GLSLShader::PrintProgramCacheStats(cout);
 
     //GL_CHECK_ERRORS
 
@@ -264,21 +380,10 @@ GAME_STATUS_TAG Game::init(const char* title, int xpos, int ypos, int width, int
     }
 
     //fill plane indices array
-    GLushort* id=&indices[0];
-    for (i = 0; i < NUM_Z; i++) {
-        for (j = 0; j < NUM_X; j++) {
-            int i0 = i * (NUM_X+1) + j;
-            int i1 = i0 + 1;
-            int i2 = i0 + (NUM_X+1);
-            int i3 = i2 + 1;
-            if ((j+i)%2) {
-                *id++ = i0; *id++ = i2; *id++ = i1;
-                *id++ = i1; *id++ = i2; *id++ = i3;
-            } else {
-                *id++ = i0; *id++ = i2; *id++ = i3;
-                *id++ = i0; *id++ = i3; *id++ = i1;
-            }
-        }
+    GLuint stripIndices[TOTAL_INDICES];
+    GridMesh::FillIndices(stripIndices, NUM_X, NUM_Z, GridMesh::TRIANGLE_STRIPS);
+    for (i = 0; i < TOTAL_INDICES; i++) {
+        indices[i] = (stripIndices[i] == GridMesh::RESTART_INDEX) ? RESTART_INDEX : GLushort(stripIndices[i]);
     }
 
     //GL_CHECK_ERRORS
@@ -303,6 +408,10 @@ GAME_STATUS_TAG Game::init(const char* title, int xpos, int ypos, int width, int
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), &indices[0], GL_STATIC_DRAW);
     //GL_CHECK_ERRORS
 
+    //the restart index starts the next row's strip
+    glEnable(GL_PRIMITIVE_RESTART);
+    glPrimitiveRestartIndex(RESTART_INDEX);
+
     //setup camera
     //setup the camera position and look direction
     glm::vec3 p = glm::vec3(5);
@@ -322,33 +431,46 @@ GAME_STATUS_TAG Game::init(const char* title, int xpos, int ypos, int width, int
 
     cam.Rotate(rX,rY,0);
     cam.SetupProjection(45, (GLfloat)width/height);
+    mouseX = rX;
+    mouseY = rY;
+    controls.yaw = appliedControls.yaw = rX;
+    controls.pitch = appliedControls.pitch = rY;
+    previousPose = currentPose = getCameraPose();
+    publishFrame();
 
     cout<<"Initialization successfull"<<endl;
 
     return GAME_INIT_SUCCESS;
 }
 
-void Game::render()
+void Game::render(float alpha)
 {
-    last_time = current_time;
-    current_time = SDL_GetTicks() / 1000.0f;
-    dt = current_time - last_time;
+    //pick up edited shaders before drawing with them
+    GLSLShaderWatcher::Instance()->Update();
+
+    //the newest update, blended by its own stamp as the loop's alpha may
+    //belong to a step published after it
+    frames.acquire();
+    const FrameSnapshot& frame = frames.read();
+    alpha = TheGameLoop::Instance()->getAlpha(frame.stepEnd);
+    float render_time = frame.last_time + (frame.current_time - frame.last_time) * alpha;
 
     //clear color buffer and depth buffer
     glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
 
-    //set the camera transformation
-    glm::mat4 MV	= cam.GetViewMatrix();
-    glm::mat4 P     = cam.GetProjectionMatrix();
+    //set the camera transformation, between the poses of the last two
+    //updates as the camera only moves in whole steps
+    glm::mat4 MV	= blendView(frame.previousPose, frame.currentPose, alpha);
+    glm::mat4 P     = blendProjection(frame.previousPose, frame.currentPose, alpha, frame.aspectRatio);
     glm::mat4 MVP	= P*MV;
 
     //bind the shader 
     shader.Use();
     //set the shader uniforms
-    glUniformMatrix4fv(shader("MVP"), 1, GL_FALSE, glm::value_ptr(MVP));
-    glUniform1f(shader("time"), current_time * 2);
+    shader.SetUniform(mvpUniform, MVP);
+    shader.SetUniform(timeUniform, render_time * 2);
     //draw the mesh triangles
-    glDrawElements(GL_TRIANGLES, TOTAL_INDICES, GL_UNSIGNED_SHORT, 0);
+    glDrawElements(GL_TRIANGLE_STRIP, TOTAL_INDICES, GL_UNSIGNED_SHORT, 0);
 
     //unbind the shader
     shader.UnUse();
@@ -386,7 +508,13 @@ void Game::handleEvents()
     handleInput();
 }
 
-void Game::update()
+void Game::update(float dt)
 {
     //m_pGameStateMachine->update();
+    previousPose = currentPose;
+    moveCamera(dt);
+    currentPose = getCameraPose();
+    last_time = current_time;
+    current_time += dt;
+    publishFrame();
 }
\ No newline at end of file
@@ -8,6 +8,7 @@
 #include "Game.h"
 #include "InputHandler.h"
 #include "opengl/FreeCamera.h"
+#include "opengl/GLSLShaderWatcher.h"
 
 using namespace std;
 
@@ -20,17 +21,52 @@ glm::mat4  P = glm::mat4(1);
 glm::mat4 MV = glm::mat4(1);
 
 //camera transformation variables
-int state = 0, oldX=0, oldY=0;
+int state = 0;
 float rX=20, rY=64, dist = -7;
 
 //skybox object
 #include "opengl/skybox.h"
 CSkybox* skybox;
-//skybox texture ID
-GLuint skyboxTextureID;
 
-#include "opengl/WaterSurface.h"
-CWaterSurface* water;
+//decodes the skybox faces in TaskPool background jobs and uploads them over several
+//frames, the sky is a flat placeholder colour until then
+#include "opengl/TextureLoader.h"
+TextureLoader* textureLoader;
+int skyboxCubemap;
+bool skyboxTimingsPrinted = false;
+Uint32 startTicks;
+
+//simulation time of the previous and of the last update, rendering blends
+//between them
+float last_time = 0, current_time = 0;
+
+#include "opengl/WaterClipmap.h"
+CWaterClipmap* water;
+
+//FFT ocean displacing the water, simulated on the CPU every update
+#include "opengl/OceanSimulation.h"
+COceanSimulation* ocean;
+
+//what render needs of one update, handed over from the simulation thread.
+//The camera follows the mouse every frame and stays on the render side.
+#include "FrameMailbox.h"
+#include "GameLoop.h"
+struct FrameSnapshot {
+    float last_time, current_time;
+    double stepEnd;
+    OceanFrame ocean;
+};
+FrameMailbox<FrameSnapshot> frames;
+
+void publishFrame()
+{
+    FrameSnapshot& frame = frames.beginWrite();
+    frame.last_time = last_time;
+    frame.current_time = current_time;
+    frame.stepEnd = TheGameLoop::Instance()->getStepEnd();
+    ocean->CopyFrame(frame.ocean);
+    frames.publish();
+}
 
 //skybox texture names
 const char* texture_names[6] = {
@@ -62,14 +98,10 @@ Game::~Game()
 
 void handleInput()
 {
-    int x = TheInputHandler::Instance()->getMousePosition()->getX();
-    int y = TheInputHandler::Instance()->getMousePosition()->getY();
+    Vector2D delta = TheInputHandler::Instance()->getMouseDelta();
 
-    rY += (x - oldX)/5.0f;
-    rX += (y - oldY)/5.0f;
-
-    oldX = x;
-    oldY = y;
+    rY += delta.getX()/5.0f;
+    rX += delta.getY()/5.0f;
 }
 
 GAME_STATUS_TAG Game::init(const char* title, int xpos, int ypos, int width, int height, int flags)
@@ -120,60 +152,47 @@ GAME_STATUS_TAG Game::init(const char* title, int xpos, int ypos, int width, int
     // Accept fragment if it closer to the camera than the former one
     //glDepthFunc(GL_LESS);
 
+    //reuse programs linked by a previous run
+    GLSLShader::SetProgramCacheDirectory("shadercache");
+    //rebuild programs when their shader files are saved
+    GLSLShader::EnableHotReload(true);
+
     //generate a new Skybox
     skybox = new CSkybox();
 
-    water = new CWaterSurface(1000,1000,1000,1000);
-
-    int texture_widths[6];
-    int texture_heights[6];
-    int channels[6];
-    GLubyte* pData[6];
-
-    cout << "Loading skybox images: ..." << endl;
-    for (int i = 0; i < 6; i++) {
-        cout << "\tLoading: "<< texture_names[i] << "...";
-        pData[i] = SOIL_load_image(texture_names[i], &texture_widths[i], &texture_heights[i], &channels[i], SOIL_LOAD_AUTO);
-        cout << "done." << endl;
-    }
+    //6 rings of 16x16 quad blocks, about 2000x2000 around the eye and
+    //following it, CWaterQuadtree draws a fixed area instead
+    water = new CWaterClipmap(6, 16);
+    //a 256m ocean tile repeated every 64 units
+    ocean = new COceanSimulation(256, 256.0f);
+    water->SetOcean(ocean, 64.0f);
+    ocean->Update(0);
+    publishFrame();
+    GLSLShader::PrintProgramCacheStats(cout);
 
-    //generate OpenGL texture
-    glGenTextures(1, &skyboxTextureID);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxTextureID);
-
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    //glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    // glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-    GLint format = (channels[0] == 4) ? GL_RGBA : GL_RGB;
-    //load the 6 image
-    for (int i = 0; i < 6; i++) {
-        //allocate cubemap data
-        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, format, texture_widths[i], texture_heights[i], 0, format, GL_UNSIGNED_BYTE, pData[i]);
-        SOIL_free_image_data(pData[i]);
-    }
+    textureLoader = new TextureLoader();
+    skyboxCubemap = textureLoader->LoadCubemap(texture_names);
+    startTicks = SDL_GetTicks();
 
     //setup the projection matrix
     P = glm::perspective(60.0f, (GLfloat)width/height, 0.1f, 1000.f);
 
-    SDL_WarpMouseInWindow(m_pWindow, width / 2, height / 2);
-    oldX = width / 2;
-    oldY = height / 2;
-
     cout<<"Initialization successfull"<<endl;
 
     return GAME_INIT_SUCCESS;
 }
 
-void Game::render()
+void Game::render(float alpha)
 {
-    float time = SDL_GetTicks() / 1000.0f * 0.1f;
+    //pick up edited shaders before drawing with them
+    GLSLShaderWatcher::Instance()->Update();
+
+    //the newest update, blended by its own stamp as the loop's alpha may
+    //belong to a step published after it
+    frames.acquire();
+    const FrameSnapshot& frame = frames.read();
+    alpha = TheGameLoop::Instance()->getAlpha(frame.stepEnd);
+    float time = (frame.last_time + (frame.current_time - frame.last_time) * alpha) * 0.1f;
     //clear color and depth buffers
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -184,11 +203,22 @@ void Game::render()
     glm::mat4 S = glm::scale(glm::mat4(1), glm::vec3(1000.0));
     glm::mat4 MVP = P * MV * S;
 
+    //upload the next rows of the skybox faces
+    textureLoader->Update();
+    if (!skyboxTimingsPrinted && textureLoader->IsComplete(skyboxCubemap)) {
+        cout << "Skybox loaded " << SDL_GetTicks() - startTicks << " ms after the request:" << endl;
+        textureLoader->PrintTimings(skyboxCubemap, cout);
+        skyboxTimingsPrinted = true;
+    }
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, textureLoader->GetTexture(skyboxCubemap));
+
     //render the skybox object
     skybox->Render( glm::value_ptr(MVP));
 
     MV = T*MV; 
     water->SetTime(time); 
+    water->SetOceanFrame(&frame.ocean);
 
     glm::vec3 eyePos;
     eyePos.x = -(MV[0][0] * MV[3][0] + MV[0][1] * MV[3][1] + MV[0][2] * MV[3][2]);
@@ -215,6 +245,10 @@ void Game::clean()
 
     m_pShader->DeleteShaderProgram();
 
+    //stops the simulation's worker threads
+    delete ocean;
+    delete textureLoader;
+
     delete m_pGameStateMachine;
     delete m_pShader;
 
@@ -234,7 +268,11 @@ void Game::handleEvents()
     handleInput();
 }
 
-void Game::update()
+void Game::update(float dt)
 {
     //m_pGameStateMachine->update();
+    last_time = current_time;
+    current_time += dt;
+    ocean->Update(current_time);
+    publishFrame();
 }
\ No newline at end of file
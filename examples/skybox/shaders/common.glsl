@@ -0,0 +1,3 @@
+//constants shared by the skybox example shaders, pulled in with #include
+
+const float PI = 3.14159;
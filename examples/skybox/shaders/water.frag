@@ -5,11 +5,16 @@ uniform samplerCube cubeMap;
 
 smooth in vec3 vNormal; 
 smooth in vec3 vPosition;
+smooth in vec2 vGridPosition;
 
 uniform vec3 eyePos;
+uniform vec3 clipmapHole;	//xz centre and half size of the finer clipmap ring, zero size for none
  
 void main(void)
 { 
+	if (all(lessThan(abs(vGridPosition - clipmapHole.xy), vec2(clipmapHole.z)))) {
+		discard;
+	}
 	vec3 eye = normalize(vPosition-eyePos);
     vec3 r = reflect(eye, vNormal);
     vec4 color = texture(cubeMap, r);
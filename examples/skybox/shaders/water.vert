@@ -5,13 +5,21 @@ layout(location=0) in vec3 vVertex;
 uniform mat4 MVP;  
 //uniform mat3 N;				//normal matrix
 uniform float time;
+uniform vec4 patchTransform;	//xz offset, scale and skirt depth of a chunk, (0,0,1,0) for one mesh
+uniform vec4 clipmapMorph;		//xz centre of a clipmap ring, distance where the morph starts and ends, zero for no morph
+uniform float patchResolution;	//quads along a patch side
+uniform vec2 ocean;				//1/tile size and height scale of the FFT ocean, zero keeps the sine waves
+uniform sampler2D oceanDisplacement;	//dx, height, dz
+uniform sampler2D oceanSlope;		//dh/dx, dh/dz
 
  
 smooth out vec3 vNormal; 
 smooth out vec3 vPosition;
+smooth out vec2 vGridPosition;	//xz before any displacement
+
+
+#include "common.glsl"
 
-  
-const float PI = 3.14159;
 const int NUM_WAVES = 4;
  
 float frequencies[NUM_WAVES]=float[NUM_WAVES](16*PI,8*PI,PI/8.0,PI/16.0);
@@ -72,10 +80,37 @@ vec3 waveNormal(vec2 xy) {
 
 void main()
 { 	 	  
-	vec4 pos = vec4(vVertex,1);
-	float offset = rand(vVertex.xz);
-    pos.y = (waveHeight(vVertex.xz +  offset )) * 0.1;
-    vPosition = pos.xyz / pos.w;
-    vNormal = waveNormal(vVertex.xz + offset);    
+	//skirt vertices have y=-1 and hang below the surface
+	vec2 xz = patchTransform.xy + vVertex.xz * patchTransform.z;
+	float k = 0.0;
+	if (clipmapMorph.w > 0) {
+		//towards the ring border odd grid vertices slide onto their even
+		//neighbour, at the border the grid matches the coarser ring outside
+		vec2 d = abs(xz - clipmapMorph.xy);
+		k = clamp((max(d.x, d.y) - clipmapMorph.z) / (clipmapMorph.w - clipmapMorph.z), 0.0, 1.0);
+		vec2 grid = floor(vVertex.xz * patchResolution + 0.5);
+		vec2 odd = grid - 2.0 * floor(grid * 0.5);
+		xz -= odd * (patchTransform.z / patchResolution) * k;
+	}
+	vGridPosition = xz;
+	vec4 pos = vec4(xz.x, 0, xz.y, 1);
+	if (ocean.x > 0) {
+		//the textures repeat every 1/ocean.x units, coarse rings read
+		//coarser mips so they do not alias. The morph blends towards the mip
+		//of the ring outside, border vertices then match it exactly
+		vec2 uv = xz * ocean.x;
+		float texelsPerQuad = patchTransform.z / patchResolution * ocean.x * textureSize(oceanDisplacement, 0).x;
+		float lod = mix(log2(max(texelsPerQuad, 1.0)), log2(max(2.0 * texelsPerQuad, 1.0)), k);
+		vec3 d = textureLod(oceanDisplacement, uv, lod).xyz * ocean.y;
+		vec2 s = textureLod(oceanSlope, uv, lod).xy;
+		pos.xyz += d;
+		pos.y += vVertex.y * patchTransform.w;
+		vNormal = normalize(vec3(-s.x, 1.0, -s.y));
+	} else {
+		float offset = rand(xz);
+		pos.y = (waveHeight(xz +  offset )) * 0.1 + vVertex.y * patchTransform.w;
+		vNormal = waveNormal(xz + offset);
+	}
+	vPosition = pos.xyz / pos.w;
 	gl_Position = MVP*pos; 
 }
\ No newline at end of file
@@ -0,0 +1,53 @@
+//Cooks images into texture cache files ahead of time, so the first run of a
+//game does not pay for it. texture_cooker.vcxproj builds it from
+//SDL2_OPENGL33/opengl/TextureCooker.cpp, ImageOps.cpp, TaskPool.cpp and SOIL,
+//it needs no window or GL context.
+//
+//	texture_cooker [--rgba | --bc1 | --bc3 | --auto] [--no-mips] input output
+
+#include <iostream>
+#include <string.h>
+
+#include "opengl/TextureCooker.h"
+
+using namespace std;
+
+static int usage()
+{
+    cerr << "usage: texture_cooker [--rgba | --bc1 | --bc3 | --auto] [--no-mips] input output" << endl;
+    return 1;
+}
+
+int main(int argc, char* argv[])
+{
+    TextureCooker::Format format = TextureCooker::FORMAT_AUTO;
+    bool mipmaps = true;
+    const char* files[2] = {0, 0};
+    int fileCount = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--rgba") == 0) {
+            format = TextureCooker::FORMAT_RGBA8;
+        } else if (strcmp(argv[i], "--bc1") == 0) {
+            format = TextureCooker::FORMAT_BC1;
+        } else if (strcmp(argv[i], "--bc3") == 0) {
+            format = TextureCooker::FORMAT_BC3;
+        } else if (strcmp(argv[i], "--auto") == 0) {
+            format = TextureCooker::FORMAT_AUTO;
+        } else if (strcmp(argv[i], "--no-mips") == 0) {
+            mipmaps = false;
+        } else if (argv[i][0] == '-' || fileCount == 2) {
+            return usage();
+        } else {
+            files[fileCount++] = argv[i];
+        }
+    }
+    if (fileCount != 2) {
+        return usage();
+    }
+
+    if (!TextureCooker::Cook(files[0], files[1], format, mipmaps)) {
+        return 1;
+    }
+    cout << files[0] << " -> " << files[1] << endl;
+    return 0;
+}